@@ -0,0 +1,185 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+#include <stdlib.h>
+
+#include "detex.h"
+
+// Allocator of the calling thread. When detex_allocator_set is false, malloc() and free()
+// are used.
+static __thread detexAllocator detex_allocator;
+static __thread bool detex_allocator_set = false;
+
+void detexSetAllocator(const detexAllocator *allocator) {
+	if (allocator == NULL) {
+		detex_allocator_set = false;
+		return;
+	}
+	detex_allocator = *allocator;
+	detex_allocator_set = true;
+}
+
+static void *DefaultAlloc(void *user_data, size_t size) {
+	return malloc(size);
+}
+
+static void DefaultFree(void *user_data, void *ptr) {
+	free(ptr);
+}
+
+void detexGetAllocator(detexAllocator *allocator_out) {
+	if (detex_allocator_set) {
+		*allocator_out = detex_allocator;
+		return;
+	}
+	allocator_out->alloc = DefaultAlloc;
+	allocator_out->free = DefaultFree;
+	allocator_out->user_data = NULL;
+}
+
+void *detexAllocate(size_t size) {
+	if (!detex_allocator_set)
+		return malloc(size);
+	return detex_allocator.alloc(detex_allocator.user_data, size);
+}
+
+void detexFree(void *ptr) {
+	if (ptr == NULL)
+		return;
+	if (!detex_allocator_set) {
+		free(ptr);
+		return;
+	}
+	detex_allocator.free(detex_allocator.user_data, ptr);
+}
+
+// Bump arena.
+
+#define DETEX_ARENA_DEFAULT_BLOCK_SIZE (1024 * 1024)
+#define DETEX_ARENA_ALIGNMENT 64
+
+typedef struct detexArenaBlock {
+	struct detexArenaBlock *next;
+	size_t size;
+	size_t used;
+} detexArenaBlock;
+
+struct detexArena {
+	// The most recently allocated block is at the head of the list; the first block is
+	// at the tail and is kept when the arena is reset.
+	detexArenaBlock *blocks;
+	size_t block_size;
+	size_t usage;
+};
+
+// The block header is padded so that the data following it is aligned.
+#define DETEX_ARENA_BLOCK_HEADER_SIZE \
+	((sizeof(detexArenaBlock) + DETEX_ARENA_ALIGNMENT - 1) & ~(size_t)(DETEX_ARENA_ALIGNMENT - 1))
+
+static detexArenaBlock *AllocateArenaBlock(size_t size) {
+	if (size > SIZE_MAX - DETEX_ARENA_BLOCK_HEADER_SIZE - DETEX_ARENA_ALIGNMENT)
+		return NULL;
+	void *memory;
+	if (posix_memalign(&memory, DETEX_ARENA_ALIGNMENT, DETEX_ARENA_BLOCK_HEADER_SIZE + size) != 0)
+		return NULL;
+	detexArenaBlock *block = (detexArenaBlock *)memory;
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+detexArena *detexCreateArena(size_t block_size) {
+	if (block_size == 0)
+		block_size = DETEX_ARENA_DEFAULT_BLOCK_SIZE;
+	detexArena *arena = (detexArena *)malloc(sizeof(detexArena));
+	if (arena == NULL)
+		return NULL;
+	arena->blocks = AllocateArenaBlock(block_size);
+	if (arena->blocks == NULL) {
+		free(arena);
+		return NULL;
+	}
+	arena->block_size = block_size;
+	arena->usage = 0;
+	return arena;
+}
+
+static void *ArenaAlloc(void *user_data, size_t size) {
+	detexArena *arena = (detexArena *)user_data;
+	if (size > SIZE_MAX - DETEX_ARENA_ALIGNMENT)
+		return NULL;
+	size_t aligned_size = (size + DETEX_ARENA_ALIGNMENT - 1) & ~(size_t)(DETEX_ARENA_ALIGNMENT - 1);
+	detexArenaBlock *block = arena->blocks;
+	if (block->size - block->used < aligned_size) {
+		// Start a new block. Allocations larger than the block size get a block of
+		// their own, which is inserted behind the current block so that the space left
+		// in the current block can still be used.
+		bool dedicated = aligned_size > arena->block_size;
+		detexArenaBlock *new_block = AllocateArenaBlock(dedicated ? aligned_size : arena->block_size);
+		if (new_block == NULL)
+			return NULL;
+		if (dedicated && block->next != NULL) {
+			new_block->next = block->next;
+			block->next = new_block;
+		}
+		else {
+			new_block->next = block;
+			arena->blocks = new_block;
+		}
+		block = new_block;
+	}
+	void *ptr = (uint8_t *)block + DETEX_ARENA_BLOCK_HEADER_SIZE + block->used;
+	block->used += aligned_size;
+	arena->usage += aligned_size;
+	return ptr;
+}
+
+static void ArenaFree(void *user_data, void *ptr) {
+	// Individual allocations are released when the arena is reset or destroyed.
+}
+
+void detexGetArenaAllocator(detexArena *arena, detexAllocator *allocator_out) {
+	allocator_out->alloc = ArenaAlloc;
+	allocator_out->free = ArenaFree;
+	allocator_out->user_data = arena;
+}
+
+void detexResetArena(detexArena *arena) {
+	detexArenaBlock *block = arena->blocks;
+	while (block->next != NULL) {
+		detexArenaBlock *next = block->next;
+		free(block);
+		block = next;
+	}
+	block->used = 0;
+	arena->blocks = block;
+	arena->usage = 0;
+}
+
+void detexDestroyArena(detexArena *arena) {
+	if (arena == NULL)
+		return;
+	detexResetArena(arena);
+	free(arena->blocks);
+	free(arena);
+}
+
+size_t detexGetArenaUsage(const detexArena *arena) {
+	return arena->usage;
+}
@@ -20,26 +20,6 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "bits.h"
 
 uint32_t detexBlock128ExtractBits(detexBlock128 *block, int nu_bits) {
-	uint32_t value = 0;
-	for (int i = 0; i < nu_bits; i++) {
-		if (block->index < 64) {
-			int shift = block->index - i;
-			if (shift < 0)
-				value |= (block->data0 & ((uint64_t)1 << block->index)) << (- shift);
-			else
-				value |= (block->data0 & ((uint64_t)1 << block->index)) >> shift;
-		}
-		else {
-			int shift = ((block->index - 64) - i);
-			if (shift < 0)
-				value |= (block->data1 & ((uint64_t)1 << (block->index - 64))) << (- shift);
-			else
-				value |= (block->data1 & ((uint64_t)1 << (block->index - 64))) >> shift;
-		}
-		block->index++;
-	}
-//	if (block->index > 128)
-//		printf("Block overflow (%d)\n", block->index);
-	return value;
+	return detexBlock128ExtractBitsInline(block, nu_bits);
 }
 
@@ -26,6 +26,25 @@ typedef struct {
 
 uint32_t detexBlock128ExtractBits(detexBlock128 *block, int nu_bits);
 
+/* Inline version of detexBlock128ExtractBits. Extracts nu_bits bits (at most 32) */
+/* starting at block->index and advances the index. The value is obtained with */
+/* at most two shifts across data0 and data1, so the cost does not depend on */
+/* nu_bits; when nu_bits is a compile-time constant, the mask is folded as well. */
+static DETEX_INLINE_ONLY uint32_t detexBlock128ExtractBitsInline(detexBlock128 *block, int nu_bits) {
+	int index = block->index;
+	uint64_t value;
+	if (index < 64) {
+		value = block->data0 >> index;
+		// The shift count is in the range [1, 31] when the field crosses into data1.
+		if (index + nu_bits > 64)
+			value |= block->data1 << (64 - index);
+	}
+	else
+		value = block->data1 >> (index - 64);
+	block->index = index + nu_bits;
+	return (uint32_t)(value & (((uint64_t)1 << nu_bits) - 1));
+}
+
 /* Return bitfield from bit0 to bit1 from 64-bit bitstring. */
 static DETEX_INLINE_ONLY uint32_t detexGetBits64(uint64_t data, int bit0, int bit1) {
 	return (data & (((uint64_t)1 << (bit1 + 1)) - 1)) >> bit0;
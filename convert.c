@@ -19,11 +19,285 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "detex.h"
 #include "half-float.h"
 #include "hdr.h"
 #include "misc.h"
+#include "simd.h"
+
+#ifdef DETEX_SIMD_X86
+
+// SIMD kernels for the most common conversions. Each kernel converts as many
+// components or pixels as fit in whole vectors, without accessing memory beyond the
+// end of the buffers, and returns the number it converted; the scalar code of the
+// conversion function handles the rest.
+
+// Byte shuffle masks (applied to each 16-byte group).
+static const uint8_t swap_rb8_shuffle_mask[16] = {
+	2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+};
+static const uint8_t swap_rb16_shuffle_mask[16] = {
+	4, 5, 2, 3, 0, 1, 6, 7, 12, 13, 10, 11, 8, 9, 14, 15
+};
+static const uint8_t rgb8_to_rgbx8_shuffle_mask[16] = {
+	0, 1, 2, 0x80, 3, 4, 5, 0x80, 6, 7, 8, 0x80, 9, 10, 11, 0x80
+};
+static const uint8_t rgb8_to_bgrx8_shuffle_mask[16] = {
+	2, 1, 0, 0x80, 5, 4, 3, 0x80, 8, 7, 6, 0x80, 11, 10, 9, 0x80
+};
+static const uint8_t rgbx8_to_rgb8_shuffle_mask[16] = {
+	0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0x80, 0x80, 0x80, 0x80
+};
+
+// Shuffle the bytes of each 16-byte group of a buffer in-place. Returns the number of
+// bytes processed.
+static DETEX_TARGET_SSSE3 int ShuffleBytesSSSE3(uint8_t *buffer, int size, const uint8_t *mask) {
+	__m128i shuffle = _mm_loadu_si128((const __m128i *)mask);
+	int i = 0;
+	for (; i + 16 <= size; i += 16) {
+		__m128i v = _mm_loadu_si128((__m128i *)(buffer + i));
+		_mm_storeu_si128((__m128i *)(buffer + i), _mm_shuffle_epi8(v, shuffle));
+	}
+	return i;
+}
+
+static DETEX_TARGET_AVX2 int ShuffleBytesAVX2(uint8_t *buffer, int size, const uint8_t *mask) {
+	__m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)mask));
+	int i = 0;
+	for (; i + 32 <= size; i += 32) {
+		__m256i v = _mm256_loadu_si256((__m256i *)(buffer + i));
+		_mm256_storeu_si256((__m256i *)(buffer + i), _mm256_shuffle_epi8(v, shuffle));
+	}
+	return i;
+}
+
+// Flip the sign bit of every component in-place, with the sign bits given as a 16-bit
+// pattern. Returns the number of bytes processed.
+static DETEX_TARGET_SSE2 int FlipSignBitsSSE2(uint8_t *buffer, int size, uint16_t sign_bits) {
+	__m128i mask = _mm_set1_epi16(sign_bits);
+	int i = 0;
+	for (; i + 16 <= size; i += 16) {
+		__m128i v = _mm_loadu_si128((__m128i *)(buffer + i));
+		_mm_storeu_si128((__m128i *)(buffer + i), _mm_xor_si128(v, mask));
+	}
+	return i;
+}
+
+static DETEX_TARGET_AVX2 int FlipSignBitsAVX2(uint8_t *buffer, int size, uint16_t sign_bits) {
+	__m256i mask = _mm256_set1_epi16(sign_bits);
+	int i = 0;
+	for (; i + 32 <= size; i += 32) {
+		__m256i v = _mm256_loadu_si256((__m256i *)(buffer + i));
+		_mm256_storeu_si256((__m256i *)(buffer + i), _mm256_xor_si256(v, mask));
+	}
+	return i;
+}
+
+// Expand packed 24-bit pixels to 32-bit pixels with alpha 0xFF, reordering the
+// components according to mask. Returns the number of pixels converted. Each 16-byte
+// load covers 4 source pixels plus 4 bytes that are not used, which must lie within the
+// source buffer.
+static DETEX_TARGET_SSSE3 int ExpandPixel24ToPixel32SSSE3(const uint8_t * DETEX_RESTRICT source_pixel_buffer,
+int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer, const uint8_t *mask) {
+	__m128i shuffle = _mm_loadu_si128((const __m128i *)mask);
+	__m128i alpha = _mm_set1_epi32(0xFF000000);
+	int i = 0;
+	for (; i + 6 <= nu_pixels; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(source_pixel_buffer + i * 3));
+		v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha);
+		_mm_storeu_si128((__m128i *)(target_pixel_buffer + i * 4), v);
+	}
+	return i;
+}
+
+static DETEX_TARGET_AVX2 int ExpandPixel24ToPixel32AVX2(const uint8_t * DETEX_RESTRICT source_pixel_buffer,
+int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer, const uint8_t *mask) {
+	__m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)mask));
+	__m256i alpha = _mm256_set1_epi32(0xFF000000);
+	int i = 0;
+	for (; i + 10 <= nu_pixels; i += 8) {
+		__m128i v0 = _mm_loadu_si128((const __m128i *)(source_pixel_buffer + i * 3));
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(source_pixel_buffer + i * 3 + 12));
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(v0), v1, 1);
+		v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha);
+		_mm256_storeu_si256((__m256i *)(target_pixel_buffer + i * 4), v);
+	}
+	return i;
+}
+
+// Pack 32-bit RGBX8 pixels into 24-bit RGB8 pixels. Returns the number of pixels
+// converted. Each 16-byte store writes 4 bytes past the 4 target pixels, which are
+// overwritten by the next store and must lie within the target buffer.
+static DETEX_TARGET_SSSE3 int PackPixel32ToPixel24SSSE3(const uint8_t * DETEX_RESTRICT source_pixel_buffer,
+int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	__m128i shuffle = _mm_loadu_si128((const __m128i *)rgbx8_to_rgb8_shuffle_mask);
+	int i = 0;
+	for (; i + 6 <= nu_pixels; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(source_pixel_buffer + i * 4));
+		_mm_storeu_si128((__m128i *)(target_pixel_buffer + i * 3), _mm_shuffle_epi8(v, shuffle));
+	}
+	return i;
+}
+
+static DETEX_TARGET_AVX2 int PackPixel32ToPixel24AVX2(const uint8_t * DETEX_RESTRICT source_pixel_buffer,
+int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	__m256i shuffle = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)rgbx8_to_rgb8_shuffle_mask));
+	int i = 0;
+	for (; i + 10 <= nu_pixels; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(source_pixel_buffer + i * 4));
+		v = _mm256_shuffle_epi8(v, shuffle);
+		_mm_storeu_si128((__m128i *)(target_pixel_buffer + i * 3), _mm256_castsi256_si128(v));
+		_mm_storeu_si128((__m128i *)(target_pixel_buffer + i * 3 + 12), _mm256_extracti128_si256(v, 1));
+	}
+	return i;
+}
+
+// Widen 8-bit components to 16-bit (x * 65535 / 255, which equals x * 257), and OR
+// each 64-bit group of four target components with or_bits (used to set alpha).
+// Returns the number of components converted. Since this may end in the middle of a
+// pixel, callers resume the scalar conversion at the start of that pixel.
+static DETEX_TARGET_SSE2 int WidenComponents8To16SSE2(const uint8_t * DETEX_RESTRICT source_buffer,
+int nu_components, uint8_t * DETEX_RESTRICT target_buffer, uint64_t or_bits) {
+	__m128i or_mask = _mm_set1_epi64x(or_bits);
+	int i = 0;
+	for (; i + 16 <= nu_components; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(source_buffer + i));
+		__m128i lo = _mm_or_si128(_mm_unpacklo_epi8(v, v), or_mask);
+		__m128i hi = _mm_or_si128(_mm_unpackhi_epi8(v, v), or_mask);
+		_mm_storeu_si128((__m128i *)(target_buffer + i * 2), lo);
+		_mm_storeu_si128((__m128i *)(target_buffer + i * 2 + 16), hi);
+	}
+	return i;
+}
+
+static DETEX_TARGET_AVX2 int WidenComponents8To16AVX2(const uint8_t * DETEX_RESTRICT source_buffer,
+int nu_components, uint8_t * DETEX_RESTRICT target_buffer, uint64_t or_bits) {
+	__m256i or_mask = _mm256_set1_epi64x(or_bits);
+	int i = 0;
+	for (; i + 32 <= nu_components; i += 32) {
+		__m256i lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(source_buffer + i)));
+		__m256i hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(source_buffer + i + 16)));
+		lo = _mm256_or_si256(_mm256_or_si256(lo, _mm256_slli_epi16(lo, 8)), or_mask);
+		hi = _mm256_or_si256(_mm256_or_si256(hi, _mm256_slli_epi16(hi, 8)), or_mask);
+		_mm256_storeu_si256((__m256i *)(target_buffer + i * 2), lo);
+		_mm256_storeu_si256((__m256i *)(target_buffer + i * 2 + 32), hi);
+	}
+	return i;
+}
+
+// Narrow 16-bit components in 32-bit lanes to 8-bit precision, computing
+// (x + 127) * 255 / 65535 exactly as (t + (t >> 16) + 1) >> 16 with t = (x + 127) * 255.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 __m128i NarrowComponents32SSE2(__m128i x) {
+	__m128i t = _mm_add_epi32(x, _mm_set1_epi32(127));
+	t = _mm_sub_epi32(_mm_slli_epi32(t, 8), t);
+	t = _mm_add_epi32(_mm_add_epi32(t, _mm_srli_epi32(t, 16)), _mm_set1_epi32(1));
+	return _mm_srli_epi32(t, 16);
+}
+
+static DETEX_INLINE_ONLY DETEX_TARGET_AVX2 __m256i NarrowComponents32AVX2(__m256i x) {
+	__m256i t = _mm256_add_epi32(x, _mm256_set1_epi32(127));
+	t = _mm256_sub_epi32(_mm256_slli_epi32(t, 8), t);
+	t = _mm256_add_epi32(_mm256_add_epi32(t, _mm256_srli_epi32(t, 16)), _mm256_set1_epi32(1));
+	return _mm256_srli_epi32(t, 16);
+}
+
+// Narrow 16-bit components to 8-bit, and OR each 32-bit group of four target
+// components with or_bits (used to set alpha). Returns the number of components
+// converted.
+static DETEX_TARGET_SSE2 int NarrowComponents16To8SSE2(const uint8_t * DETEX_RESTRICT source_buffer,
+int nu_components, uint8_t * DETEX_RESTRICT target_buffer, uint32_t or_bits) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i or_mask = _mm_set1_epi32(or_bits);
+	int i = 0;
+	for (; i + 16 <= nu_components; i += 16) {
+		__m128i v0 = _mm_loadu_si128((const __m128i *)(source_buffer + i * 2));
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(source_buffer + i * 2 + 16));
+		__m128i c0 = NarrowComponents32SSE2(_mm_unpacklo_epi16(v0, zero));
+		__m128i c1 = NarrowComponents32SSE2(_mm_unpackhi_epi16(v0, zero));
+		__m128i c2 = NarrowComponents32SSE2(_mm_unpacklo_epi16(v1, zero));
+		__m128i c3 = NarrowComponents32SSE2(_mm_unpackhi_epi16(v1, zero));
+		__m128i v = _mm_packus_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3));
+		_mm_storeu_si128((__m128i *)(target_buffer + i), _mm_or_si128(v, or_mask));
+	}
+	return i;
+}
+
+static DETEX_TARGET_AVX2 int NarrowComponents16To8AVX2(const uint8_t * DETEX_RESTRICT source_buffer,
+int nu_components, uint8_t * DETEX_RESTRICT target_buffer, uint32_t or_bits) {
+	__m256i or_mask = _mm256_set1_epi32(or_bits);
+	int i = 0;
+	for (; i + 32 <= nu_components; i += 32) {
+		__m256i c[4];
+		for (int j = 0; j < 4; j++)
+			c[j] = NarrowComponents32AVX2(_mm256_cvtepu16_epi32(
+				_mm_loadu_si128((const __m128i *)(source_buffer + i * 2 + j * 16))));
+		// The packs interleave the 128-bit lanes, which is undone by the permutes.
+		__m256i p0 = _mm256_permute4x64_epi64(_mm256_packs_epi32(c[0], c[1]), 0xD8);
+		__m256i p1 = _mm256_permute4x64_epi64(_mm256_packs_epi32(c[2], c[3]), 0xD8);
+		__m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi16(p0, p1), 0xD8);
+		_mm256_storeu_si256((__m256i *)(target_buffer + i), _mm256_or_si256(v, or_mask));
+	}
+	return i;
+}
+
+// Dispatch functions.
+
+static int ShuffleBytes(uint8_t *buffer, int size, const uint8_t *mask) {
+	if (detexCPUSupportsAVX2())
+		return ShuffleBytesAVX2(buffer, size, mask);
+	if (detexCPUSupportsSSSE3())
+		return ShuffleBytesSSSE3(buffer, size, mask);
+	return 0;
+}
+
+static int FlipSignBits(uint8_t *buffer, int size, uint16_t sign_bits) {
+	if (detexCPUSupportsAVX2())
+		return FlipSignBitsAVX2(buffer, size, sign_bits);
+	if (detexCPUSupportsSSE2())
+		return FlipSignBitsSSE2(buffer, size, sign_bits);
+	return 0;
+}
+
+static int ExpandPixel24ToPixel32(const uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
+uint8_t * DETEX_RESTRICT target_pixel_buffer, const uint8_t *mask) {
+	if (detexCPUSupportsAVX2())
+		return ExpandPixel24ToPixel32AVX2(source_pixel_buffer, nu_pixels, target_pixel_buffer, mask);
+	if (detexCPUSupportsSSSE3())
+		return ExpandPixel24ToPixel32SSSE3(source_pixel_buffer, nu_pixels, target_pixel_buffer, mask);
+	return 0;
+}
+
+static int PackPixel32ToPixel24(const uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
+uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	if (detexCPUSupportsAVX2())
+		return PackPixel32ToPixel24AVX2(source_pixel_buffer, nu_pixels, target_pixel_buffer);
+	if (detexCPUSupportsSSSE3())
+		return PackPixel32ToPixel24SSSE3(source_pixel_buffer, nu_pixels, target_pixel_buffer);
+	return 0;
+}
+
+static int WidenComponents8To16(const uint8_t * DETEX_RESTRICT source_buffer, int nu_components,
+uint8_t * DETEX_RESTRICT target_buffer, uint64_t or_bits) {
+	if (detexCPUSupportsAVX2())
+		return WidenComponents8To16AVX2(source_buffer, nu_components, target_buffer, or_bits);
+	if (detexCPUSupportsSSE2())
+		return WidenComponents8To16SSE2(source_buffer, nu_components, target_buffer, or_bits);
+	return 0;
+}
+
+static int NarrowComponents16To8(const uint8_t * DETEX_RESTRICT source_buffer, int nu_components,
+uint8_t * DETEX_RESTRICT target_buffer, uint32_t or_bits) {
+	if (detexCPUSupportsAVX2())
+		return NarrowComponents16To8AVX2(source_buffer, nu_components, target_buffer, or_bits);
+	if (detexCPUSupportsSSE2())
+		return NarrowComponents16To8SSE2(source_buffer, nu_components, target_buffer, or_bits);
+	return 0;
+}
+
+#endif
 
 // Conversion functions. For conversions where the pixel size is unchanged,
 // the conversion is performed in-place and target_pixel_buffer will be NULL.
@@ -36,6 +310,13 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel32RGBA8ToPixel32BGRA8(uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
 uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = ShuffleBytes(source_pixel_buffer, nu_pixels * 4, swap_rb8_shuffle_mask) / 4;
+		source_pixel_buffer += n * 4;
+		nu_pixels -= n;
+	}
+#endif
 	uint32_t *source_pixel32_buffer = (uint32_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		/* Swap R and B. */
@@ -53,6 +334,13 @@ uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel64RGBX16ToPixel64BGRX16(uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
 uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = ShuffleBytes(source_pixel_buffer, nu_pixels * 8, swap_rb16_shuffle_mask) / 8;
+		source_pixel_buffer += n * 8;
+		nu_pixels -= n;
+	}
+#endif
 	uint64_t *source_pixel64_buffer = (uint64_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		/* Swap R and B (16-bit). */
@@ -72,6 +360,15 @@ uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel24RGB8ToPixel32BGRX8(uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
 uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = ExpandPixel24ToPixel32(source_pixel_buffer, nu_pixels, target_pixel_buffer,
+			rgb8_to_bgrx8_shuffle_mask);
+		source_pixel_buffer += n * 3;
+		target_pixel_buffer += n * 4;
+		nu_pixels -= n;
+	}
+#endif
 	uint32_t *target_pixel32_buffer = (uint32_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		/* Swap R and B. */
@@ -89,6 +386,13 @@ uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel8R8ToPixel8SignedR8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = FlipSignBits(source_pixel_buffer, nu_pixels, 0x8080);
+		source_pixel_buffer += n;
+		nu_pixels -= n;
+	}
+#endif
 	for (int i = 0; i < nu_pixels; i++) {
 		int32_t red = *source_pixel_buffer;
 		red -= 128;
@@ -99,6 +403,13 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel16RG8ToPixel16SignedRG8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = FlipSignBits(source_pixel_buffer, nu_pixels * 2, 0x8080) / 2;
+		source_pixel_buffer += n * 2;
+		nu_pixels -= n;
+	}
+#endif
 	uint16_t *source_pixel16_buffer = (uint16_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint32_t pixel = *source_pixel16_buffer;
@@ -111,6 +422,13 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel8SignedR8ToPixel8R8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = FlipSignBits(source_pixel_buffer, nu_pixels, 0x8080);
+		source_pixel_buffer += n;
+		nu_pixels -= n;
+	}
+#endif
 	for (int i = 0; i < nu_pixels; i++) {
 		int32_t red = *(int8_t *)source_pixel_buffer + 128;
 		*source_pixel_buffer = (uint8_t)red;
@@ -120,6 +438,13 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel16SignedRG8ToPixel16RG8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = FlipSignBits(source_pixel_buffer, nu_pixels * 2, 0x8080) / 2;
+		source_pixel_buffer += n * 2;
+		nu_pixels -= n;
+	}
+#endif
 	uint16_t *source_pixel16_buffer = (uint16_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint32_t pixel = *source_pixel16_buffer;
@@ -134,6 +459,13 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel16R16ToPixel16SignedR16(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = FlipSignBits(source_pixel_buffer, nu_pixels * 2, 0x8000) / 2;
+		source_pixel_buffer += n * 2;
+		nu_pixels -= n;
+	}
+#endif
 	uint16_t *source_pixel16_buffer = (uint16_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		int32_t red = *source_pixel16_buffer;
@@ -145,6 +477,13 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel32RG16ToPixel32SignedRG16(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = FlipSignBits(source_pixel_buffer, nu_pixels * 4, 0x8000) / 4;
+		source_pixel_buffer += n * 4;
+		nu_pixels -= n;
+	}
+#endif
 	uint32_t *source_pixel32_buffer = (uint32_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint32_t pixel = *source_pixel32_buffer;
@@ -157,6 +496,13 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel16SignedR16ToPixel16R16(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = FlipSignBits(source_pixel_buffer, nu_pixels * 2, 0x8000) / 2;
+		source_pixel_buffer += n * 2;
+		nu_pixels -= n;
+	}
+#endif
 	uint16_t *source_pixel16_buffer = (uint16_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		int32_t red = *(int16_t *)source_pixel16_buffer;
@@ -168,6 +514,13 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel32SignedRG16ToPixel32RG16(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = FlipSignBits(source_pixel_buffer, nu_pixels * 4, 0x8000) / 4;
+		source_pixel_buffer += n * 4;
+		nu_pixels -= n;
+	}
+#endif
 	uint32_t *source_pixel32_buffer = (uint32_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint32_t pixel = *source_pixel32_buffer;
@@ -257,6 +610,14 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel16R16ToPixel8R8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = NarrowComponents16To8(source_pixel_buffer, nu_pixels, target_pixel_buffer, 0);
+		source_pixel_buffer += n * 2;
+		target_pixel_buffer += n * 1;
+		nu_pixels -= n;
+	}
+#endif
 	uint16_t *source_pixel16_buffer = (uint16_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint32_t pixel = *source_pixel16_buffer;
@@ -268,6 +629,14 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel32RG16ToPixel16RG8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = NarrowComponents16To8(source_pixel_buffer, nu_pixels * 2, target_pixel_buffer, 0) / 2;
+		source_pixel_buffer += n * 4;
+		target_pixel_buffer += n * 2;
+		nu_pixels -= n;
+	}
+#endif
 	uint32_t *source_pixel32_buffer = (uint32_t *)source_pixel_buffer;
 	uint16_t *target_pixel16_buffer = (uint16_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
@@ -283,6 +652,14 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel48RGB16ToPixel24RGB8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = NarrowComponents16To8(source_pixel_buffer, nu_pixels * 3, target_pixel_buffer, 0) / 3;
+		source_pixel_buffer += n * 6;
+		target_pixel_buffer += n * 3;
+		nu_pixels -= n;
+	}
+#endif
 	uint16_t *source_pixel16_buffer = (uint16_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint32_t red = source_pixel16_buffer[0];
@@ -298,6 +675,15 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel64RGBX16ToPixel32RGBX8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = NarrowComponents16To8(source_pixel_buffer, nu_pixels * 4, target_pixel_buffer,
+			0xFF000000) / 4;
+		source_pixel_buffer += n * 8;
+		target_pixel_buffer += n * 4;
+		nu_pixels -= n;
+	}
+#endif
 	uint64_t *source_pixel64_buffer = (uint64_t *)source_pixel_buffer;
 	uint32_t *target_pixel32_buffer = (uint32_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
@@ -314,6 +700,14 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel64RGBA16ToPixel32RGBA8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = NarrowComponents16To8(source_pixel_buffer, nu_pixels * 4, target_pixel_buffer, 0) / 4;
+		source_pixel_buffer += n * 8;
+		target_pixel_buffer += n * 4;
+		nu_pixels -= n;
+	}
+#endif
 	uint64_t *source_pixel64_buffer = (uint64_t *)source_pixel_buffer;
 	uint32_t *target_pixel32_buffer = (uint32_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
@@ -331,6 +725,14 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel8R8ToPixel16R16(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = WidenComponents8To16(source_pixel_buffer, nu_pixels, target_pixel_buffer, 0);
+		source_pixel_buffer += n * 1;
+		target_pixel_buffer += n * 2;
+		nu_pixels -= n;
+	}
+#endif
 	uint16_t *target_pixel16_buffer = (uint16_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint32_t pixel = *source_pixel_buffer;
@@ -342,6 +744,14 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel16RG8ToPixel32RG16(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = WidenComponents8To16(source_pixel_buffer, nu_pixels * 2, target_pixel_buffer, 0) / 2;
+		source_pixel_buffer += n * 2;
+		target_pixel_buffer += n * 4;
+		nu_pixels -= n;
+	}
+#endif
 	uint16_t *source_pixel16_buffer = (uint16_t *)source_pixel_buffer;
 	uint32_t *target_pixel32_buffer = (uint32_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
@@ -357,6 +767,14 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel24RGB8ToPixel48RGB16(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = WidenComponents8To16(source_pixel_buffer, nu_pixels * 3, target_pixel_buffer, 0) / 3;
+		source_pixel_buffer += n * 3;
+		target_pixel_buffer += n * 6;
+		nu_pixels -= n;
+	}
+#endif
 	uint16_t *target_pixel16_buffer = (uint16_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint32_t red = source_pixel_buffer[0];
@@ -372,6 +790,15 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel32RGBX8ToPixel64RGBX16(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = WidenComponents8To16(source_pixel_buffer, nu_pixels * 4, target_pixel_buffer,
+			0xFFFF000000000000) / 4;
+		source_pixel_buffer += n * 4;
+		target_pixel_buffer += n * 8;
+		nu_pixels -= n;
+	}
+#endif
 	uint32_t *source_pixel32_buffer = (uint32_t *)source_pixel_buffer;
 	uint64_t *target_pixel64_buffer = (uint64_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
@@ -389,6 +816,14 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel32RGBA8ToPixel64RGBA16(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = WidenComponents8To16(source_pixel_buffer, nu_pixels * 4, target_pixel_buffer, 0) / 4;
+		source_pixel_buffer += n * 4;
+		target_pixel_buffer += n * 8;
+		nu_pixels -= n;
+	}
+#endif
 	uint32_t *source_pixel32_buffer = (uint32_t *)source_pixel_buffer;
 	uint64_t *target_pixel64_buffer = (uint64_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
@@ -657,6 +1092,15 @@ int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel24RGB8ToPixel32RGBX8(uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
 uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = ExpandPixel24ToPixel32(source_pixel_buffer, nu_pixels, target_pixel_buffer,
+			rgb8_to_rgbx8_shuffle_mask);
+		source_pixel_buffer += n * 3;
+		target_pixel_buffer += n * 4;
+		nu_pixels -= n;
+	}
+#endif
 	uint32_t *target_pixel32_buffer = (uint32_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint32_t red = source_pixel_buffer[0];
@@ -670,6 +1114,14 @@ uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 
 static void ConvertPixel32RGBX8ToPixel24RGB8(uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
 uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int n = PackPixel32ToPixel24(source_pixel_buffer, nu_pixels, target_pixel_buffer);
+		source_pixel_buffer += n * 4;
+		target_pixel_buffer += n * 3;
+		nu_pixels -= n;
+	}
+#endif
 	uint32_t *source_pixel32_buffer = (uint32_t *)source_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint32_t pixel = *source_pixel32_buffer;
@@ -704,7 +1156,7 @@ uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 static void ConvertPixel64RGBX16ToPixel48RGB16(uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
 uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 	uint64_t *source_pixel64_buffer = (uint64_t *)source_pixel_buffer;
-	uint16_t *target_pixel16_buffer = (uint16_t *)target_pixel16_buffer;
+	uint16_t *target_pixel16_buffer = (uint16_t *)target_pixel_buffer;
 	for (int i = 0; i < nu_pixels; i++) {
 		uint64_t pixel = *source_pixel64_buffer;
 		target_pixel16_buffer[0] = detexPixel64GetR16(pixel);
@@ -751,6 +1203,56 @@ uint8_t * DETEX_RESTRICT target_pixel_buffer) {
 }
 
 
+// Fused conversions for frequently used format pairs that would otherwise take several
+// passes over the data. The results are identical to those of the multi-step conversion
+// paths they replace.
+
+// Table that maps a normalized half-float to an 8-bit component, giving the same result
+// as converting to a 16-bit component and then to an 8-bit component.
+static uint8_t half_float_to_uint8_table[65536];
+static pthread_once_t half_float_to_uint8_table_once = PTHREAD_ONCE_INIT;
+
+static void CalculateHalfFloatToUInt8Table() {
+	uint16_t *buffer = (uint16_t *)malloc(65536 * sizeof(uint16_t));
+	for (int i = 0; i <= 0xFFFF; i++)
+		buffer[i] = i;
+	detexConvertNormalizedHalfFloatToUInt16(buffer, 65536);
+	for (int i = 0; i <= 0xFFFF; i++)
+		half_float_to_uint8_table[i] = (buffer[i] + 127) * 255 / 65535;
+	free(buffer);
+}
+
+static void ConvertPixel64FloatRGBX16ToPixel32RGBX8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
+int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	pthread_once(&half_float_to_uint8_table_once, CalculateHalfFloatToUInt8Table);
+	uint16_t *source_pixel16_buffer = (uint16_t *)source_pixel_buffer;
+	uint32_t *target_pixel32_buffer = (uint32_t *)target_pixel_buffer;
+	for (int i = 0; i < nu_pixels; i++) {
+		*target_pixel32_buffer = detexPack32RGB8Alpha0xFF(
+			half_float_to_uint8_table[source_pixel16_buffer[0]],
+			half_float_to_uint8_table[source_pixel16_buffer[1]],
+			half_float_to_uint8_table[source_pixel16_buffer[2]]);
+		source_pixel16_buffer += 4;
+		target_pixel32_buffer++;
+	}
+}
+
+static void ConvertPixel64FloatRGBX16ToPixel32BGRX8(uint8_t * DETEX_RESTRICT source_pixel_buffer,
+int nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	pthread_once(&half_float_to_uint8_table_once, CalculateHalfFloatToUInt8Table);
+	uint16_t *source_pixel16_buffer = (uint16_t *)source_pixel_buffer;
+	uint32_t *target_pixel32_buffer = (uint32_t *)target_pixel_buffer;
+	for (int i = 0; i < nu_pixels; i++) {
+		*target_pixel32_buffer = detexPack32RGB8Alpha0xFF(
+			half_float_to_uint8_table[source_pixel16_buffer[2]],
+			half_float_to_uint8_table[source_pixel16_buffer[1]],
+			half_float_to_uint8_table[source_pixel16_buffer[0]]);
+		source_pixel16_buffer += 4;
+		target_pixel32_buffer++;
+	}
+}
+
+
 typedef void (*detexConversionFunc)(uint8_t *source_pixel_buffer, int nu_pixels,
 	uint8_t *target_pixel_buffer);
 
@@ -861,31 +1363,24 @@ detexConversionType detex_conversion_table[] = {
 	{ DETEX_PIXEL_FORMAT_FLOAT_RGBX32, DETEX_PIXEL_FORMAT_FLOAT_RGB32, ConvertPixel128RGBX32ToPixel96RGB32 },
 	{ DETEX_PIXEL_FORMAT_FLOAT_RGB32_HDR, DETEX_PIXEL_FORMAT_FLOAT_RGBX32_HDR, ConvertPixel96RGB32ToPixel128RGBX32 },
 	{ DETEX_PIXEL_FORMAT_FLOAT_RGBX32_HDR, DETEX_PIXEL_FORMAT_FLOAT_RGB32_HDR, ConvertPixel128RGBX32ToPixel96RGB32 },
+	// Fused conversions. These are not used by the search, but replace the steps of a
+	// conversion path that has the same source and target format afterwards. They must
+	// be the last entries of the table.
+	// 73
+	{ DETEX_PIXEL_FORMAT_FLOAT_RGBX16, DETEX_PIXEL_FORMAT_RGBX8, ConvertPixel64FloatRGBX16ToPixel32RGBX8 },
+	{ DETEX_PIXEL_FORMAT_FLOAT_RGBX16, DETEX_PIXEL_FORMAT_RGBA8, ConvertPixel64FloatRGBX16ToPixel32RGBX8 },
+	{ DETEX_PIXEL_FORMAT_FLOAT_RGBX16, DETEX_PIXEL_FORMAT_BGRX8, ConvertPixel64FloatRGBX16ToPixel32BGRX8 },
+	{ DETEX_PIXEL_FORMAT_FLOAT_RGBX16, DETEX_PIXEL_FORMAT_BGRA8, ConvertPixel64FloatRGBX16ToPixel32BGRX8 },
 };
 
 #define NU_CONVERSION_TYPES (sizeof(detex_conversion_table) / sizeof(detex_conversion_table[0]))
+#define NU_FUSED_CONVERSION_TYPES 4
+#define NU_SEARCHED_CONVERSION_TYPES (NU_CONVERSION_TYPES - NU_FUSED_CONVERSION_TYPES)
 
 // #define TRACE_MATCH_CONVERSION
 
-static __thread uint32_t cached_source_format = -1;
-static __thread uint32_t cached_target_format = -1;
-static __thread int cached_nu_conversions = - 1;
-static __thread uint32_t cached_conversion[4];
-
-static void CacheResult(uint32_t source_format, uint32_t target_format, int n, uint32_t *conversion) {
-	cached_source_format = source_format;
-	cached_target_format = target_format;
-	cached_nu_conversions = n;
-//	printf("Caching conversion ( ");
-	for (int i = 0; i < n; i++) {
-		cached_conversion[i] = conversion[i];
-//		printf("%d ", conversion[i]);
-	}
-//	printf(")\n");
-}
-
-// Match conversion. Returns number of conversion steps, -1 if not succesful.
-static int detexMatchConversion(uint32_t source_pixel_format, uint32_t target_pixel_format,
+// Search for a conversion path. Returns number of conversion steps, -1 if not succesful.
+static int SearchConversion(uint32_t source_pixel_format, uint32_t target_pixel_format,
 uint32_t *conversion) {
 	// Immediately return if the formats are identical.
 	if (source_pixel_format == target_pixel_format)
@@ -894,18 +1389,11 @@ uint32_t *conversion) {
 	printf("Matching conversion between %s and %s.\n", detexGetTextureFormatText(source_pixel_format),
 		detexGetTextureFormatText(target_pixel_format));
 #endif
-	// Check whether the conversion has been cached.
-	if (source_pixel_format == cached_source_format && target_pixel_format == cached_target_format) {
-		for (int i = 0; i < cached_nu_conversions; i++)
-			conversion[i] = cached_conversion[i];
-		return cached_nu_conversions;
-	}
 	// First check direct conversions.
-	for (int i = 0; i < NU_CONVERSION_TYPES; i++)
+	for (int i = 0; i < NU_SEARCHED_CONVERSION_TYPES; i++)
 		if (detex_conversion_table[i].target_format == target_pixel_format 
 		&& detex_conversion_table[i].source_format == source_pixel_format) {
 			conversion[0] = i;
-			CacheResult(source_pixel_format, target_pixel_format, 1, conversion);
 			return 1;
 		}
 	// Check two-step conversions.
@@ -917,7 +1405,7 @@ uint32_t *conversion) {
 	n = detexGetComponentPrecision(target_pixel_format);
 	if (n < min_precision)
 		min_precision = n;
-	for (int i = 0; i < NU_CONVERSION_TYPES; i++)
+	for (int i = 0; i < NU_SEARCHED_CONVERSION_TYPES; i++)
 		if (detex_conversion_table[i].target_format == target_pixel_format) {
 			// Avoid loss of components.
 			if (detexGetNumberOfComponents(detex_conversion_table[i].source_format) <
@@ -928,18 +1416,17 @@ uint32_t *conversion) {
 			min_precision)
 				continue;
 			conversion[1] = i;
-			for (int j = 0; j < NU_CONVERSION_TYPES; j++) {
+			for (int j = 0; j < NU_SEARCHED_CONVERSION_TYPES; j++) {
 				if (detex_conversion_table[j].target_format ==
 				detex_conversion_table[i].source_format &&
 				detex_conversion_table[j].source_format == source_pixel_format) {
 					conversion[0] = j;
-					CacheResult(source_pixel_format, target_pixel_format, 2, conversion);
 					return 2;
 				}
 			}
 		}
 	// Check three-step conversions.
-	for (int i = 0; i < NU_CONVERSION_TYPES; i++)
+	for (int i = 0; i < NU_SEARCHED_CONVERSION_TYPES; i++)
 		// Match the first conversion with the source format.
 		if (detex_conversion_table[i].source_format == source_pixel_format) {
 			// Avoid loss of components.
@@ -955,7 +1442,7 @@ uint32_t *conversion) {
 			printf("Trying conversion ( %d ? ? )\n", conversion[0]);
 #endif
 			// Match the third conversion with the target format.
-			for (int j = 0; j < NU_CONVERSION_TYPES; j++)
+			for (int j = 0; j < NU_SEARCHED_CONVERSION_TYPES; j++)
 				if (detex_conversion_table[j].target_format == target_pixel_format) {
 					// Avoid loss of components.
 					if (detexGetNumberOfComponents(detex_conversion_table[j].source_format) <
@@ -969,20 +1456,18 @@ uint32_t *conversion) {
 #ifdef TRACE_MATCH_CONVERSION
 					printf("Trying conversion ( %d ? %d )\n", conversion[0], conversion[2]);
 #endif
-					for (int k = 0; k < NU_CONVERSION_TYPES; k++)
+					for (int k = 0; k < NU_SEARCHED_CONVERSION_TYPES; k++)
 						if (detex_conversion_table[k].target_format ==
 						detex_conversion_table[j].source_format &&
 						detex_conversion_table[k].source_format ==
 						detex_conversion_table[i].target_format) {
 							conversion[1] = k;
-							CacheResult(source_pixel_format, target_pixel_format,
-								3, conversion);
 							return 3;
 						}
 				}
 		}
 	// Check four-step conversions.
-	for (int i = 0; i < NU_CONVERSION_TYPES; i++)
+	for (int i = 0; i < NU_SEARCHED_CONVERSION_TYPES; i++)
 		// Match the first conversion with the source format.
 		if (detex_conversion_table[i].source_format == source_pixel_format) {
 			// Avoid loss of components.
@@ -998,7 +1483,7 @@ uint32_t *conversion) {
 			printf("Trying conversion ( %d ? ? ? )\n", conversion[0]);
 #endif
 			// Match the fourth conversion with the target format.
-			for (int j = 0; j < NU_CONVERSION_TYPES; j++)
+			for (int j = 0; j < NU_SEARCHED_CONVERSION_TYPES; j++)
 				if (detex_conversion_table[j].target_format == target_pixel_format) {
 					// Avoid loss of components.
 					if (detexGetNumberOfComponents(detex_conversion_table[j].source_format) <
@@ -1013,7 +1498,7 @@ uint32_t *conversion) {
 					printf("Trying conversion ( %d ? ? %d )\n", conversion[0], conversion[3]);
 #endif
 					// Match the second conversion
-					for (int k = 0; k < NU_CONVERSION_TYPES; k++)
+					for (int k = 0; k < NU_SEARCHED_CONVERSION_TYPES; k++)
 						if (detex_conversion_table[k].source_format ==
 						detex_conversion_table[i].target_format) {
 							// Avoid loss of components.
@@ -1030,14 +1515,12 @@ uint32_t *conversion) {
 								conversion[0], conversion[1], conversion[3]);
 #endif
 							// Match the third conversion.
-							for (int l = 0; l < NU_CONVERSION_TYPES; l++) {
+							for (int l = 0; l < NU_SEARCHED_CONVERSION_TYPES; l++) {
 								if (detex_conversion_table[l].target_format ==
 								detex_conversion_table[j].source_format &&
 								detex_conversion_table[l].source_format ==
 								detex_conversion_table[k].target_format) {
 									conversion[2] = l;
-									CacheResult(source_pixel_format, target_pixel_format,
-										4, conversion);
 									return 4;
 								}
 							}
@@ -1047,32 +1530,346 @@ uint32_t *conversion) {
 	return - 1;
 }
 
-// Temporary pixel buffer management for conversion function.
+// Replace consecutive steps of a conversion path by a fused conversion with the same
+// source and target format. Returns the new number of steps.
+static int FuseConversionSteps(uint32_t *conversion, int nu_conversions) {
+	for (int i = 0; i < nu_conversions - 1; i++)
+		for (int j = nu_conversions - 1; j > i; j--)
+			for (int k = NU_SEARCHED_CONVERSION_TYPES; k < NU_CONVERSION_TYPES; k++)
+				if (detex_conversion_table[k].source_format ==
+				detex_conversion_table[conversion[i]].source_format &&
+				detex_conversion_table[k].target_format ==
+				detex_conversion_table[conversion[j]].target_format) {
+					conversion[i] = k;
+					for (int l = j + 1; l < nu_conversions; l++)
+						conversion[i + l - j] = conversion[l];
+					nu_conversions -= j - i;
+					j = i;
+					break;
+				}
+	return nu_conversions;
+}
+
+// Search for a conversion path and fuse its steps where possible.
+static int detexMatchConversion(uint32_t source_pixel_format, uint32_t target_pixel_format,
+uint32_t *conversion) {
+	int n = SearchConversion(source_pixel_format, target_pixel_format, conversion);
+	if (n < 2)
+		return n;
+	return FuseConversionSteps(conversion, n);
+}
+
+// Precomputed conversion matrix. The conversion paths between all pixel formats that
+// occur in the conversion table are searched once, before the first conversion, so that
+// finding a path only requires looking up the index of both formats.
+
+#define DETEX_MAX_CONVERSION_FORMATS 64
+
+typedef struct {
+	int8_t nu_conversions;
+	uint8_t conversion[4];
+} detexConversionMatrixEntry;
+
+// Sorted list of the pixel formats in the conversion table.
+static uint32_t detex_conversion_formats[DETEX_MAX_CONVERSION_FORMATS];
+static int detex_nu_conversion_formats = 0;
+static detexConversionMatrixEntry detex_conversion_matrix[DETEX_MAX_CONVERSION_FORMATS]
+	[DETEX_MAX_CONVERSION_FORMATS];
+static pthread_once_t detex_conversion_matrix_once = PTHREAD_ONCE_INIT;
+
+static bool AddConversionFormat(uint32_t format) {
+	int i = 0;
+	while (i < detex_nu_conversion_formats && detex_conversion_formats[i] < format)
+		i++;
+	if (i < detex_nu_conversion_formats && detex_conversion_formats[i] == format)
+		return true;
+	if (detex_nu_conversion_formats == DETEX_MAX_CONVERSION_FORMATS)
+		return false;
+	memmove(&detex_conversion_formats[i + 1], &detex_conversion_formats[i],
+		(detex_nu_conversion_formats - i) * sizeof(uint32_t));
+	detex_conversion_formats[i] = format;
+	detex_nu_conversion_formats++;
+	return true;
+}
+
+static void BuildConversionMatrix() {
+	// When the matrix cannot hold the table, it is left empty and conversion paths
+	// are searched for every conversion.
+	if (NU_CONVERSION_TYPES > 256)
+		return;
+	for (int i = 0; i < NU_CONVERSION_TYPES; i++)
+		if (!AddConversionFormat(detex_conversion_table[i].source_format) ||
+		!AddConversionFormat(detex_conversion_table[i].target_format)) {
+			detex_nu_conversion_formats = 0;
+			return;
+		}
+	for (int i = 0; i < detex_nu_conversion_formats; i++)
+		for (int j = 0; j < detex_nu_conversion_formats; j++) {
+			uint32_t conversion[4];
+			int n = detexMatchConversion(detex_conversion_formats[i], detex_conversion_formats[j],
+				conversion);
+			detex_conversion_matrix[i][j].nu_conversions = n;
+			for (int k = 0; k < n; k++)
+				detex_conversion_matrix[i][j].conversion[k] = conversion[k];
+		}
+}
+
+// Return the index of a pixel format in the conversion matrix, -1 if not present.
+static int GetConversionFormatIndex(uint32_t format) {
+	int low = 0;
+	int high = detex_nu_conversion_formats - 1;
+	while (low <= high) {
+		int mid = (low + high) / 2;
+		if (detex_conversion_formats[mid] == format)
+			return mid;
+		if (detex_conversion_formats[mid] < format)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+	return - 1;
+}
+
+// Look up a conversion path. Returns number of conversion steps, -1 if not succesful.
+static int LookupConversion(uint32_t source_pixel_format, uint32_t target_pixel_format,
+uint32_t *conversion) {
+	if (source_pixel_format == target_pixel_format)
+		return 0;
+	pthread_once(&detex_conversion_matrix_once, BuildConversionMatrix);
+	int i = GetConversionFormatIndex(source_pixel_format);
+	int j = GetConversionFormatIndex(target_pixel_format);
+	if (i < 0 || j < 0) {
+		// Formats that do not occur in the table have no conversion path, unless the
+		// matrix could not be built.
+		if (detex_nu_conversion_formats > 0)
+			return - 1;
+		return detexMatchConversion(source_pixel_format, target_pixel_format, conversion);
+	}
+	const detexConversionMatrixEntry *entry = &detex_conversion_matrix[i][j];
+	for (int k = 0; k < entry->nu_conversions; k++)
+		conversion[k] = entry->conversion[k];
+	return entry->nu_conversions;
+}
+
+// Conversion path with the layout of its temporary buffers. Intermediate results that
+// cannot be stored in the source or target buffer are stored in a scratch buffer. Each
+// intermediate result is only needed by the next non-in-place step, so they alternate
+// between two regions of the scratch buffer.
+//
+// The steps are performed in chunks of pixels, so that the intermediate results of a
+// chunk stay in the cache until the next step reads them and the scratch buffer only
+// needs to hold a chunk rather than the whole image.
 
-#define DETEX_MAX_TEMP_PIXEL_BUFFERS 3
+// Maximum size in bytes of the pixels of a chunk in any format used by a conversion path.
+#define DETEX_CONVERSION_CHUNK_SIZE 8192
 
 typedef struct {
-	uint8_t *pixel_buffer[DETEX_MAX_TEMP_PIXEL_BUFFERS];
-	uint32_t size[DETEX_MAX_TEMP_PIXEL_BUFFERS];
-	int nu_buffers;
-} TempPixelBufferInfo;
+	int nu_conversions;
+	uint32_t conversion[4];
+	int nu_non_in_place_conversions;
+	int first_non_in_place_conversion;
+	int last_non_in_place_conversion;
+	// Scratch region (0 or 1) used for the output of each step, -1 when the step is
+	// in-place or writes the target buffer.
+	int output_region[4];
+	// Size per pixel of each scratch region.
+	uint32_t region_pixel_size[2];
+	uint32_t source_pixel_size;
+	uint32_t target_pixel_size;
+	uint32_t chunk_nu_pixels;
+} ConversionPath;
+
+// Match a conversion path and lay out its temporary buffers. Returns false if there is
+// no conversion path.
+static bool MatchConversionPath(uint32_t source_pixel_format, uint32_t target_pixel_format,
+ConversionPath *path) {
+	path->nu_conversions = LookupConversion(source_pixel_format, target_pixel_format,
+		path->conversion);
+	if (path->nu_conversions < 0)
+		return false;
+	// Count in place/non-place steps.
+	path->nu_non_in_place_conversions = 0;
+	path->last_non_in_place_conversion = - 1;
+	path->first_non_in_place_conversion = - 1;
+	for (int i = 0; i < path->nu_conversions; i++)
+		if (detexGetPixelSize(detex_conversion_table[path->conversion[i]].source_format)
+		!= detexGetPixelSize(detex_conversion_table[path->conversion[i]].target_format)) {
+			path->nu_non_in_place_conversions++;
+			path->last_non_in_place_conversion = i;
+			if (path->first_non_in_place_conversion < 0)
+				path->first_non_in_place_conversion = i;
+		}
+	path->source_pixel_size = detexGetPixelSize(source_pixel_format);
+	path->target_pixel_size = detexGetPixelSize(target_pixel_format);
+	uint32_t max_pixel_size = path->source_pixel_size;
+	path->region_pixel_size[0] = 0;
+	path->region_pixel_size[1] = 0;
+	int current_region = - 1;
+	if (path->first_non_in_place_conversion > 0) {
+		// When doing a non-place conversion and the first conversion step is in-place,
+		// a copy of the source buffer is used to avoid corrupting it.
+		path->region_pixel_size[0] = path->source_pixel_size;
+		current_region = 0;
+	}
+	for (int i = 0; i < path->nu_conversions; i++) {
+		path->output_region[i] = - 1;
+		uint32_t pixel_size = detexGetPixelSize(
+			detex_conversion_table[path->conversion[i]].target_format);
+		if (pixel_size > max_pixel_size)
+			max_pixel_size = pixel_size;
+		if (pixel_size == detexGetPixelSize(detex_conversion_table[path->conversion[i]].source_format)
+		|| i == path->last_non_in_place_conversion)
+			continue;
+		int region = current_region == 0 ? 1 : 0;
+		if (pixel_size > path->region_pixel_size[region])
+			path->region_pixel_size[region] = pixel_size;
+		path->output_region[i] = region;
+		current_region = region;
+	}
+	path->chunk_nu_pixels = DETEX_CONVERSION_CHUNK_SIZE / max_pixel_size;
+	return true;
+}
 
-static void InitTemporaryPixelBuffers(TempPixelBufferInfo *info) {
-	info->nu_buffers = 0;
+// Offset of the second scratch region for chunks of nu_chunk_pixels pixels, aligned to
+// 16 bytes.
+static size_t GetScratchRegionOffset(const ConversionPath *path, uint32_t nu_chunk_pixels) {
+	return ((size_t)path->region_pixel_size[0] * nu_chunk_pixels + 15) & ~(size_t)15;
 }
 
-static uint8_t *AllocateTemporaryPixelBuffer(TempPixelBufferInfo *info, uint32_t size) {
-	if (info->nu_buffers == DETEX_MAX_TEMP_PIXEL_BUFFERS)
-		return NULL;
-	uint8_t *buffer = (uint8_t *)malloc(size);
-	info->pixel_buffer[info->nu_buffers] = buffer;
-	info->nu_buffers++;
-	return buffer;
+static uint32_t GetChunkNumberOfPixels(const ConversionPath *path, uint32_t nu_pixels) {
+	if (nu_pixels < path->chunk_nu_pixels)
+		return nu_pixels;
+	return path->chunk_nu_pixels;
 }
 
-static void FreeTemporaryPixelBuffers(TempPixelBufferInfo *info) {
-	for (int i = 0; i < info->nu_buffers; i++)
-		free(info->pixel_buffer[i]);
+static size_t GetScratchSize(const ConversionPath *path, uint32_t nu_pixels) {
+	uint32_t nu_chunk_pixels = GetChunkNumberOfPixels(path, nu_pixels);
+	if (path->region_pixel_size[1] == 0)
+		return (size_t)path->region_pixel_size[0] * nu_chunk_pixels;
+	return GetScratchRegionOffset(path, nu_chunk_pixels) +
+		(size_t)path->region_pixel_size[1] * nu_chunk_pixels;
+}
+
+// Perform the conversion steps of a path on a single chunk.
+static void ExecuteConversionSteps(const ConversionPath *path, uint8_t * DETEX_RESTRICT source_pixel_buffer,
+uint32_t nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer, uint8_t **region) {
+	if (path->first_non_in_place_conversion > 0) {
+		memcpy(region[0], source_pixel_buffer, path->source_pixel_size * nu_pixels);
+		source_pixel_buffer = region[0];
+	}
+	if (target_pixel_buffer != NULL && path->nu_non_in_place_conversions == 0) {
+		// When doing a non-in-place conversion with only in-place conversion steps,
+		// start by copying the source buffer to the target buffer.
+		memcpy(target_pixel_buffer, source_pixel_buffer, path->source_pixel_size * nu_pixels);
+		source_pixel_buffer = target_pixel_buffer;
+	}
+	for (int i = 0; i < path->nu_conversions; i++) {
+		const detexConversionType *type = &detex_conversion_table[path->conversion[i]];
+		if (detexGetPixelSize(type->source_format) == detexGetPixelSize(type->target_format)) {
+			// In-place conversion step.
+			type->conversion_func(source_pixel_buffer, nu_pixels, NULL);
+		}
+		else if (i == path->last_non_in_place_conversion) {
+			type->conversion_func(source_pixel_buffer, nu_pixels, target_pixel_buffer);
+			source_pixel_buffer = target_pixel_buffer;
+		}
+		else {
+			uint8_t *temp_pixel_buffer = region[path->output_region[i]];
+			type->conversion_func(source_pixel_buffer, nu_pixels, temp_pixel_buffer);
+			source_pixel_buffer = temp_pixel_buffer;
+		}
+	}
+}
+
+// Perform the conversion steps of a path chunk by chunk. The scratch buffer must be at
+// least GetScratchSize() bytes.
+static void ExecuteConversionPath(const ConversionPath *path, uint8_t * DETEX_RESTRICT source_pixel_buffer,
+uint32_t nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer, uint8_t *scratch_buffer) {
+	uint32_t nu_chunk_pixels = GetChunkNumberOfPixels(path, nu_pixels);
+	uint8_t *region[2];
+	region[0] = scratch_buffer;
+	region[1] = scratch_buffer + GetScratchRegionOffset(path, nu_chunk_pixels);
+	for (uint32_t i = 0; i < nu_pixels; i += nu_chunk_pixels) {
+		uint32_t n = nu_chunk_pixels;
+		if (n > nu_pixels - i)
+			n = nu_pixels - i;
+		ExecuteConversionSteps(path, source_pixel_buffer + (size_t)i * path->source_pixel_size, n,
+			target_pixel_buffer == NULL ? NULL : target_pixel_buffer +
+			(size_t)i * path->target_pixel_size, region);
+	}
+}
+
+static bool CheckConversionPath(const ConversionPath *path, uint8_t *target_pixel_buffer,
+const char *func_name) {
+	if (target_pixel_buffer == NULL && path->nu_non_in_place_conversions > 0) {
+		detexSetErrorMessage("%s: Unable to find in-place conversion path", func_name);
+		return false;
+	}
+	return true;
+}
+
+// Perform a conversion using a caller-provided scratch buffer.
+static bool ConvertWithScratch(const ConversionPath *path, uint8_t * DETEX_RESTRICT source_pixel_buffer,
+uint32_t nu_pixels, uint8_t * DETEX_RESTRICT target_pixel_buffer, uint8_t *scratch_buffer,
+size_t scratch_size, const char *func_name) {
+	if (!CheckConversionPath(path, target_pixel_buffer, func_name))
+		return false;
+	if (scratch_size < GetScratchSize(path, nu_pixels)) {
+		detexSetErrorMessage("%s: Scratch buffer is too small", func_name);
+		return false;
+	}
+	ExecuteConversionPath(path, source_pixel_buffer, nu_pixels, target_pixel_buffer,
+		scratch_buffer);
+	return true;
+}
+
+// Size of a scratch buffer that holds both regions for any conversion path, including
+// the alignment of the second region.
+#define DETEX_MAX_SCRATCH_SIZE (DETEX_CONVERSION_CHUNK_SIZE * 2 + 16)
+
+// Perform a conversion using a scratch buffer on the stack. Since the intermediate
+// results are limited to a chunk, this never needs to allocate memory.
+static bool ConvertWithStackScratch(const ConversionPath *path,
+uint8_t * DETEX_RESTRICT source_pixel_buffer, uint32_t nu_pixels,
+uint8_t * DETEX_RESTRICT target_pixel_buffer, const char *func_name) {
+	if (!CheckConversionPath(path, target_pixel_buffer, func_name))
+		return false;
+	uint64_t scratch_buffer[DETEX_MAX_SCRATCH_SIZE / 8];
+	ExecuteConversionPath(path, source_pixel_buffer, nu_pixels, target_pixel_buffer,
+		(uint8_t *)scratch_buffer);
+	return true;
+}
+
+// Return the size of the scratch buffer required by detexConvertPixelsWithScratch.
+bool detexGetConvertPixelsScratchSize(uint32_t nu_pixels, uint32_t source_pixel_format,
+uint32_t target_pixel_format, size_t *size_out) {
+	ConversionPath path;
+	if (!MatchConversionPath(source_pixel_format, target_pixel_format, &path)) {
+		detexSetErrorMessage("detexGetConvertPixelsScratchSize: Unable to find conversion path");
+		return false;
+	}
+	*size_out = GetScratchSize(&path, nu_pixels);
+	return true;
+}
+
+// Convert pixels between different formats using a caller-provided scratch buffer for
+// intermediate results. No memory is allocated. Return true if successful.
+bool detexConvertPixelsWithScratch(uint8_t * DETEX_RESTRICT source_pixel_buffer, uint32_t nu_pixels,
+uint32_t source_pixel_format, uint8_t * DETEX_RESTRICT target_pixel_buffer,
+uint32_t target_pixel_format, uint8_t *scratch_buffer, size_t scratch_size) {
+	if (source_pixel_format == target_pixel_format) {
+		if (target_pixel_buffer != NULL)
+			memcpy(target_pixel_buffer, source_pixel_buffer, nu_pixels *
+				detexGetPixelSize(source_pixel_format));
+		return true;
+	}
+	ConversionPath path;
+	if (!MatchConversionPath(source_pixel_format, target_pixel_format, &path)) {
+		detexSetErrorMessage("detexConvertPixelsWithScratch: Unable to find conversion path");
+		return false;
+	}
+	return ConvertWithScratch(&path, source_pixel_buffer, nu_pixels, target_pixel_buffer,
+		scratch_buffer, scratch_size, "detexConvertPixelsWithScratch");
 }
 
 // Convert pixels between different formats. Return true if successful.
@@ -1090,81 +1887,66 @@ uint32_t target_pixel_format) {
 				detexGetPixelSize(source_pixel_format));
 		return true;
 	}
-	uint32_t conversion[4];
-	int nu_conversions = detexMatchConversion(source_pixel_format, target_pixel_format, conversion);
-	if (nu_conversions < 0) {
+	ConversionPath path;
+	if (!MatchConversionPath(source_pixel_format, target_pixel_format, &path)) {
 		detexSetErrorMessage("detexConvertPixels: Unable to find conversion path");
 		return false;
 	}
-	// Count in place/non-place steps.
-	int nu_non_in_place_conversions = 0;
-	int last_non_in_place_conversion = - 1;
-	int first_non_in_place_conversion = - 1;
-	for (int i = 0; i < nu_conversions; i++)
-		if (detexGetPixelSize(detex_conversion_table[conversion[i]].source_format)
-		!= detexGetPixelSize(detex_conversion_table[conversion[i]].target_format)) {
-			nu_non_in_place_conversions++;
-			last_non_in_place_conversion = i;
-			if (first_non_in_place_conversion < 0)
-				first_non_in_place_conversion = i;
-		}
-	if (target_pixel_buffer == NULL && nu_non_in_place_conversions > 0) {
-		detexSetErrorMessage("Unable to find in-place conversion path");
+	return ConvertWithStackScratch(&path, source_pixel_buffer, nu_pixels, target_pixel_buffer,
+		"detexConvertPixels");
+}
+
+// Conversion plans.
+
+struct detexConversionPlan {
+	ConversionPath path;
+};
+
+// Create a conversion plan. Returns true if successful.
+bool detexCreateConversionPlan(uint32_t source_pixel_format, uint32_t target_pixel_format,
+detexConversionPlan **plan_out) {
+	ConversionPath path;
+	if (!MatchConversionPath(source_pixel_format, target_pixel_format, &path)) {
+		detexSetErrorMessage("detexCreateConversionPlan: Unable to find conversion path");
 		return false;
 	}
-	// Perform conversions.
-	TempPixelBufferInfo temp_pixel_buffer_info;
-	InitTemporaryPixelBuffers(&temp_pixel_buffer_info);
-	if (first_non_in_place_conversion > 0) {
-		// When doing a non-place conversion and the first conversion step is in-place,
-		// allocate a temporary buffer to avoid corrupting the source buffer.
-		uint8_t *temp_pixel_buffer = AllocateTemporaryPixelBuffer(&temp_pixel_buffer_info,
-			detexGetPixelSize(source_pixel_format) * nu_pixels);
-		memcpy(temp_pixel_buffer, source_pixel_buffer,
-			detexGetPixelSize(source_pixel_format) * nu_pixels);
-		source_pixel_buffer = temp_pixel_buffer;
-	}
-	if (target_pixel_buffer != NULL && nu_non_in_place_conversions == 0) {
-		// When doing a non-in-place conversion with only in-place conversion steps,
-		// start by copying the source buffer to the target buffer.
-		memcpy(target_pixel_buffer, source_pixel_buffer,
-			detexGetPixelSize(source_pixel_format) * nu_pixels);
-		source_pixel_buffer = target_pixel_buffer;
-	}
-	for (int i = 0; i < nu_conversions; i++) {
-		if (detexGetPixelSize(detex_conversion_table[conversion[i]].source_format)
-		== detexGetPixelSize(detex_conversion_table[conversion[i]].target_format)) {
-			// In-place conversion step.
-			detex_conversion_table[conversion[i]].conversion_func(
-				source_pixel_buffer, nu_pixels, NULL);
-		}
-		else {
-			if (i == last_non_in_place_conversion) {
-				detex_conversion_table[conversion[i]].conversion_func(
-					source_pixel_buffer, nu_pixels, target_pixel_buffer);
-				source_pixel_buffer = target_pixel_buffer;
-			}
-			else {
-				uint8_t *temp_pixel_buffer = AllocateTemporaryPixelBuffer(&temp_pixel_buffer_info,
-					nu_pixels * detexGetPixelSize(
-						detex_conversion_table[conversion[i]].target_format));
-				if (temp_pixel_buffer == NULL) {
-					// Error: Too many temporary buffers needed.
-					detexSetErrorMessage("detexConvertPixels: Too many temporary buffers needed");
-					FreeTemporaryPixelBuffers(&temp_pixel_buffer_info);
-					return false;
-				}
-				detex_conversion_table[conversion[i]].conversion_func(
-					source_pixel_buffer, nu_pixels, temp_pixel_buffer);
-				source_pixel_buffer = temp_pixel_buffer;
-			}
-		}
-	
+	detexConversionPlan *plan = (detexConversionPlan *)detexAllocate(sizeof(detexConversionPlan));
+	if (plan == NULL) {
+		detexSetErrorMessage("detexCreateConversionPlan: Could not allocate memory");
+		return false;
 	}
-	FreeTemporaryPixelBuffers(&temp_pixel_buffer_info);
+	plan->path = path;
+	*plan_out = plan;
 	return true;
 }
 
+size_t detexGetConversionPlanScratchSize(const detexConversionPlan *plan, uint32_t nu_pixels) {
+	return GetScratchSize(&plan->path, nu_pixels);
+}
+
+int detexGetConversionPlanNumberOfSteps(const detexConversionPlan *plan) {
+	return plan->path.nu_conversions;
+}
+
+bool detexConversionPlanIsInPlace(const detexConversionPlan *plan) {
+	return plan->path.nu_non_in_place_conversions == 0;
+}
+
+// Convert pixels using a conversion plan. Return true if successful.
+bool detexExecuteConversionPlan(const detexConversionPlan *plan,
+uint8_t * DETEX_RESTRICT source_pixel_buffer, uint32_t nu_pixels,
+uint8_t * DETEX_RESTRICT target_pixel_buffer, uint8_t *scratch_buffer, size_t scratch_size) {
+	if (scratch_buffer == NULL)
+		return ConvertWithStackScratch(&plan->path, source_pixel_buffer, nu_pixels,
+			target_pixel_buffer, "detexExecuteConversionPlan");
+	return ConvertWithScratch(&plan->path, source_pixel_buffer, nu_pixels, target_pixel_buffer,
+		scratch_buffer, scratch_size, "detexExecuteConversionPlan");
+}
+
+void detexFreeConversionPlan(detexConversionPlan *plan) {
+	detexFree(plan);
+}
+
 bool detexConvertPixelsInPlace(uint8_t * DETEX_RESTRICT source_pixel_buffer, uint32_t nu_pixels,
 uint32_t source_pixel_format, uint32_t target_pixel_format) {
 	return detexConvertPixels(source_pixel_buffer, nu_pixels, source_pixel_format, NULL, target_pixel_format);
@@ -22,38 +22,41 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "detex.h"
 #include "file-info.h"
+#include "mapped-file.h"
 #include "misc.h"
 
-// Load texture from DDS file with mip-maps. Returns true if successful.
-// nu_levels is a return parameter that returns the number of mipmap levels found.
-// textures_out is a return parameter for an array of detexTexture pointers that is allocated,
-// free with free(). textures_out[i] are allocated textures corresponding to each level, free
-// with free();
-bool detexLoadDDSFileWithMipmaps(const char *filename, int max_mipmaps, detexTexture ***textures_out,
-int *nu_levels_out) {
-	FILE *f = fopen(filename, "rb");
-	if (f == NULL) {
-		detexSetErrorMessage("detexLoadDDSFileWithMipmaps: Could not open file %s", filename);
-		return false;
-	}
+// Return whether a DX10 header resource dimension is supported (1D or 2D texture).
+static bool DDSResourceDimensionIsSupported(uint32_t resource_dimension) {
+	return resource_dimension == 2 || resource_dimension == 3;
+}
+
+// Load texture from DDS file data provided by read callbacks, with mip-maps. filename is
+// only used for error messages and may be NULL.
+static bool LoadDDSWithMipmaps(const detexReadCallbacks *callbacks, const char *func_name,
+const char *filename, int max_mipmaps, detexTexture ***textures_out, int *nu_levels_out) {
 	// Read signature.
 	char id[4];
-	size_t s = fread(id, 1, 4, f);
+	size_t s = callbacks->read(callbacks->user_data, id, 4);
 	if (s != 4) {
-		detexSetErrorMessage("detexLoadDDSFileWithMipmaps: Error reading file %s", filename);
+		detexSetReadErrorMessage(func_name, filename);
 		return false;
 	}
 	if (id[0] != 'D' || id[1] != 'D' || id[2] != 'S' || id[3] != ' ') {
-		detexSetErrorMessage("detexLoadDDSFileWithMipmaps: Couldn't find DDS signature");
+		detexSetErrorMessage("%s: Couldn't find DDS signature", func_name);
 		return false;
 	}
 	uint8_t header[124];
-	s = fread(header, 1, 124, f);
+	s = callbacks->read(callbacks->user_data, header, 124);
 	if (s != 124) {
-		detexSetErrorMessage("detexLoadDDSFileWithMipmaps: Error reading file %s", filename);
+		detexSetReadErrorMessage(func_name, filename);
 		return false;
 	}
 	uint8_t *headerp = &header[0];
+	if (!detexTextureDimensionsAreValid(*(uint32_t *)(headerp + 12), *(uint32_t *)(headerp + 8))) {
+		detexSetErrorMessage("%s: Invalid texture dimensions (%u x %u)", func_name,
+			*(uint32_t *)(headerp + 12), *(uint32_t *)(headerp + 8));
+		return false;
+	}
 	int width = *(uint32_t *)(headerp + 12);
 	int height = *(uint32_t *)(headerp + 8);
 //	int pitch = *(uint32_t *)(headerp + 16);
@@ -71,23 +74,23 @@ int *nu_levels_out) {
 	uint32_t dx10_format = 0;
 	if (strncmp(four_cc, "DX10", 4) == 0) {
 		uint32_t dx10_header[5];
-		s = fread(dx10_header, 1, 20, f);
+		s = callbacks->read(callbacks->user_data, dx10_header, 20);
 		if (s != 20) {
-			detexSetErrorMessage("detexLoadDDSFileWithMipmaps: Error reading file %s", filename);
+			detexSetReadErrorMessage(func_name, filename);
 			return false;
 		}
 		dx10_format = dx10_header[0];
 		uint32_t resource_dimension = dx10_header[1];
-		if (resource_dimension != 3) {
-			detexSetErrorMessage("detexLoadDDSFileWithMipmaps: Only 2D textures supported for .dds files");
+		if (!DDSResourceDimensionIsSupported(resource_dimension)) {
+			detexSetErrorMessage("%s: Only 1D and 2D textures supported for .dds files", func_name);
 			return false;
 		}
 	}
 	const detexTextureFileInfo *info = detexLookupDDSFileInfo(four_cc, dx10_format, pixel_format_flags, bitcount,
 		red_mask, green_mask, blue_mask, alpha_mask);
 	if (info == NULL) {
-		detexSetErrorMessage("detexLoadDDSFileWithMipmaps: Unsupported format in .dds file (fourCC = %s, "
-			"DX10 format = %d).", four_cc, dx10_format);
+		detexSetErrorMessage("%s: Unsupported format in .dds file (fourCC = %s, "
+			"DX10 format = %d).", func_name, four_cc, dx10_format);
 		return false;
 	}
 	// Maybe implement option to treat BC1 as BC1A?
@@ -101,32 +104,54 @@ int *nu_levels_out) {
 	int extended_width = ((width + block_width - 1) / block_width) * block_width;
 	int extended_height = ((height + block_height - 1) / block_height) * block_height;
 	uint32_t flags = *(uint32_t *)(headerp + 4);
-	int nu_file_mipmaps = 1;
-	if (flags & 0x20000) {
+	// A mip-map count of zero indicates a single level.
+	uint32_t nu_file_mipmaps = 1;
+	if ((flags & 0x20000) && *(uint32_t *)(headerp + 24) > 0) {
 		nu_file_mipmaps = *(uint32_t *)(headerp + 24);
 //		if (nu_file_mipmaps > 1 && max_mipmaps == 1) {
 //			detexSetErrorMessage("Disregarding mipmaps beyond the first level.\n");
 //		}
 	}
+	if (nu_file_mipmaps > 32) {
+		detexSetErrorMessage("%s: Invalid number of mip-map levels (%u)", func_name,
+			nu_file_mipmaps);
+		return false;
+	}
 	int nu_mipmaps;
-	if (nu_file_mipmaps > max_mipmaps)
+	if ((int)nu_file_mipmaps > max_mipmaps)
 		nu_mipmaps = max_mipmaps;
 	else
 		nu_mipmaps = nu_file_mipmaps;
-	detexTexture **textures = (detexTexture **)malloc(sizeof(detexTexture *) * nu_mipmaps);
+	detexTexture **textures = (detexTexture **)detexAllocate(sizeof(detexTexture *) * nu_mipmaps);
+	if (textures == NULL && nu_mipmaps > 0) {
+		detexSetErrorMessage("%s: Out of memory", func_name);
+		return false;
+	}
 	for (int i = 0; i < nu_mipmaps; i++) {
-		int n = (extended_height / block_width) * (extended_width / block_height);
+		size_t size = (size_t)(extended_height / block_height) * (extended_width / block_width) *
+			bytes_per_block;
 		// Allocate texture.
-		textures[i] = (detexTexture *)malloc(sizeof(detexTexture));
+		textures[i] = (detexTexture *)detexAllocate(sizeof(detexTexture));
+		if (textures[i] == NULL) {
+			detexFreeTextures(textures, i);
+			detexSetErrorMessage("%s: Out of memory", func_name);
+			return false;
+		}
 		textures[i]->format = info->texture_format;
-		textures[i]->data = (uint8_t *)malloc(n * bytes_per_block);
+		textures[i]->data = (uint8_t *)detexAllocate(size);
 		textures[i]->width = width;
 		textures[i]->height = height;
 		textures[i]->width_in_blocks = extended_width / block_width;
 		textures[i]->height_in_blocks = extended_height / block_height;
-		size_t r = fread(textures[i]->data, 1, n * bytes_per_block, f);
-		if (r < n * bytes_per_block) {
-			detexSetErrorMessage("detexLoadDDSFileWithMipmaps: Error reading file %s", filename);
+		if (textures[i]->data == NULL && size > 0) {
+			detexFreeTextures(textures, i + 1);
+			detexSetErrorMessage("%s: Out of memory", func_name);
+			return false;
+		}
+		size_t r = callbacks->read(callbacks->user_data, textures[i]->data, size);
+		if (r < size) {
+			detexFreeTextures(textures, i + 1);
+			detexSetReadErrorMessage(func_name, filename);
 			return false;
 		}
 		// Divide by two for the next mipmap level, rounding down.
@@ -135,15 +160,44 @@ int *nu_levels_out) {
 		extended_width = ((width + block_width - 1) / block_width) * block_width;
 		extended_height = ((height + block_height - 1) / block_height) * block_height;
 	}
-	fclose(f);
 	*nu_levels_out = nu_mipmaps;
 	*textures_out = textures;
 	return true;
 }
 
+// Load texture from DDS file with mip-maps. Returns true if successful.
+// nu_levels is a return parameter that returns the number of mipmap levels found.
+// textures_out is a return parameter for an array of detexTexture pointers that is allocated,
+// free with detexFree(). textures_out[i] are allocated textures corresponding to each level,
+// free with detexFree() after freeing textures_out[i]->data with detexFree().
+bool detexLoadDDSFileWithMipmaps(const char *filename, int max_mipmaps, detexTexture ***textures_out,
+int *nu_levels_out) {
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL) {
+		detexSetErrorMessage("detexLoadDDSFileWithMipmaps: Could not open file %s", filename);
+		return false;
+	}
+	detexReadCallbacks callbacks;
+	callbacks.read = detexReadFromFile;
+	callbacks.skip = detexSkipInFile;
+	callbacks.user_data = f;
+	bool r = LoadDDSWithMipmaps(&callbacks, "detexLoadDDSFileWithMipmaps", filename, max_mipmaps,
+		textures_out, nu_levels_out);
+	fclose(f);
+	return r;
+}
+
+// Load texture from DDS file data provided by read callbacks, with mip-maps. Returns true
+// if successful. The textures are allocated as with detexLoadDDSFileWithMipmaps.
+bool detexLoadDDSCallbacksWithMipmaps(const detexReadCallbacks *callbacks, int max_mipmaps,
+detexTexture ***textures_out, int *nu_levels_out) {
+	return LoadDDSWithMipmaps(callbacks, "detexLoadDDSCallbacksWithMipmaps", NULL, max_mipmaps,
+		textures_out, nu_levels_out);
+}
+
 
 // Load texture from DDS file (first mip-map only). Returns true if successful.
-// The texture is allocated, free with free().
+// The texture and its data are allocated, free with detexFree().
 bool detexLoadDDSFile(const char *filename, detexTexture **texture_out) {
 	int nu_mipmaps;
 	detexTexture **textures;
@@ -151,7 +205,212 @@ bool detexLoadDDSFile(const char *filename, detexTexture **texture_out) {
 	if (!r)
 		return false;
 	*texture_out = textures[0];
-	free(textures);
+	detexFree(textures);
+	return true;
+}
+
+// Build an index of at most max_levels mip-map levels of every array element and cube map
+// face of a DDS file without reading the pixel data. index->levels is allocated with
+// malloc(), free with free().
+static bool IndexDDS(const detexRandomAccessReader *reader, int max_levels, const char *func_name,
+detexTextureFileIndex *index) {
+	uint8_t id[4];
+	uint32_t header[31];
+	if (!detexReadAt(reader, 0, id, 4) || !detexReadAt(reader, 4, header, 124)) {
+		detexSetErrorMessage("%s: File too small for DDS header", func_name);
+		return false;
+	}
+	if (id[0] != 'D' || id[1] != 'D' || id[2] != 'S' || id[3] != ' ') {
+		detexSetErrorMessage("%s: Couldn't find DDS signature", func_name);
+		return false;
+	}
+	if (!detexTextureDimensionsAreValid(header[3], header[2])) {
+		detexSetErrorMessage("%s: Invalid texture dimensions (%u x %u)", func_name, header[3],
+			header[2]);
+		return false;
+	}
+	int width = header[3];
+	int height = header[2];
+	uint32_t pixel_format_flags = header[19];
+	int bitcount = header[21];
+	uint32_t red_mask = header[22];
+	uint32_t green_mask = header[23];
+	uint32_t blue_mask = header[24];
+	uint32_t alpha_mask = header[25];
+	char four_cc[5];
+	memcpy(four_cc, &header[20], 4);
+	four_cc[4] = '\0';
+	uint64_t offset = 128;
+	int nu_layers = 1;
+	int nu_faces = 1;
+	uint32_t caps2 = header[27];
+	if (caps2 & 0x200) {
+		// Cube map. Faces that are not present are not stored.
+		nu_faces = __builtin_popcount(caps2 & 0xFC00);
+	}
+	uint32_t dx10_format = 0;
+	if (strncmp(four_cc, "DX10", 4) == 0) {
+		uint32_t dx10_header[5];
+		if (!detexReadAt(reader, offset, dx10_header, 20)) {
+			detexSetErrorMessage("%s: Unexpected end of file", func_name);
+			return false;
+		}
+		offset += 20;
+		dx10_format = dx10_header[0];
+		uint32_t resource_dimension = dx10_header[1];
+		if (!DDSResourceDimensionIsSupported(resource_dimension)) {
+			detexSetErrorMessage("%s: Only 1D and 2D textures supported for .dds files", func_name);
+			return false;
+		}
+		// The misc flag indicates a cube map, in which case the array size is the number
+		// of cubes.
+		nu_faces = (dx10_header[2] & 0x4) ? 6 : 1;
+		if (dx10_header[3] > 1)
+			nu_layers = dx10_header[3];
+	}
+	if (nu_faces == 0 || (uint64_t)nu_layers * nu_faces > reader->size) {
+		detexSetErrorMessage("%s: Invalid number of array elements or faces", func_name);
+		return false;
+	}
+	const detexTextureFileInfo *info = detexLookupDDSFileInfo(four_cc, dx10_format, pixel_format_flags,
+		bitcount, red_mask, green_mask, blue_mask, alpha_mask);
+	if (info == NULL) {
+		detexSetErrorMessage("%s: Unsupported format in .dds file (fourCC = %s, DX10 format = %d).",
+			func_name, four_cc, dx10_format);
+		return false;
+	}
+	int bytes_per_block;
+	if (detexFormatIsCompressed(info->texture_format))
+		bytes_per_block = detexGetCompressedBlockSize(info->texture_format);
+	else
+		bytes_per_block = detexGetPixelSize(info->texture_format);
+	int block_width = info->block_width;
+	int block_height = info->block_height;
+	uint32_t flags = header[1];
+	uint32_t nu_file_levels = 1;
+	if ((flags & 0x20000) && header[6] > 0)
+		nu_file_levels = header[6];
+	if (nu_file_levels > 32) {
+		detexSetErrorMessage("%s: Invalid number of mip-map levels (%u)", func_name,
+			nu_file_levels);
+		return false;
+	}
+	int nu_levels = nu_file_levels;
+	if (nu_levels > max_levels)
+		nu_levels = max_levels;
+	// The mip-map levels of each face are stored together, one face after the other.
+	detexTextureLevelInfo *levels = (detexTextureLevelInfo *)malloc(sizeof(detexTextureLevelInfo) *
+		nu_layers * nu_faces * nu_levels);
+	if (levels == NULL && nu_levels > 0) {
+		detexSetErrorMessage("%s: Out of memory", func_name);
+		return false;
+	}
+	for (int slice = 0; slice < nu_layers * nu_faces; slice++) {
+		int level_width = width;
+		int level_height = height;
+		for (int i = 0; i < (int)nu_file_levels; i++) {
+			int extended_width = ((level_width + block_width - 1) / block_width) * block_width;
+			int extended_height = ((level_height + block_height - 1) / block_height) * block_height;
+			size_t size = (size_t)(extended_height / block_height) * (extended_width / block_width) *
+				bytes_per_block;
+			if (i < nu_levels) {
+				if (offset + size > reader->size) {
+					free(levels);
+					detexSetErrorMessage("%s: Unexpected end of file", func_name);
+					return false;
+				}
+				detexTextureLevelInfo *level = &levels[slice * nu_levels + i];
+				level->format = info->texture_format;
+				level->width = level_width;
+				level->height = level_height;
+				level->width_in_blocks = extended_width / block_width;
+				level->height_in_blocks = extended_height / block_height;
+				level->offset = offset;
+				level->size = size;
+			}
+			offset += size;
+			// Divide by two for the next mipmap level, rounding down.
+			level_width >>= 1;
+			level_height >>= 1;
+		}
+	}
+	index->nu_levels = nu_levels;
+	index->nu_layers = nu_layers;
+	index->nu_faces = nu_faces;
+	index->levels = levels;
+	return true;
+}
+
+// Load texture from DDS file data in memory with mip-maps. Returns true if successful.
+// The textures are allocated as with detexLoadDDSFileWithMipmaps and do not refer to data.
+// The data is parsed through an index, which checks every level against the size of the
+// data before anything is allocated.
+bool detexLoadDDSMemoryWithMipmaps(const uint8_t *data, size_t size, int max_mipmaps,
+detexTexture ***textures_out, int *nu_levels_out) {
+	detexRandomAccessReader reader;
+	reader.read_at = detexReadAtMemory;
+	reader.user_data = (void *)data;
+	reader.size = size;
+	detexTextureFileIndex index;
+	if (!IndexDDS(&reader, max_mipmaps, "detexLoadDDSMemoryWithMipmaps", &index))
+		return false;
+	// Return the levels of the first array element and face.
+	bool r = detexLoadLevelsFromReader(&reader, index.levels, index.nu_levels,
+		"detexLoadDDSMemoryWithMipmaps", textures_out);
+	free(index.levels);
+	if (!r)
+		return false;
+	*nu_levels_out = index.nu_levels;
+	return true;
+}
+
+// Map a DDS file into memory and return its mip-map levels. The data pointers of the
+// textures point directly into the mapping, which must be treated as read-only.
+// textures_out is owned by the mapped file; release everything with detexUnmapFile().
+bool detexMapDDSFileWithMipmaps(const char *filename, int max_mipmaps, detexMappedFile **file_out,
+detexTexture ***textures_out, int *nu_levels_out) {
+	detexMappedFile *file;
+	if (!detexMapFile(filename, "detexMapDDSFileWithMipmaps", &file))
+		return false;
+	detexRandomAccessReader reader;
+	reader.read_at = detexReadAtMemory;
+	reader.user_data = file->data;
+	reader.size = file->size;
+	detexTextureFileIndex index;
+	if (!IndexDDS(&reader, max_mipmaps, "detexMapDDSFileWithMipmaps", &index)) {
+		detexUnmapFile(file);
+		return false;
+	}
+	// Return the levels of the first array element and face.
+	bool r = detexSetMappedFileLevels(file, index.levels, index.nu_levels,
+		"detexMapDDSFileWithMipmaps");
+	free(index.levels);
+	if (!r) {
+		detexUnmapFile(file);
+		return false;
+	}
+	*file_out = file;
+	*textures_out = file->textures;
+	*nu_levels_out = file->nu_levels;
+	return true;
+}
+
+// Build an index of the mip-map levels of a DDS file. Only the header is read; the pixel
+// data of any level can be loaded later with detexLoadTextureFileLevels(). Free the index
+// with detexFreeTextureFileIndex().
+bool detexIndexDDSFile(const char *filename, detexTextureFileIndex **index_out) {
+	detexTextureFileIndex *index;
+	if (!detexOpenTextureFileIndex(filename, "detexIndexDDSFile", &index))
+		return false;
+	detexRandomAccessReader reader;
+	reader.read_at = detexReadAtFileDescriptor;
+	reader.user_data = &index->fd;
+	reader.size = index->file_size;
+	if (!IndexDDS(&reader, 32, "detexIndexDDSFile", index)) {
+		detexFreeTextureFileIndex(index);
+		return false;
+	}
+	*index_out = index;
 	return true;
 }
 
@@ -17,11 +17,272 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
 #include "detex.h"
+#include "simd.h"
+
+#ifdef DETEX_SIMD_X86
+
+// SIMD versions of the BC1, BC1A, BC2 and BC3 decoders. The output is identical to
+// the scalar code. Integer division by 3, 5 and 7 (exact for the value ranges
+// involved) is replaced by a multiplication with a 16-bit reciprocal.
+
+// Calculate the four-color palette of a 5-6-5 color block as RGBA8 pixels in the
+// 32-bit lanes 0 to 3. alpha is used for the alpha component of the first three
+// colors and of the fourth color in four-color mode; in three-color mode the
+// fourth color is zero.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 __m128i ColorPaletteSSE2(uint32_t colors,
+bool four_color_mode, int alpha) {
+	__m128i c = _mm_setr_epi16(colors, colors, colors, 0, colors >> 16, colors >> 16,
+		colors >> 16, 0);
+	c = _mm_and_si128(c, _mm_setr_epi16(0xF800, 0x07E0, 0x001F, 0, 0xF800, 0x07E0, 0x001F, 0));
+	// Red is shifted right by 8, green right by 3 and blue left by 3.
+	__m128i endpoints = _mm_or_si128(
+		_mm_mulhi_epu16(c, _mm_setr_epi16(1 << 8, 1 << 13, 0, 0, 1 << 8, 1 << 13, 0, 0)),
+		_mm_mullo_epi16(c, _mm_setr_epi16(0, 0, 8, 0, 0, 0, 8, 0)));
+	endpoints = _mm_or_si128(endpoints, _mm_setr_epi16(0, 0, 0, alpha, 0, 0, 0, alpha));
+	// Swap the two endpoints.
+	__m128i swapped = _mm_shuffle_epi32(endpoints, _MM_SHUFFLE(1, 0, 3, 2));
+	__m128i interpolated;
+	if (four_color_mode) {
+		// (2 * color0 + color1) / 3 and (color0 + 2 * color1) / 3.
+		__m128i sum = _mm_add_epi16(_mm_add_epi16(endpoints, endpoints), swapped);
+		interpolated = _mm_srli_epi16(_mm_mulhi_epu16(sum, _mm_set1_epi16(0xAAAB)), 1);
+	}
+	else {
+		// (color0 + color1) / 2 and zero.
+		interpolated = _mm_srli_epi16(_mm_add_epi16(endpoints, swapped), 1);
+		interpolated = _mm_move_epi64(interpolated);
+	}
+	return _mm_packus_epi16(endpoints, interpolated);
+}
+
+// Calculate the eight-value alpha palette of a BC3 alpha block as 16-bit values.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 __m128i AlphaPaletteSSE2(int alpha0, int alpha1) {
+	__m128i a0 = _mm_set1_epi16(alpha0);
+	__m128i a1 = _mm_set1_epi16(alpha1);
+	if (alpha0 > alpha1) {
+		__m128i sum = _mm_add_epi16(
+			_mm_mullo_epi16(a0, _mm_setr_epi16(7, 0, 6, 5, 4, 3, 2, 1)),
+			_mm_mullo_epi16(a1, _mm_setr_epi16(0, 7, 1, 2, 3, 4, 5, 6)));
+		// Divide by 7.
+		return _mm_mulhi_epu16(sum, _mm_set1_epi16(9363));
+	}
+	__m128i sum = _mm_add_epi16(
+		_mm_mullo_epi16(a0, _mm_setr_epi16(5, 0, 4, 3, 2, 1, 0, 0)),
+		_mm_mullo_epi16(a1, _mm_setr_epi16(0, 5, 1, 2, 3, 4, 0, 0)));
+	// Divide by 5, the last two values are 0 and 0xFF.
+	return _mm_or_si128(_mm_mulhi_epu16(sum, _mm_set1_epi16(13108)),
+		_mm_setr_epi16(0, 0, 0, 0, 0, 0, 0, 0xFF));
+}
+
+// Look up the 2-bit color indices of 16 pixels in the palette and store the pixels.
+// alpha contains the alpha value of each pixel in the 8-bit lanes 0 to 15; its
+// bits are ORed into the alpha component of each pixel.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 void StorePixelsSSE2(__m128i palette,
+uint32_t pixels, __m128i alpha, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i p0 = _mm_shuffle_epi32(palette, _MM_SHUFFLE(0, 0, 0, 0));
+	__m128i p1 = _mm_shuffle_epi32(palette, _MM_SHUFFLE(1, 1, 1, 1));
+	__m128i p2 = _mm_shuffle_epi32(palette, _MM_SHUFFLE(2, 2, 2, 2));
+	__m128i p3 = _mm_shuffle_epi32(palette, _MM_SHUFFLE(3, 3, 3, 3));
+	__m128i p0_xor_p1 = _mm_xor_si128(p0, p1);
+	__m128i p2_xor_p3 = _mm_xor_si128(p2, p3);
+	__m128i mask0 = _mm_setr_epi32(1, 4, 16, 64);
+	__m128i mask1 = _mm_setr_epi32(2, 8, 32, 128);
+	__m128i indices = _mm_set1_epi32(pixels);
+	__m128i zero = _mm_setzero_si128();
+	__m128i alpha16[2];
+	alpha16[0] = _mm_unpacklo_epi8(zero, alpha);
+	alpha16[1] = _mm_unpackhi_epi8(zero, alpha);
+	for (int i = 0; i < 4; i++) {
+		// Select one of the four colors for each of four pixels based on the two index bits.
+		__m128i bit0 = _mm_cmpeq_epi32(_mm_and_si128(indices, mask0), mask0);
+		__m128i bit1 = _mm_cmpeq_epi32(_mm_and_si128(indices, mask1), mask1);
+		__m128i low = _mm_xor_si128(p0, _mm_and_si128(bit0, p0_xor_p1));
+		__m128i high = _mm_xor_si128(p2, _mm_and_si128(bit0, p2_xor_p3));
+		__m128i result = _mm_xor_si128(low, _mm_and_si128(bit1, _mm_xor_si128(low, high)));
+		if (i & 1)
+			result = _mm_or_si128(result, _mm_unpackhi_epi16(zero, alpha16[i >> 1]));
+		else
+			result = _mm_or_si128(result, _mm_unpacklo_epi16(zero, alpha16[i >> 1]));
+		_mm_storeu_si128((__m128i *)(pixel_buffer + i * 16), result);
+		indices = _mm_srli_epi32(indices, 8);
+	}
+}
+
+// AVX2 version of StorePixelsSSE2, using a variable shift and a lane permutation
+// instead of masks.
+static DETEX_INLINE_ONLY DETEX_TARGET_AVX2 void StorePixelsAVX2(__m128i palette,
+uint32_t pixels, __m128i alpha, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m256i palette256 = _mm256_broadcastsi128_si256(palette);
+	__m256i pixels256 = _mm256_set1_epi32(pixels);
+	__m256i three = _mm256_set1_epi32(3);
+	__m256i indices0 = _mm256_and_si256(_mm256_srlv_epi32(pixels256,
+		_mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14)), three);
+	__m256i indices1 = _mm256_and_si256(_mm256_srlv_epi32(pixels256,
+		_mm256_setr_epi32(16, 18, 20, 22, 24, 26, 28, 30)), three);
+	__m256i result0 = _mm256_permutevar8x32_epi32(palette256, indices0);
+	__m256i result1 = _mm256_permutevar8x32_epi32(palette256, indices1);
+	result0 = _mm256_or_si256(result0, _mm256_slli_epi32(_mm256_cvtepu8_epi32(alpha), 24));
+	result1 = _mm256_or_si256(result1, _mm256_slli_epi32(_mm256_cvtepu8_epi32(
+		_mm_srli_si128(alpha, 8)), 24));
+	_mm256_storeu_si256((__m256i *)pixel_buffer, result0);
+	_mm256_storeu_si256((__m256i *)(pixel_buffer + 32), result1);
+}
+
+// Return the alpha values of a BC2 block in the 8-bit lanes 0 to 15.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 __m128i AlphaBC2SSE2(const uint8_t * DETEX_RESTRICT bitstring) {
+	__m128i alpha_bits = _mm_loadl_epi64((const __m128i *)bitstring);
+	__m128i mask = _mm_set1_epi8(0x0F);
+	__m128i alpha = _mm_unpacklo_epi8(_mm_and_si128(alpha_bits, mask),
+		_mm_and_si128(_mm_srli_epi16(alpha_bits, 4), mask));
+	// Multiply the 4-bit values by 17 (equal to value * 255 / 15).
+	return _mm_or_si128(alpha, _mm_slli_epi16(alpha, 4));
+}
+
+// Return the alpha values of a BC3 block in the 8-bit lanes 0 to 15.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 __m128i AlphaBC3SSE2(const uint8_t * DETEX_RESTRICT bitstring) {
+	uint8_t alpha_palette[16];
+	_mm_storeu_si128((__m128i *)alpha_palette, _mm_packus_epi16(
+		AlphaPaletteSSE2(bitstring[0], bitstring[1]), _mm_setzero_si128()));
+	uint64_t alpha_bits = (uint32_t)bitstring[2] |
+		((uint32_t)bitstring[3] << 8) |
+		((uint64_t)*(uint32_t *)&bitstring[4] << 16);
+	uint8_t alpha[16];
+	for (int i = 0; i < 16; i++)
+		alpha[i] = alpha_palette[(alpha_bits >> (i * 3)) & 0x7];
+	return _mm_loadu_si128((const __m128i *)alpha);
+}
+
+// Return the alpha values of a BC3 block as 32-bit values in two 256-bit registers.
+static DETEX_INLINE_ONLY DETEX_TARGET_AVX2 void AlphaBC3AVX2(const uint8_t * DETEX_RESTRICT bitstring,
+__m256i *alpha0, __m256i *alpha1) {
+	__m256i alpha_palette = _mm256_cvtepu16_epi32(AlphaPaletteSSE2(bitstring[0], bitstring[1]));
+	uint32_t alpha_bits0 = (uint32_t)bitstring[2] | ((uint32_t)bitstring[3] << 8) |
+		((uint32_t)bitstring[4] << 16);
+	uint32_t alpha_bits1 = (uint32_t)bitstring[5] | ((uint32_t)bitstring[6] << 8) |
+		((uint32_t)bitstring[7] << 16);
+	__m256i shifts = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+	__m256i seven = _mm256_set1_epi32(7);
+	*alpha0 = _mm256_permutevar8x32_epi32(alpha_palette,
+		_mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(alpha_bits0), shifts), seven));
+	*alpha1 = _mm256_permutevar8x32_epi32(alpha_palette,
+		_mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(alpha_bits1), shifts), seven));
+}
+
+#define DEFINE_DECODE_BLOCK_BC1(suffix, target) \
+	static DETEX_INLINE_ONLY target void DecodeBlockBC1##suffix( \
+	const uint8_t * DETEX_RESTRICT bitstring, uint8_t * DETEX_RESTRICT pixel_buffer) { \
+		uint32_t colors = *(uint32_t *)&bitstring[0]; \
+		bool four_color_mode = (colors & 0xFFFF) > ((colors & 0xFFFF0000) >> 16); \
+		__m128i palette = ColorPaletteSSE2(colors, four_color_mode, 0xFF); \
+		StorePixels##suffix(palette, *(uint32_t *)&bitstring[4], \
+			_mm_set1_epi8((char)0xFF), pixel_buffer); \
+	}
+
+#define DEFINE_DECODE_BLOCK_BC1A(suffix, target) \
+	static DETEX_INLINE_ONLY target void DecodeBlockBC1A##suffix( \
+	const uint8_t * DETEX_RESTRICT bitstring, uint8_t * DETEX_RESTRICT pixel_buffer) { \
+		uint32_t colors = *(uint32_t *)&bitstring[0]; \
+		bool four_color_mode = (colors & 0xFFFF) > ((colors & 0xFFFF0000) >> 16); \
+		__m128i palette = ColorPaletteSSE2(colors, four_color_mode, 0xFF); \
+		StorePixels##suffix(palette, *(uint32_t *)&bitstring[4], \
+			_mm_setzero_si128(), pixel_buffer); \
+	}
+
+#define DEFINE_DECODE_BLOCK_BC2(suffix, target) \
+	static DETEX_INLINE_ONLY target void DecodeBlockBC2##suffix( \
+	const uint8_t * DETEX_RESTRICT bitstring, uint8_t * DETEX_RESTRICT pixel_buffer) { \
+		__m128i palette = ColorPaletteSSE2(*(uint32_t *)&bitstring[8], true, 0); \
+		StorePixels##suffix(palette, *(uint32_t *)&bitstring[12], \
+			AlphaBC2SSE2(bitstring), pixel_buffer); \
+	}
+
+DEFINE_DECODE_BLOCK_BC1(SSE2, DETEX_TARGET_SSE2)
+DEFINE_DECODE_BLOCK_BC1(AVX2, DETEX_TARGET_AVX2)
+DEFINE_DECODE_BLOCK_BC1A(SSE2, DETEX_TARGET_SSE2)
+DEFINE_DECODE_BLOCK_BC1A(AVX2, DETEX_TARGET_AVX2)
+DEFINE_DECODE_BLOCK_BC2(SSE2, DETEX_TARGET_SSE2)
+DEFINE_DECODE_BLOCK_BC2(AVX2, DETEX_TARGET_AVX2)
+
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 void DecodeBlockBC3SSE2(
+const uint8_t * DETEX_RESTRICT bitstring, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i palette = ColorPaletteSSE2(*(uint32_t *)&bitstring[8], true, 0);
+	StorePixelsSSE2(palette, *(uint32_t *)&bitstring[12], AlphaBC3SSE2(bitstring),
+		pixel_buffer);
+}
+
+static DETEX_INLINE_ONLY DETEX_TARGET_AVX2 void DecodeBlockBC3AVX2(
+const uint8_t * DETEX_RESTRICT bitstring, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i palette = ColorPaletteSSE2(*(uint32_t *)&bitstring[8], true, 0);
+	// The alpha values are ORed in after the color lookup.
+	StorePixelsAVX2(palette, *(uint32_t *)&bitstring[12], _mm_setzero_si128(), pixel_buffer);
+	__m256i alpha0, alpha1;
+	AlphaBC3AVX2(bitstring, &alpha0, &alpha1);
+	__m256i *pixel256_buffer = (__m256i *)pixel_buffer;
+	_mm256_storeu_si256(pixel256_buffer, _mm256_or_si256(_mm256_loadu_si256(pixel256_buffer),
+		_mm256_slli_epi32(alpha0, 24)));
+	_mm256_storeu_si256(pixel256_buffer + 1, _mm256_or_si256(_mm256_loadu_si256(pixel256_buffer + 1),
+		_mm256_slli_epi32(alpha1, 24)));
+}
+
+// Multi-block functions for each instruction set.
+#define DEFINE_DECOMPRESS_BLOCKS(format, suffix, target, block_size) \
+	static target void DecompressBlocks##format##suffix(const uint8_t * DETEX_RESTRICT bitstring, \
+	int nu_blocks, uint8_t * DETEX_RESTRICT pixel_buffer) { \
+		for (int i = 0; i < nu_blocks; i++) { \
+			DecodeBlock##format##suffix(bitstring, pixel_buffer); \
+			bitstring += block_size; \
+			pixel_buffer += 64; \
+		} \
+	}
+
+DEFINE_DECOMPRESS_BLOCKS(BC1, SSE2, DETEX_TARGET_SSE2, 8)
+DEFINE_DECOMPRESS_BLOCKS(BC1, AVX2, DETEX_TARGET_AVX2, 8)
+DEFINE_DECOMPRESS_BLOCKS(BC1A, SSE2, DETEX_TARGET_SSE2, 8)
+DEFINE_DECOMPRESS_BLOCKS(BC1A, AVX2, DETEX_TARGET_AVX2, 8)
+DEFINE_DECOMPRESS_BLOCKS(BC2, SSE2, DETEX_TARGET_SSE2, 16)
+DEFINE_DECOMPRESS_BLOCKS(BC2, AVX2, DETEX_TARGET_AVX2, 16)
+DEFINE_DECOMPRESS_BLOCKS(BC3, SSE2, DETEX_TARGET_SSE2, 16)
+DEFINE_DECOMPRESS_BLOCKS(BC3, AVX2, DETEX_TARGET_AVX2, 16)
+
+// Decompress blocks using the best available instruction set. Returns false when
+// no SIMD implementation is available.
+#define DEFINE_DECOMPRESS_BLOCKS_SIMD(format) \
+	static DETEX_INLINE_ONLY bool DecompressBlocks##format##SIMD( \
+	const uint8_t * DETEX_RESTRICT bitstring, int nu_blocks, \
+	uint8_t * DETEX_RESTRICT pixel_buffer) { \
+		if (detexCPUSupportsAVX2()) { \
+			DecompressBlocks##format##AVX2(bitstring, nu_blocks, pixel_buffer); \
+			return true; \
+		} \
+		if (detexCPUSupportsSSE2()) { \
+			DecompressBlocks##format##SSE2(bitstring, nu_blocks, pixel_buffer); \
+			return true; \
+		} \
+		return false; \
+	}
+
+#else
+
+#define DEFINE_DECOMPRESS_BLOCKS_SIMD(format) \
+	static DETEX_INLINE_ONLY bool DecompressBlocks##format##SIMD( \
+	const uint8_t * DETEX_RESTRICT bitstring, int nu_blocks, \
+	uint8_t * DETEX_RESTRICT pixel_buffer) { \
+		return false; \
+	}
+
+#endif
+
+DEFINE_DECOMPRESS_BLOCKS_SIMD(BC1)
+DEFINE_DECOMPRESS_BLOCKS_SIMD(BC1A)
+DEFINE_DECOMPRESS_BLOCKS_SIMD(BC2)
+DEFINE_DECOMPRESS_BLOCKS_SIMD(BC3)
 
 /* Decompress a 64-bit 4x4 pixel texture block compressed using the BC1 */
 /* format. */
 bool detexDecompressBlockBC1(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
 uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	if (DecompressBlocksBC1SIMD(bitstring, 1, pixel_buffer))
+		return true;
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || !defined(__BYTE_ORDER__)
 	uint32_t colors = *(uint32_t *)&bitstring[0];
 #else
@@ -98,6 +359,8 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 		return false;
 	if (!opaque && (flags & DETEX_DECOMPRESS_FLAG_OPAQUE_ONLY))
 		return false;
+	if (DecompressBlocksBC1ASIMD(bitstring, 1, pixel_buffer))
+		return true;
 	// Decode the two 5-6-5 RGB colors.
 	int color_r[4], color_g[4], color_b[4], color_a[4];
 	color_b[0] = (colors & 0x0000001F) << 3;
@@ -146,6 +409,8 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 	(flags & DETEX_DECOMPRESS_FLAG_ENCODE))
 		// GeForce 6 and 7 series produce wrong result in this case.
 		return false;
+	if (DecompressBlocksBC2SIMD(bitstring, 1, pixel_buffer))
+		return true;
 	int color_r[4], color_g[4], color_b[4];
 	color_b[0] = (colors & 0x0000001F) << 3;
 	color_g[0] = (colors & 0x000007E0) >> (5 - 2);
@@ -189,6 +454,8 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 	(flags & DETEX_DECOMPRESS_FLAG_ENCODE))
 		// GeForce 6 and 7 series produce wrong result in this case.
 		return false;
+	if (DecompressBlocksBC3SIMD(bitstring, 1, pixel_buffer))
+		return true;
 	int color_r[4], color_g[4], color_b[4];
 	// color_x[] has a value between 0 and 248 with the lower three bits zero.
 	color_b[0] = (colors & 0x0000001F) << 3;
@@ -239,3 +506,54 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 	return true;
 }
 
+/* Decompress nu_blocks consecutive 64-bit blocks compressed using the BC1 */
+/* format, storing 16 pixels per block consecutively in pixel_buffer. */
+void detexDecompressBlocksBC1(const uint8_t * DETEX_RESTRICT bitstring, int nu_blocks,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	if (DecompressBlocksBC1SIMD(bitstring, nu_blocks, pixel_buffer))
+		return;
+	for (int i = 0; i < nu_blocks; i++) {
+		detexDecompressBlockBC1(bitstring, DETEX_MODE_MASK_ALL, 0, pixel_buffer);
+		bitstring += 8;
+		pixel_buffer += 64;
+	}
+}
+
+/* Decompress nu_blocks consecutive 64-bit blocks compressed using the BC1A */
+/* format, storing 16 pixels per block consecutively in pixel_buffer. */
+void detexDecompressBlocksBC1A(const uint8_t * DETEX_RESTRICT bitstring, int nu_blocks,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	if (DecompressBlocksBC1ASIMD(bitstring, nu_blocks, pixel_buffer))
+		return;
+	for (int i = 0; i < nu_blocks; i++) {
+		detexDecompressBlockBC1A(bitstring, DETEX_MODE_MASK_ALL, 0, pixel_buffer);
+		bitstring += 8;
+		pixel_buffer += 64;
+	}
+}
+
+/* Decompress nu_blocks consecutive 128-bit blocks compressed using the BC2 */
+/* format, storing 16 pixels per block consecutively in pixel_buffer. */
+void detexDecompressBlocksBC2(const uint8_t * DETEX_RESTRICT bitstring, int nu_blocks,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	if (DecompressBlocksBC2SIMD(bitstring, nu_blocks, pixel_buffer))
+		return;
+	for (int i = 0; i < nu_blocks; i++) {
+		detexDecompressBlockBC2(bitstring, DETEX_MODE_MASK_ALL, 0, pixel_buffer);
+		bitstring += 16;
+		pixel_buffer += 64;
+	}
+}
+
+/* Decompress nu_blocks consecutive 128-bit blocks compressed using the BC3 */
+/* format, storing 16 pixels per block consecutively in pixel_buffer. */
+void detexDecompressBlocksBC3(const uint8_t * DETEX_RESTRICT bitstring, int nu_blocks,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	if (DecompressBlocksBC3SIMD(bitstring, nu_blocks, pixel_buffer))
+		return;
+	for (int i = 0; i < nu_blocks; i++) {
+		detexDecompressBlockBC3(bitstring, DETEX_MODE_MASK_ALL, 0, pixel_buffer);
+		bitstring += 16;
+		pixel_buffer += 64;
+	}
+}
@@ -19,6 +19,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "detex.h"
 #include "bits.h"
 #include "bptc-tables.h"
+#include "simd.h"
 
 static const int8_t map_mode_table[32] = {
 	0, 1, 2, 10, -1, -1, 3, 11, -1, -1, 4, 12, -1, -1, 5, 13,
@@ -26,10 +27,10 @@ static const int8_t map_mode_table[32] = {
 };
 
 static int ExtractMode(detexBlock128 *block) {
-	uint32_t mode = detexBlock128ExtractBits(block, 2);
+	uint32_t mode = detexBlock128ExtractBitsInline(block, 2);
 	if (mode < 2)
 		return mode;
-	return map_mode_table[mode | (detexBlock128ExtractBits(block, 3) << 2)];
+	return map_mode_table[mode | (detexBlock128ExtractBitsInline(block, 3) << 2)];
 }
 
 static int GetPartitionIndex(int nu_subsets, int partition_set_id, int i) {
@@ -107,9 +108,199 @@ static int32_t InterpolateFloat(int32_t e0, int32_t e1, int16_t index, uint8_t i
 			+ detex_bptc_table_aWeight4[index] * e1 + 32) >> 6);
 }
 
+// Unquantize the endpoints and interpolate the pixels, storing the finished half-float values.
+static void UnquantizeAndInterpolate(int32_t * DETEX_RESTRICT r, int32_t * DETEX_RESTRICT g,
+int32_t * DETEX_RESTRICT b, int mode, bool signed_flag, const uint8_t * DETEX_RESTRICT subset_index,
+const uint8_t * DETEX_RESTRICT color_index, int color_index_bit_count, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	int nu_subsets;
+	if (mode >= 10)
+		nu_subsets = 1;
+	else
+		nu_subsets = 2;
+	// Unquantize endpoints.
+	if (signed_flag)
+		for (int i = 0; i < 2 * nu_subsets; i++) {
+			r[i] = UnquantizeSigned(r[i], mode);
+			g[i] = UnquantizeSigned(g[i], mode);
+			b[i] = UnquantizeSigned(b[i], mode);
+		}
+	else
+		for (int i = 0; i < 2 * nu_subsets; i++) {
+			r[i] = Unquantize(r[i], mode);
+			g[i] = Unquantize(g[i], mode);
+			b[i] = Unquantize(b[i], mode);
+		}
+
+	for (int i = 0; i < 16; i++) {
+		int32_t endpoint_start_r, endpoint_start_g, endpoint_start_b;
+		int32_t endpoint_end_r, endpoint_end_g, endpoint_end_b;
+		endpoint_start_r = r[2 * subset_index[i]];
+		endpoint_end_r = r[2 * subset_index[i] + 1];
+		endpoint_start_g = g[2 * subset_index[i]];
+		endpoint_end_g = g[2 * subset_index[i] + 1];
+		endpoint_start_b = b[2 * subset_index[i]];
+		endpoint_end_b = b[2 * subset_index[i] + 1];
+		uint64_t output;
+		if (signed_flag) {
+			int32_t r16 = InterpolateFloat(endpoint_start_r, endpoint_end_r, color_index[i],
+				color_index_bit_count);
+			if (r16 < 0)
+				r16 = - (((- r16) * 31) >> 5);
+			else
+				r16 = (r16 * 31) >> 5;
+			int s = 0;
+			if (r16 < 0) {
+				s = 0x8000;
+				r16 = - r16;
+			}
+			r16 |= s;
+			int32_t g16 = InterpolateFloat(endpoint_start_g, endpoint_end_g, color_index[i],
+				color_index_bit_count);
+			if (g16 < 0)
+				g16 = - (((- g16) * 31) >> 5);
+			else
+				g16 = (g16 * 31) >> 5;
+			s = 0;
+			if (g16 < 0) {
+				s = 0x8000;
+				g16 = - g16;
+			}
+			g16 |= s;
+			int32_t b16 = InterpolateFloat(endpoint_start_b, endpoint_end_b, color_index[i],
+				color_index_bit_count);
+			if (b16 < 0)
+				b16 = - (((- b16) * 31) >> 5);
+			else
+				b16 = (b16 * 31) >> 5;
+			s = 0;
+			if (b16 < 0) {
+				s = 0x8000;
+				b16 = - b16;
+			}
+			b16 |= s;
+			output = detexPack64RGB16(r16, g16, b16);
+		}
+		else {
+			output = detexPack64R16(InterpolateFloat(endpoint_start_r, endpoint_end_r, color_index[i],
+				color_index_bit_count) * 31 / 64);
+			output |= detexPack64G16(InterpolateFloat(endpoint_start_g, endpoint_end_g, color_index[i],
+				color_index_bit_count) * 31 / 64);
+			output |= detexPack64B16(InterpolateFloat(endpoint_start_b, endpoint_end_b, color_index[i],
+				color_index_bit_count) * 31 / 64);
+		}
+		*(uint64_t *)&pixel_buffer[i * 8] = output;
+	}
+}
+
+#ifdef DETEX_SIMD_X86
+
+// Select b where mask is set, otherwise a.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 __m128i SelectSSE2(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_andnot_si128(mask, a), _mm_and_si128(mask, b));
+}
+
+// Unquantize four endpoint components at once. Equivalent to Unquantize() and
+// UnquantizeSigned().
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 __m128i UnquantizeSSE2(__m128i x, int mode, bool signed_flag) {
+	int epb = bptc_float_EPB[mode];
+	if (epb >= 16)
+		return x;
+	__m128i sign = _mm_setzero_si128();
+	__m128i max;
+	if (signed_flag) {
+		sign = _mm_srai_epi32(x, 31);
+		x = _mm_sub_epi32(_mm_xor_si128(x, sign), sign);
+		max = _mm_cmpgt_epi32(x, _mm_set1_epi32(((int32_t)1 << (epb - 1)) - 2));
+	}
+	else
+		max = _mm_cmpeq_epi32(x, _mm_set1_epi32(((int32_t)1 << epb) - 1));
+	__m128i unq = _mm_srl_epi32(_mm_add_epi32(_mm_slli_epi32(x, 15), _mm_set1_epi32(0x4000)),
+		_mm_cvtsi32_si128(epb - 1));
+	unq = SelectSSE2(max, unq, _mm_set1_epi32(signed_flag ? 0x7FFF : 0xFFFF));
+	unq = _mm_andnot_si128(_mm_cmpeq_epi32(x, _mm_setzero_si128()), unq);
+	if (signed_flag)
+		unq = _mm_sub_epi32(_mm_xor_si128(unq, sign), sign);
+	return unq;
+}
+
+// Interpolate the components of one pixel. The endpoints are interleaved 16-bit values, so
+// that a single multiply-add computes (64 - w) * e0 + w * e1 for each component. For the
+// unsigned format the endpoints are biased by -32768 to fit the signed multiply-add.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 __m128i InterpolateSSE2(__m128i endpoints, int weight,
+bool signed_flag) {
+	__m128i w = _mm_set1_epi32((weight << 16) | (64 - weight));
+	__m128i bias = _mm_set1_epi32(signed_flag ? 32 : 64 * 32768 + 32);
+	return _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(endpoints, w), bias), 6);
+}
+
+// Unquantize the endpoints and interpolate the pixels, two pixels at a time. Produces output
+// identical to UnquantizeAndInterpolate().
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 void UnquantizeAndInterpolateSharedSSE2(const int32_t * DETEX_RESTRICT r,
+const int32_t * DETEX_RESTRICT g, const int32_t * DETEX_RESTRICT b, int mode, bool signed_flag,
+const uint8_t * DETEX_RESTRICT subset_index, const uint8_t * DETEX_RESTRICT color_index,
+int color_index_bit_count, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i bias = _mm_set1_epi32(signed_flag ? 0 : 32768);
+	__m128i r4 = _mm_sub_epi32(UnquantizeSSE2(_mm_loadu_si128((const __m128i *)r), mode, signed_flag), bias);
+	__m128i g4 = _mm_sub_epi32(UnquantizeSSE2(_mm_loadu_si128((const __m128i *)g), mode, signed_flag), bias);
+	__m128i b4 = _mm_sub_epi32(UnquantizeSSE2(_mm_loadu_si128((const __m128i *)b), mode, signed_flag), bias);
+	// The unused fourth component is given endpoint values that interpolate to zero.
+	__m128i rg = _mm_packs_epi32(r4, g4);
+	__m128i bx = _mm_packs_epi32(b4, _mm_sub_epi32(_mm_setzero_si128(), bias));
+	// Interleaved endpoints { e0.r, e1.r, e0.g, e1.g, e0.b, e1.b, e0.x, e1.x } of each subset.
+	__m128i rbgx_lo = _mm_unpacklo_epi32(rg, bx);
+	__m128i rbgx_hi = _mm_unpackhi_epi32(rg, bx);
+	__m128i endpoints[2];
+	endpoints[0] = _mm_unpacklo_epi32(rbgx_lo, rbgx_hi);
+	endpoints[1] = _mm_unpackhi_epi32(rbgx_lo, rbgx_hi);
+	const uint16_t *weight_table = color_index_bit_count == 3 ? detex_bptc_table_aWeight3 :
+		detex_bptc_table_aWeight4;
+	for (int i = 0; i < 16; i += 2) {
+		__m128i v0 = InterpolateSSE2(endpoints[subset_index[i]], weight_table[color_index[i]],
+			signed_flag);
+		__m128i v1 = InterpolateSSE2(endpoints[subset_index[i + 1]], weight_table[color_index[i + 1]],
+			signed_flag);
+		__m128i output;
+		if (signed_flag) {
+			// Scale the magnitude by 31 / 32 and convert to sign-magnitude. A negative value
+			// that scales to zero becomes positive zero.
+			__m128i sign0 = _mm_srai_epi32(v0, 31);
+			__m128i sign1 = _mm_srai_epi32(v1, 31);
+			v0 = _mm_sub_epi32(_mm_xor_si128(v0, sign0), sign0);
+			v1 = _mm_sub_epi32(_mm_xor_si128(v1, sign1), sign1);
+			v0 = _mm_srli_epi32(_mm_sub_epi32(_mm_slli_epi32(v0, 5), v0), 5);
+			v1 = _mm_srli_epi32(_mm_sub_epi32(_mm_slli_epi32(v1, 5), v1), 5);
+			sign0 = _mm_andnot_si128(_mm_cmpeq_epi32(v0, _mm_setzero_si128()), sign0);
+			sign1 = _mm_andnot_si128(_mm_cmpeq_epi32(v1, _mm_setzero_si128()), sign1);
+			output = _mm_or_si128(_mm_packs_epi32(v0, v1), _mm_and_si128(
+				_mm_packs_epi32(sign0, sign1), _mm_set1_epi16(0x8000)));
+		}
+		else {
+			// Scale by 31 / 64.
+			v0 = _mm_srli_epi32(_mm_sub_epi32(_mm_slli_epi32(v0, 5), v0), 6);
+			v1 = _mm_srli_epi32(_mm_sub_epi32(_mm_slli_epi32(v1, 5), v1), 6);
+			output = _mm_packs_epi32(v0, v1);
+		}
+		_mm_storeu_si128((__m128i *)&pixel_buffer[i * 8], output);
+	}
+}
+
+static DETEX_TARGET_SSE2 void UnquantizeAndInterpolateSSE2(const int32_t * DETEX_RESTRICT r,
+const int32_t * DETEX_RESTRICT g, const int32_t * DETEX_RESTRICT b, int mode, bool signed_flag,
+const uint8_t * DETEX_RESTRICT subset_index, const uint8_t * DETEX_RESTRICT color_index,
+int color_index_bit_count, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	if (signed_flag)
+		UnquantizeAndInterpolateSharedSSE2(r, g, b, mode, true, subset_index, color_index,
+			color_index_bit_count, pixel_buffer);
+	else
+		UnquantizeAndInterpolateSharedSSE2(r, g, b, mode, false, subset_index, color_index,
+			color_index_bit_count, pixel_buffer);
+}
+
+#endif
+
 static bool DecompressBlockBPTCFloatShared(const uint8_t * DETEX_RESTRICT bitstring,
 uint32_t mode_mask, uint32_t flags, bool signed_flag,
-const uint8_t * DETEX_RESTRICT pixel_buffer) {
+uint8_t * DETEX_RESTRICT pixel_buffer) {
 	detexBlock128 block;
 	block.data0 = *(uint64_t *)&bitstring[0];
 	block.data1 = *(uint64_t *)&bitstring[8];
@@ -517,20 +708,6 @@ const uint8_t * DETEX_RESTRICT pixel_buffer) {
 			b[i] = SignExtend(b[i], bptc_float_EPB[mode], 32);
 		}
 
-	// Unquantize endpoints.
-	if (signed_flag)
-		for (int i = 0; i < 2 * nu_subsets; i++) {
-			r[i] = UnquantizeSigned(r[i], mode);
-			g[i] = UnquantizeSigned(g[i], mode);
-			b[i] = UnquantizeSigned(b[i], mode);
-		}
-	else
-		for (int i = 0; i < 2 * nu_subsets; i++) {
-			r[i] = Unquantize(r[i], mode);
-			g[i] = Unquantize(g[i], mode);
-			b[i] = Unquantize(b[i], mode);
-		}
-
 	uint8_t subset_index[16];
 	for (int i = 0; i < 16; i++) {
 		// subset_index[i] is a number from 0 to 1, depending on the number of subsets.
@@ -563,65 +740,14 @@ const uint8_t * DETEX_RESTRICT pixel_buffer) {
 		}
 	}
 
-	for (int i = 0; i < 16; i++) {
-		int32_t endpoint_start_r, endpoint_start_g, endpoint_start_b;
-		int32_t endpoint_end_r, endpoint_end_g, endpoint_end_b;
-		endpoint_start_r = r[2 * subset_index[i]];
-		endpoint_end_r = r[2 * subset_index[i] + 1];
-		endpoint_start_g = g[2 * subset_index[i]];
-		endpoint_end_g = g[2 * subset_index[i] + 1];
-		endpoint_start_b = b[2 * subset_index[i]];
-		endpoint_end_b = b[2 * subset_index[i] + 1];
-		uint64_t output;
-		if (signed_flag) {
-			int32_t r16 = InterpolateFloat(endpoint_start_r, endpoint_end_r, color_index[i],
-				color_index_bit_count);
-			if (r16 < 0)
-				r16 = - (((- r16) * 31) >> 5);
-			else
-				r16 = (r16 * 31) >> 5;
-			int s = 0;
-			if (r16 < 0) {
-				s = 0x8000;
-				r16 = - r16;
-			}
-			r16 |= s;
-			int32_t g16 = InterpolateFloat(endpoint_start_g, endpoint_end_g, color_index[i],
-				color_index_bit_count);
-			if (g16 < 0)
-				g16 = - (((- g16) * 31) >> 5);
-			else
-				g16 = (g16 * 31) >> 5;
-			s = 0;
-			if (g16 < 0) {
-				s = 0x8000;
-				g16 = - g16;
-			}
-			g16 |= s;
-			int32_t b16 = InterpolateFloat(endpoint_start_b, endpoint_end_b, color_index[i],
-				color_index_bit_count);
-			if (b16 < 0)
-				b16 = - (((- b16) * 31) >> 5);
-			else
-				b16 = (b16 * 31) >> 5;
-			s = 0;
-			if (b16 < 0) {
-				s = 0x8000;
-				b16 = - b16;
-			}
-			b16 |= s;
-			output = detexPack64RGB16(r16, g16, b16);
-		}
-		else {
-			output = detexPack64R16(InterpolateFloat(endpoint_start_r, endpoint_end_r, color_index[i],
-				color_index_bit_count) * 31 / 64);
-			output |= detexPack64G16(InterpolateFloat(endpoint_start_g, endpoint_end_g, color_index[i],
-				color_index_bit_count) * 31 / 64);
-			output |= detexPack64B16(InterpolateFloat(endpoint_start_b, endpoint_end_b, color_index[i],
-				color_index_bit_count) * 31 / 64);
-		}
-		*(uint64_t *)&pixel_buffer[i * 8] = output;
-	}
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSE2())
+		UnquantizeAndInterpolateSSE2(r, g, b, mode, signed_flag, subset_index, color_index,
+			color_index_bit_count, pixel_buffer);
+	else
+#endif
+		UnquantizeAndInterpolate(r, g, b, mode, signed_flag, subset_index, color_index,
+			color_index_bit_count, pixel_buffer);
 	return true;
 }
 
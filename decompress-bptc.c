@@ -19,6 +19,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "detex.h"
 #include "bits.h"
 #include "bptc-tables.h"
+#include "simd.h"
 
 // BPTC mode layout:
 //
@@ -68,10 +69,10 @@ static DETEX_INLINE_ONLY uint8_t GetAlphaComponentPrecisionPlusPbit(int mode) {
 	return alpha_precision_plus_pbit_table[mode];
 }
 
-static const int8_t components_in_qword0_table[8] = { 2, -1, 1, 1, 3, 3, 3, 2 };
+static const int8_t components_in_qword0_table[8] = { 2, 2, 1, 1, 3, 3, 3, 2 };
 
 /* Extract endpoint colors. */
-static void ExtractEndpoints(int mode, int nu_subsets, detexBlock128 * DETEX_RESTRICT block,
+static DETEX_INLINE_ONLY void ExtractEndpoints(int mode, int nu_subsets, detexBlock128 * DETEX_RESTRICT block,
 uint8_t * DETEX_RESTRICT endpoint_array) {
 	// Optimized version avoiding the use of block_extract_bits().
 	int components_in_qword0 = components_in_qword0_table[mode];
@@ -133,30 +134,31 @@ uint8_t * DETEX_RESTRICT endpoint_array) {
 
 static const uint8_t mode_has_p_bits[8] = { 1, 1, 0, 1, 0, 0, 1, 1 };
 
-static void FullyDecodeEndpoints(uint8_t * DETEX_RESTRICT endpoint_array, int nu_subsets,
+/* Extract the P-bits and append them to the endpoint components as the LSB. */
+static DETEX_INLINE_ONLY void ExtractPBits(uint8_t * DETEX_RESTRICT endpoint_array, int nu_subsets,
 int mode, detexBlock128 * DETEX_RESTRICT block) {
-	if (mode_has_p_bits[mode]) {
-		// Mode 1 (shared P-bits) handled elsewhere.
-		// Extract end-point P-bits. Take advantage of the fact that they don't cross the
-		// 64-bit word boundary in any mode.
-		uint32_t bits;
-		if (block->index < 64)
-			bits = block->data0 >> block->index;
-		else
-			bits = block->data1 >> (block->index - 64);
-		for (int i = 0; i < nu_subsets * 2; i++) {
-			endpoint_array[i * 4 + 0] <<= 1;
- 			endpoint_array[i * 4 + 1] <<= 1;
-			endpoint_array[i * 4 + 2] <<= 1;
-			endpoint_array[i * 4 + 3] <<= 1;
-			endpoint_array[i * 4 + 0] |= (bits & 1);
-			endpoint_array[i * 4 + 1] |= (bits & 1);
-			endpoint_array[i * 4 + 2] |= (bits & 1);
-			endpoint_array[i * 4 + 3] |= (bits & 1);
-			bits >>= 1;
-		}
-		block->index += nu_subsets * 2;
+	if (!mode_has_p_bits[mode])
+		return;
+	// Extract end-point P-bits. Take advantage of the fact that they don't cross the
+	// 64-bit word boundary in any mode.
+	uint32_t bits;
+	if (block->index < 64)
+		bits = block->data0 >> block->index;
+	else
+		bits = block->data1 >> (block->index - 64);
+	// Mode 1 has one shared P-bit per subset, the other modes one P-bit per endpoint.
+	int pbit_shift = (mode == 1);
+	int nu_components = GetAlphaComponentPrecision(mode) > 0 ? 4 : 3;
+	for (int i = 0; i < nu_subsets * 2; i++) {
+		uint8_t pbit = (bits >> (i >> pbit_shift)) & 1;
+		for (int j = 0; j < nu_components; j++)
+			endpoint_array[i * 4 + j] = (endpoint_array[i * 4 + j] << 1) | pbit;
 	}
+	block->index += (nu_subsets * 2) >> pbit_shift;
+}
+
+static DETEX_INLINE_ONLY void UnquantizeEndpoints(uint8_t * DETEX_RESTRICT endpoint_array, int nu_subsets,
+int mode) {
 	int color_prec = GetColorComponentPrecisionPlusPbit(mode);
 	int alpha_prec = GetAlphaComponentPrecisionPlusPbit(mode);
 	for (int i = 0; i < nu_subsets * 2; i++) {
@@ -165,21 +167,20 @@ int mode, detexBlock128 * DETEX_RESTRICT block) {
 		endpoint_array[i * 4 + 0] <<= (8 - color_prec);
 		endpoint_array[i * 4 + 1] <<= (8 - color_prec);
 		endpoint_array[i * 4 + 2] <<= (8 - color_prec);
-		endpoint_array[i * 4 + 3] <<= (8 - alpha_prec);
-
 	        // Replicate each component's MSB into the LSBs revealed by the left-shift operation above.
 		endpoint_array[i * 4 + 0] |= (endpoint_array[i * 4 + 0] >> color_prec);
 		endpoint_array[i * 4 + 1] |= (endpoint_array[i * 4 + 1] >> color_prec);
 		endpoint_array[i * 4 + 2] |= (endpoint_array[i * 4 + 2] >> color_prec);
-		endpoint_array[i * 4 + 3] |= (endpoint_array[i * 4 + 3] >> alpha_prec);
-	}
-	if (mode <= 3) {
-		for (int i = 0; i < nu_subsets * 2; i++)
+		if (alpha_prec > 0) {
+			endpoint_array[i * 4 + 3] <<= (8 - alpha_prec);
+			endpoint_array[i * 4 + 3] |= (endpoint_array[i * 4 + 3] >> alpha_prec);
+		}
+		else
 			endpoint_array[i * 4 + 3] = 0xFF;
- 	}
+	}
 }
 
-static uint8_t Interpolate(uint8_t e0, uint8_t e1, uint8_t index, uint8_t indexprecision) {
+static DETEX_INLINE_ONLY uint8_t Interpolate(uint8_t e0, uint8_t e1, uint8_t index, uint8_t indexprecision) {
 	if (indexprecision == 2)
 		return (uint8_t) (((64 - detex_bptc_table_aWeight2[index]) * (uint16_t)e0
 			+ detex_bptc_table_aWeight2[index] * (uint16_t)e1 + 32) >> 6);
@@ -199,7 +200,7 @@ static DETEX_INLINE_ONLY int GetColorIndexBitcount(int mode, int index_selection
 	return bptc_color_index_bitcount[mode] + index_selection_bit;
 }
 
-static uint8_t bptc_alpha_index_bitcount[8] = { 3, 3, 2, 2, 3, 2, 4, 2};
+static const uint8_t bptc_alpha_index_bitcount[8] = { 3, 3, 2, 2, 3, 2, 4, 2};
 
 static DETEX_INLINE_ONLY int GetAlphaIndexBitcount(int mode, int index_selection_bit) {
 	// If the index selection bit is set for mode 4, return 2, otherwise 3.
@@ -237,7 +238,7 @@ static int ExtractMode(detexBlock128 *block) {
 }
 
 static DETEX_INLINE_ONLY int ExtractPartitionSetID(detexBlock128 *block, int mode) {
-	return detexBlock128ExtractBits(block, GetNumberOfPartitionBits(mode));
+	return detexBlock128ExtractBitsInline(block, GetNumberOfPartitionBits(mode));
 }
 
 static DETEX_INLINE_ONLY int GetPartitionIndex(int nu_subsets, int partition_set_id, int i) {
@@ -249,7 +250,7 @@ static DETEX_INLINE_ONLY int GetPartitionIndex(int nu_subsets, int partition_set
 }
 
 static DETEX_INLINE_ONLY int ExtractRotationBits(detexBlock128 *block, int mode) {
-	return detexBlock128ExtractBits(block, GetNumberOfRotationBits(mode));
+	return detexBlock128ExtractBitsInline(block, GetNumberOfRotationBits(mode));
 }
 
 static DETEX_INLINE_ONLY int GetAnchorIndex(int partition_set_id, int partition, int nu_subsets) {
@@ -266,144 +267,51 @@ static const uint8_t IB[8] = { 3, 3, 2, 2, 2, 2, 4, 2 };
 static const uint8_t IB2[8] = { 0, 0, 0, 0, 3, 2, 0, 0 };
 static const uint8_t mode_has_partition_bits[8] = { 1, 1, 1, 1, 0, 0, 0, 1 };
 
-/* Decompress a 128-bit 4x4 pixel texture block compressed using BPTC mode 1. */
-
-static bool DecompressBlockBPTCMode1(detexBlock128 * DETEX_RESTRICT block,
-uint8_t * DETEX_RESTRICT pixel_buffer) {
-	uint64_t data0 = block->data0;
-	uint64_t data1 = block->data1;
-	int partition_set_id = detexGetBits64(data0, 2, 7);
-	uint8_t endpoint[2 * 2 * 3];	// 2 subsets.
-	endpoint[0] = detexGetBits64(data0, 8, 13);	// red, subset 0, endpoint 0
-	endpoint[3] = detexGetBits64(data0, 14, 19);	// red, subset 0, endpoint 1
-	endpoint[6] = detexGetBits64(data0, 20, 25);	// red, subset 1, endpoint 0
-	endpoint[9] = detexGetBits64(data0, 26, 31);	// red, subset 1, endpoint 1
-	endpoint[1] = detexGetBits64(data0, 32, 37);	// green, subset 0, endpoint 0
-	endpoint[4] = detexGetBits64(data0, 38, 43);	// green, subset 0, endpoint 1
-	endpoint[7] = detexGetBits64(data0, 44, 49);	// green, subset 1, endpoint 0
-	endpoint[10] = detexGetBits64(data0, 50, 55);	// green, subset 1, endpoint 1
-	endpoint[2] = detexGetBits64(data0, 56, 61);	// blue, subset 0, endpoint 0
-	endpoint[5] = detexGetBits64(data0, 62, 63)	// blue, subset 0, endpoint 1
-		| (detexGetBits64(data1, 0, 3) << 2);
-	endpoint[8] = detexGetBits64(data1, 4, 9);	// blue, subset 1, endpoint 0
-	endpoint[11] = detexGetBits64(data1, 10, 15);	// blue, subset 1, endpoint 1
-	// Decode endpoints.
-	for (int i = 0; i < 2 * 2; i++) {
-		//component-wise left-shift
-		endpoint[i * 3 + 0] <<= 2;
-		endpoint[i * 3 + 1] <<= 2;
-		endpoint[i * 3 + 2] <<= 2;
-       	}
-	// P-bit is shared.
-	uint8_t pbit_zero = detexGetBits64(data1, 16, 16) << 1;
-	uint8_t pbit_one = detexGetBits64(data1, 17, 17) << 1;
-        // RGB only pbits for mode 1, one for each subset.
-	for (int j = 0; j < 3; j++) {
-		endpoint[0 * 3 + j] |= pbit_zero;
-		endpoint[1 * 3 + j] |= pbit_zero;
-		endpoint[2 * 3 + j] |= pbit_one;
-		endpoint[3 * 3 + j] |= pbit_one;
-	}
-	for (int i = 0; i < 2 * 2; i++) {
-	        // Replicate each component's MSB into the LSB.
-		endpoint[i * 3 + 0] |= endpoint[i * 3 + 0] >> 7;
-		endpoint[i * 3 + 1] |= endpoint[i * 3 + 1] >> 7;
-		endpoint[i * 3 + 2] |= endpoint[i * 3 + 2] >> 7;
-	}
- 
+// Block parameters decoded from the bitstring, shared by the scalar and SIMD kernels.
+typedef struct {
+	uint8_t endpoint_array[3 * 2 * 4];	// Max. 3 subsets, quantized (including P-bits).
 	uint8_t subset_index[16];
-	for (int i = 0; i < 16; i++)
-		// subset_index[i] is a number from 0 to 1.
-		subset_index[i] = detex_bptc_table_P2[partition_set_id * 16 + i];
-	uint8_t anchor_index[2];
-	anchor_index[0] = 0;
-	anchor_index[1] = detex_bptc_table_anchor_index_second_subset[partition_set_id];
 	uint8_t color_index[16];
-	// Extract primary index bits.
-	data1 >>= 18;
-	for (int i = 0; i < 16; i++)
-		if (i == anchor_index[subset_index[i]]) {
-			// Highest bit is zero.
-			color_index[i] = data1 & 3; // Get two bits.
-			data1 >>= 2;
-		}
-		else {
-			color_index[i] = data1 & 7;	// Get three bits.
-			data1 >>= 3;
-		}
-	uint32_t *pixel32_buffer = (uint32_t *)pixel_buffer;
-	for (int i = 0; i < 16; i++) {
-		uint8_t endpoint_start[3];
-		uint8_t endpoint_end[3];
-		for (int j = 0; j < 3; j++) {
-			 endpoint_start[j] = endpoint[2 * subset_index[i] * 3 + j];
-			 endpoint_end[j] = endpoint[(2 * subset_index[i] + 1) * 3 + j];
-		}
-		uint32_t output;
-		output = detexPack32R8(Interpolate(endpoint_start[0], endpoint_end[0], color_index[i], 3));
-		output |= detexPack32G8(Interpolate(endpoint_start[1], endpoint_end[1], color_index[i], 3));
-		output |= detexPack32B8(Interpolate(endpoint_start[2], endpoint_end[2], color_index[i], 3));
-		output |= detexPack32A8(0xFF);
-		pixel32_buffer[i] = output;
-	}
-	return true;
-}
-
-/* Decompress a 128-bit 4x4 pixel texture block compressed using the BPTC */
-/* (BC7) format. */
-bool detexDecompressBlockBPTC(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
-uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
-	detexBlock128 block;
-	block.data0 = *(uint64_t *)&bitstring[0];
-	block.data1 = *(uint64_t *)&bitstring[8];
-	block.index = 0;
-	int mode = ExtractMode(&block);
-	if (mode == - 1)
-		return 0;
-	// Allow compression tied to specific modes (according to mode_mask).
-	if (!(mode_mask & ((int)1 << mode)))
-		return 0;
-	if (mode >= 4 && (flags & DETEX_DECOMPRESS_FLAG_OPAQUE_ONLY))
-		return 0;
-	if (mode < 4 && (flags & DETEX_DECOMPRESS_FLAG_NON_OPAQUE_ONLY))
-		return 0;
-	if (mode == 1)
-		return DecompressBlockBPTCMode1(&block, pixel_buffer);
-
+	uint8_t alpha_index[16];
+	int rotation;
+	int index_selection_bit;
+} detexBPTCBlockInfo;
+
+// Decode everything except the endpoint unquantization and interpolation. This function is
+// always inlined with a constant mode, so that all mode-dependent table look-ups and
+// branches are resolved at compile time in each of the per-mode kernels.
+static DETEX_INLINE_ONLY void DecodeBlockInfoBPTC(detexBlock128 * DETEX_RESTRICT block, int mode,
+detexBPTCBlockInfo * DETEX_RESTRICT info) {
 	int nu_subsets = 1;
 	int partition_set_id = 0;
 	if (mode_has_partition_bits[mode]) {
 		nu_subsets = GetNumberOfSubsets(mode);
-		partition_set_id = ExtractPartitionSetID(&block, mode);
+		partition_set_id = ExtractPartitionSetID(block, mode);
 	}
-	int rotation = ExtractRotationBits(&block, mode);
+	info->rotation = ExtractRotationBits(block, mode);
 	int index_selection_bit = 0;
 	if (mode == 4)
-		index_selection_bit = detexBlock128ExtractBits(&block, 1);
-
-	int alpha_index_bitcount = GetAlphaIndexBitcount(mode, index_selection_bit);
-	int color_index_bitcount = GetColorIndexBitcount(mode, index_selection_bit);
+		index_selection_bit = detexBlock128ExtractBitsInline(block, 1);
+	info->index_selection_bit = index_selection_bit;
 
-	uint8_t endpoint_array[3 * 2 * 4];	// Max. 3 subsets.
-	ExtractEndpoints(mode, nu_subsets, &block, endpoint_array);
-	FullyDecodeEndpoints(endpoint_array, nu_subsets, mode, &block);
+	ExtractEndpoints(mode, nu_subsets, block, info->endpoint_array);
+	ExtractPBits(info->endpoint_array, nu_subsets, mode, block);
 
-	uint8_t subset_index[16];
+	uint8_t *subset_index = info->subset_index;
+	uint8_t *color_index = info->color_index;
+	uint8_t *alpha_index = info->alpha_index;
 	for (int i = 0; i < 16; i++)
 		// subset_index[i] is a number from 0 to 2, or 0 to 1, or 0 depending on the number of subsets.
 		subset_index[i] = GetPartitionIndex(nu_subsets, partition_set_id, i);
 	uint8_t anchor_index[4];	// Only need max. 3 elements.
 	for (int i = 0; i < nu_subsets; i++)
 		anchor_index[i] = GetAnchorIndex(partition_set_id, i, nu_subsets);
-	uint8_t color_index[16];
-	uint8_t alpha_index[16];
 	// Extract primary index bits.
 	uint64_t data1;
-	if (block.index >= 64) {
+	if (mode != 4) {
 		// Because the index bits are all in the second 64-bit word, there is no need to use
 		// block_extract_bits().
-		// This implies the mode is not 4.
-		data1 = block.data1 >> (block.index - 64);
+		data1 = block->data1 >> (block->index - 64);
 		uint8_t mask1 = (1 << IB[mode]) - 1;
 		uint8_t mask2 = (1 << (IB[mode] - 1)) - 1;
 		for (int i = 0; i < 16; i++)
@@ -419,81 +327,65 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 				alpha_index[i] = color_index[i];
 			}
 	}
-	else {	// Implies mode 4.
+	else {
 		// Because the bits cross the 64-bit word boundary, we have to be careful.
 		// Block index is 50 at this point.
-		uint64_t data = block.data0 >> 50;
-		data |= block.data1 << 14;
+		uint64_t data = block->data0 >> 50;
+		data |= block->data1 << 14;
+		uint8_t *primary_index = index_selection_bit ? alpha_index : color_index;
 		for (int i = 0; i < 16; i++)
 			if (i == anchor_index[subset_index[i]]) {
 				// Highest bit is zero.
-				if (index_selection_bit) {	// Implies mode == 4.
-					alpha_index[i] = data & 0x1;
-					data >>= 1;
-				}
-				else {
-					color_index[i] = data & 0x1;
-					data >>= 1;
-				}
+				primary_index[i] = data & 0x1;
+				data >>= 1;
 			}
 			else {
-				if (index_selection_bit) {	// Implies mode == 4.
-					alpha_index[i] = data & 0x3;
-					data >>= 2;
-				}
-				else {
-					color_index[i] = data & 0x3;
-					data >>= 2;
-				}
+				primary_index[i] = data & 0x3;
+				data >>= 2;
 			}
 		// Block index is 81 at this point.
-		data1 = block.data1 >> (81 - 64);
+		data1 = block->data1 >> (81 - 64);
 	}
 	// Extract secondary index bits.
 	if (IB2[mode] > 0) {
+		uint8_t *secondary_index = index_selection_bit ? color_index : alpha_index;
 		uint8_t mask1 = (1 << IB2[mode]) - 1;
 		uint8_t mask2 = (1 << (IB2[mode] - 1)) - 1;
 		for (int i = 0; i < 16; i++)
 			if (i == anchor_index[subset_index[i]]) {
 				// Highest bit is zero.
-				if (index_selection_bit) {
-					color_index[i] = data1 & 0x3;
-					data1 >>= 2;
-				}
-				else {
-//					alpha_index[i] = block_extract_bits(&block, IB2[mode] - 1);
-					alpha_index[i] = data1 & mask2;
-					data1 >>= IB2[mode] - 1;
-				}
+				secondary_index[i] = data1 & mask2;
+				data1 >>= IB2[mode] - 1;
 			}
 			else {
-				if (index_selection_bit) {
-					color_index[i] = data1 & 0x7;
-					data1 >>= 3;
-				}
-				else {
-//					alpha_index[i] = block_extract_bits(&block, IB2[mode]);
-					alpha_index[i] = data1 & mask1;
-					data1 >>= IB2[mode];
-				}
+				secondary_index[i] = data1 & mask1;
+				data1 >>= IB2[mode];
 			}
 	}
+}
 
+static DETEX_INLINE_ONLY void InterpolatePixels(detexBPTCBlockInfo * DETEX_RESTRICT info, int mode,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	int nu_subsets = GetNumberOfSubsets(mode);
+	int color_index_bitcount = GetColorIndexBitcount(mode, info->index_selection_bit);
+	int alpha_index_bitcount = GetAlphaIndexBitcount(mode, info->index_selection_bit);
+	int rotation = info->rotation;
+	uint8_t *endpoint_array = info->endpoint_array;
+	UnquantizeEndpoints(endpoint_array, nu_subsets, mode);
 	uint32_t *pixel32_buffer = (uint32_t *)pixel_buffer;
 	for (int i = 0; i < 16; i++) {
-		uint8_t endpoint_start[4];
-		uint8_t endpoint_end[4];
-		for (int j = 0; j < 4; j++) {
-			 endpoint_start[j] = endpoint_array[2 * subset_index[i] * 4 + j];
-			 endpoint_end[j] = endpoint_array[(2 * subset_index[i] + 1) * 4 + j];
-		}
-
-		uint32_t output = 0;
-		output = detexPack32R8(Interpolate(endpoint_start[0], endpoint_end[0], color_index[i], color_index_bitcount));
-		output |= detexPack32G8(Interpolate(endpoint_start[1], endpoint_end[1], color_index[i], color_index_bitcount));
-		output |= detexPack32B8(Interpolate(endpoint_start[2], endpoint_end[2], color_index[i], color_index_bitcount));
-		output |= detexPack32A8(Interpolate(endpoint_start[3], endpoint_end[3], alpha_index[i], alpha_index_bitcount));
-   
+		uint8_t *endpoint_start = &endpoint_array[2 * info->subset_index[i] * 4];
+		uint8_t *endpoint_end = &endpoint_array[(2 * info->subset_index[i] + 1) * 4];
+		uint8_t color_index = info->color_index[i];
+		uint32_t output;
+		output = detexPack32R8(Interpolate(endpoint_start[0], endpoint_end[0], color_index, color_index_bitcount));
+		output |= detexPack32G8(Interpolate(endpoint_start[1], endpoint_end[1], color_index, color_index_bitcount));
+		output |= detexPack32B8(Interpolate(endpoint_start[2], endpoint_end[2], color_index, color_index_bitcount));
+		if (mode <= 3)
+			output |= detexPack32A8(0xFF);
+		else
+			output |= detexPack32A8(Interpolate(endpoint_start[3], endpoint_end[3], info->alpha_index[i],
+				alpha_index_bitcount));
 		if (rotation > 0) {
 			if (rotation == 1)
 				output = detexPack32RGBA8(detexPixel32GetA8(output), detexPixel32GetG8(output),
@@ -508,6 +400,217 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 		}
 		pixel32_buffer[i] = output;
 	}
+}
+
+#ifdef DETEX_SIMD_X86
+
+// Unquantize two endpoints held as 16-bit components, replicating the MSBs into the LSBs.
+// The variable shifts are done using multiplications with constants derived from the mode.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 __m128i UnquantizeEndpointsSSSE3(__m128i e, int mode) {
+	int color_prec = GetColorComponentPrecisionPlusPbit(mode);
+	int alpha_prec = GetAlphaComponentPrecisionPlusPbit(mode);
+	int color_shl = 1 << (8 - color_prec);
+	int color_shr = 1 << (16 - color_prec);
+	int alpha_shl = alpha_prec > 0 ? 1 << (8 - alpha_prec) : 0;
+	int alpha_shr = alpha_prec > 0 ? 1 << (16 - alpha_prec) : 0;
+	e = _mm_mullo_epi16(e, _mm_setr_epi16(color_shl, color_shl, color_shl, alpha_shl,
+		color_shl, color_shl, color_shl, alpha_shl));
+	e = _mm_or_si128(e, _mm_mulhi_epu16(e, _mm_setr_epi16(color_shr, color_shr, color_shr,
+		alpha_shr, color_shr, color_shr, color_shr, alpha_shr)));
+	if (alpha_prec == 0)
+		e = _mm_or_si128(e, _mm_setr_epi16(0, 0, 0, 0xFF, 0, 0, 0, 0xFF));
+	return e;
+}
+
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 __m128i GetWeightTableSSSE3(int index_bitcount) {
+	if (index_bitcount == 2)
+		return _mm_setr_epi8(0, 21, 43, 64, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	if (index_bitcount == 3)
+		return _mm_setr_epi8(0, 9, 18, 27, 37, 46, 55, 64, 0, 0, 0, 0, 0, 0, 0, 0);
+	return _mm_setr_epi8(0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64);
+}
+
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 __m128i GetRotationShuffleSSSE3(int rotation) {
+	if (rotation == 1)
+		return _mm_setr_epi8(3, 1, 2, 0, 7, 5, 6, 4, 11, 9, 10, 8, 15, 13, 14, 12);
+	if (rotation == 2)
+		return _mm_setr_epi8(0, 3, 2, 1, 4, 7, 6, 5, 8, 11, 10, 9, 12, 15, 14, 13);
+	return _mm_setr_epi8(0, 1, 3, 2, 4, 5, 7, 6, 8, 9, 11, 10, 12, 13, 15, 14);
+}
+
+// Unquantize the endpoints and interpolate two pixels per 128-bit register using 16-bit
+// components. The per-pixel weights and subset endpoints are gathered using byte shuffles.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 void InterpolatePixelsSSSE3(detexBPTCBlockInfo * DETEX_RESTRICT info,
+int mode, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	int nu_subsets = GetNumberOfSubsets(mode);
+	int color_index_bitcount = GetColorIndexBitcount(mode, info->index_selection_bit);
+	int alpha_index_bitcount = GetAlphaIndexBitcount(mode, info->index_selection_bit);
+	const __m128i zero = _mm_setzero_si128();
+	// Endpoints of subset 0 (and subset 1 when present) as 16-bit components.
+	__m128i raw = nu_subsets == 1 ? _mm_loadl_epi64((const __m128i *)info->endpoint_array) :
+		_mm_loadu_si128((const __m128i *)info->endpoint_array);
+	__m128i e01 = UnquantizeEndpointsSSSE3(_mm_unpacklo_epi8(raw, zero), mode);
+	__m128i endpoint0, endpoint1, subset_shuffle;
+	if (nu_subsets == 1) {
+		endpoint0 = _mm_unpacklo_epi64(e01, e01);
+		endpoint1 = _mm_unpackhi_epi64(e01, e01);
+	}
+	else {
+		// Build byte tables with the first and the second endpoint of each subset, from
+		// which the 16-bit endpoint components of each pixel are shuffled.
+		__m128i e23 = UnquantizeEndpointsSSSE3(_mm_unpackhi_epi8(raw, zero), mode);
+		__m128i e45 = zero;
+		if (nu_subsets == 3)
+			e45 = UnquantizeEndpointsSSSE3(_mm_unpacklo_epi8(_mm_loadl_epi64(
+				(const __m128i *)&info->endpoint_array[16]), zero), mode);
+		__m128i bytes0123 = _mm_packus_epi16(e01, e23);
+		__m128i bytes45 = _mm_packus_epi16(e45, zero);
+		endpoint0 = _mm_or_si128(_mm_shuffle_epi8(bytes0123, _mm_setr_epi8(0, 1, 2, 3, 8, 9, 10, 11,
+			-1, -1, -1, -1, -1, -1, -1, -1)), _mm_shuffle_epi8(bytes45, _mm_setr_epi8(-1, -1, -1, -1,
+			-1, -1, -1, -1, 0, 1, 2, 3, -1, -1, -1, -1)));
+		endpoint1 = _mm_or_si128(_mm_shuffle_epi8(bytes0123, _mm_setr_epi8(4, 5, 6, 7, 12, 13, 14, 15,
+			-1, -1, -1, -1, -1, -1, -1, -1)), _mm_shuffle_epi8(bytes45, _mm_setr_epi8(-1, -1, -1, -1,
+			-1, -1, -1, -1, 4, 5, 6, 7, -1, -1, -1, -1)));
+		// Byte offset of the endpoint in the tables for each pixel.
+		subset_shuffle = _mm_slli_epi16(_mm_loadu_si128((const __m128i *)info->subset_index), 2);
+	}
+	// Look up the weights for each pixel and interleave the color and alpha weights.
+	__m128i color_weight = _mm_shuffle_epi8(GetWeightTableSSSE3(color_index_bitcount),
+		_mm_loadu_si128((const __m128i *)info->color_index));
+	__m128i alpha_weight = _mm_shuffle_epi8(GetWeightTableSSSE3(alpha_index_bitcount),
+		_mm_loadu_si128((const __m128i *)info->alpha_index));
+	__m128i weights[2];
+	weights[0] = _mm_unpacklo_epi8(color_weight, alpha_weight);
+	weights[1] = _mm_unpackhi_epi8(color_weight, alpha_weight);
+	// Shuffles expanding the bytes of two pixels into 16-bit components. The zeroing
+	// bytes (-128) keep their sign bit when a pixel offset is added.
+	const __m128i weight_expand = _mm_setr_epi8(0, -128, 0, -128, 0, -128, 1, -128,
+		2, -128, 2, -128, 2, -128, 3, -128);
+	const __m128i subset_expand = _mm_setr_epi8(0, -128, 0, -128, 0, -128, 0, -128,
+		1, -128, 1, -128, 1, -128, 1, -128);
+	const __m128i component_offset = _mm_setr_epi8(0, -128, 1, -128, 2, -128, 3, -128,
+		0, -128, 1, -128, 2, -128, 3, -128);
+	const __m128i c32 = _mm_set1_epi16(32);
+	const __m128i c64 = _mm_set1_epi16(64);
+	for (int i = 0; i < 4; i++) {
+		__m128i result[2];
+		for (int j = 0; j < 2; j++) {
+			// Pixels 2 * p and 2 * p + 1.
+			int p = i * 2 + j;
+			__m128i w = _mm_shuffle_epi8(weights[p >> 2], _mm_add_epi8(weight_expand,
+				_mm_set1_epi8((p & 3) * 4)));
+			__m128i e0 = endpoint0;
+			__m128i e1 = endpoint1;
+			if (nu_subsets > 1) {
+				__m128i shuffle = _mm_add_epi8(_mm_shuffle_epi8(subset_shuffle,
+					_mm_add_epi8(subset_expand, _mm_set1_epi8(p * 2))), component_offset);
+				e0 = _mm_shuffle_epi8(endpoint0, shuffle);
+				e1 = _mm_shuffle_epi8(endpoint1, shuffle);
+			}
+			// ((64 - w) * e0 + w * e1 + 32) >> 6
+			result[j] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(_mm_sub_epi16(c64, w), e0), _mm_mullo_epi16(w, e1)), c32), 6);
+		}
+		__m128i output = _mm_packus_epi16(result[0], result[1]);
+		if (info->rotation > 0)
+			output = _mm_shuffle_epi8(output, GetRotationShuffleSSSE3(info->rotation));
+		_mm_storeu_si128((__m128i *)&pixel_buffer[i * 16], output);
+	}
+}
+
+#endif
+
+// Define a kernel for each mode. The mode is a compile-time constant, so that the
+// specialized code generated for each mode only contains the paths relevant to it.
+
+#define DEFINE_DECOMPRESS_BLOCK_BPTC_MODE(mode) \
+	static void DecompressBlockBPTCMode##mode(detexBlock128 * DETEX_RESTRICT block, \
+	uint8_t * DETEX_RESTRICT pixel_buffer) { \
+		detexBPTCBlockInfo info; \
+		DecodeBlockInfoBPTC(block, mode, &info); \
+		InterpolatePixels(&info, mode, pixel_buffer); \
+	}
+
+#define DEFINE_DECOMPRESS_BLOCK_BPTC_MODE_SSSE3(mode) \
+	static DETEX_TARGET_SSSE3 void DecompressBlockBPTCMode##mode##SSSE3(detexBlock128 * DETEX_RESTRICT block, \
+	uint8_t * DETEX_RESTRICT pixel_buffer) { \
+		detexBPTCBlockInfo info; \
+		DecodeBlockInfoBPTC(block, mode, &info); \
+		InterpolatePixelsSSSE3(&info, mode, pixel_buffer); \
+	}
+
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE(0)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE(1)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE(2)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE(3)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE(4)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE(5)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE(6)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE(7)
+
+typedef void (*detexDecompressBlockBPTCModeFuncType)(detexBlock128 * DETEX_RESTRICT block,
+	uint8_t * DETEX_RESTRICT pixel_buffer);
+
+static const detexDecompressBlockBPTCModeFuncType decompress_mode_function[8] = {
+	DecompressBlockBPTCMode0,
+	DecompressBlockBPTCMode1,
+	DecompressBlockBPTCMode2,
+	DecompressBlockBPTCMode3,
+	DecompressBlockBPTCMode4,
+	DecompressBlockBPTCMode5,
+	DecompressBlockBPTCMode6,
+	DecompressBlockBPTCMode7,
+};
+
+#ifdef DETEX_SIMD_X86
+
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE_SSSE3(0)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE_SSSE3(1)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE_SSSE3(2)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE_SSSE3(3)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE_SSSE3(4)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE_SSSE3(5)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE_SSSE3(6)
+DEFINE_DECOMPRESS_BLOCK_BPTC_MODE_SSSE3(7)
+
+static const detexDecompressBlockBPTCModeFuncType decompress_mode_function_ssse3[8] = {
+	DecompressBlockBPTCMode0SSSE3,
+	DecompressBlockBPTCMode1SSSE3,
+	DecompressBlockBPTCMode2SSSE3,
+	DecompressBlockBPTCMode3SSSE3,
+	DecompressBlockBPTCMode4SSSE3,
+	DecompressBlockBPTCMode5SSSE3,
+	DecompressBlockBPTCMode6SSSE3,
+	DecompressBlockBPTCMode7SSSE3,
+};
+
+#endif
+
+/* Decompress a 128-bit 4x4 pixel texture block compressed using the BPTC */
+/* (BC7) format. */
+bool detexDecompressBlockBPTC(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
+uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	detexBlock128 block;
+	block.data0 = *(uint64_t *)&bitstring[0];
+	block.data1 = *(uint64_t *)&bitstring[8];
+	block.index = 0;
+	int mode = ExtractMode(&block);
+	if (mode == - 1)
+		return 0;
+	// Allow compression tied to specific modes (according to mode_mask).
+	if (!(mode_mask & ((int)1 << mode)))
+		return 0;
+	if (mode >= 4 && (flags & DETEX_DECOMPRESS_FLAG_OPAQUE_ONLY))
+		return 0;
+	if (mode < 4 && (flags & DETEX_DECOMPRESS_FLAG_NON_OPAQUE_ONLY))
+		return 0;
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3()) {
+		decompress_mode_function_ssse3[mode](&block, pixel_buffer);
+		return true;
+	}
+#endif
+	decompress_mode_function[mode](&block, pixel_buffer);
 	return true;
 }
 
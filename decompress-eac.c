@@ -17,6 +17,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
 #include "detex.h"
+#include "simd.h"
 
 static const int8_t eac_modifier_table[16][8] = {
 	{ -3, -6, -9, -15, 2, 5, 8, 14 },
@@ -37,6 +38,151 @@ static const int8_t eac_modifier_table[16][8] = {
 	{ -3, -5, -7, -9, 2, 4, 6, 8 }
 };
 
+#ifdef DETEX_SIMD_X86
+
+// Expand the 3-bit pixel indices of an EAC block to one 16-bit lane per pixel, in row-major
+// order (pixels 0-7 in indices[0], 8-15 in indices[1]). The indices are stored MSB first in
+// column-major order; each lane receives the two bytes containing the index of the pixel,
+// which is shifted to the top of the lane by a per-lane multiplication and then down to bit 0.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 void GetIndicesEACSSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+__m128i * DETEX_RESTRICT indices) {
+	__m128i bytes = _mm_loadl_epi64((const __m128i *)bitstring);
+	indices[0] = _mm_shuffle_epi8(bytes, _mm_setr_epi8(2, 1, 3, 2, 5, 4, 6, 5, 2, 1, 4, 3, 5, 4, 7, 6));
+	indices[1] = _mm_shuffle_epi8(bytes, _mm_setr_epi8(3, 2, 4, 3, 6, 5, 7, 6, 3, 2, 4, 3, 6, 5, 7, 6));
+	indices[0] = _mm_srli_epi16(_mm_mullo_epi16(indices[0], _mm_setr_epi16(1 << 8, 1 << 12, 1 << 8,
+		1 << 12, 1 << 11, 1 << 7, 1 << 11, 1 << 7)), 13);
+	indices[1] = _mm_srli_epi16(_mm_mullo_epi16(indices[1], _mm_setr_epi16(1 << 6, 1 << 10, 1 << 6,
+		1 << 10, 1 << 9, 1 << 13, 1 << 9, 1 << 13)), 13);
+}
+
+// Return the eight modifiers of the modifier table of a block as 16-bit values.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 __m128i GetModifiersEACSSSE3(const uint8_t * DETEX_RESTRICT bitstring) {
+	__m128i modifiers = _mm_loadl_epi64((const __m128i *)eac_modifier_table[bitstring[1] & 0x0F]);
+	return _mm_srai_epi16(_mm_unpacklo_epi8(modifiers, modifiers), 8);
+}
+
+// Look up the 16-bit values of the pixels in a palette of eight 16-bit values.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 void LookupPalette16SSSE3(__m128i palette,
+const __m128i * DETEX_RESTRICT indices, __m128i * DETEX_RESTRICT pixels) {
+	// Byte shuffle index pair (2 * index, 2 * index + 1).
+	const __m128i multiplier = _mm_set1_epi16(0x0202);
+	const __m128i offset = _mm_set1_epi16(0x0100);
+	pixels[0] = _mm_shuffle_epi8(palette, _mm_add_epi16(_mm_mullo_epi16(indices[0], multiplier), offset));
+	pixels[1] = _mm_shuffle_epi8(palette, _mm_add_epi16(_mm_mullo_epi16(indices[1], multiplier), offset));
+}
+
+// Decode the 11-bit values of an EAC R11 block, replicated to 16 bits.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 void DecodeBlockEAC11BitSSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+__m128i * DETEX_RESTRICT pixels) {
+	int base_codeword_times_8_plus_4 = (bitstring[0] << 3) | 0x4;
+	int multiplier_times_8 = (bitstring[1] & 0xF0) >> 1;
+	if (multiplier_times_8 == 0)
+		multiplier_times_8 = 1;
+	__m128i palette = _mm_add_epi16(_mm_set1_epi16(base_codeword_times_8_plus_4),
+		_mm_mullo_epi16(GetModifiersEACSSSE3(bitstring), _mm_set1_epi16(multiplier_times_8)));
+	palette = _mm_min_epi16(_mm_max_epi16(palette, _mm_setzero_si128()), _mm_set1_epi16(2047));
+	// Replicate bits to 16-bit.
+	palette = _mm_or_si128(_mm_slli_epi16(palette, 5), _mm_srli_epi16(palette, 6));
+	__m128i indices[2];
+	GetIndicesEACSSSE3(bitstring, indices);
+	LookupPalette16SSSE3(palette, indices, pixels);
+}
+
+// Decode the 11-bit values of an EAC signed R11 block, replicated to 16 bits. Returns false
+// if the block is invalid.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 bool DecodeBlockEACSigned11BitSSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+__m128i * DETEX_RESTRICT pixels) {
+	int base_codeword = (int8_t)bitstring[0];
+	if (base_codeword == - 128)
+		return false;
+	int multiplier_times_8 = (bitstring[1] & 0xF0) >> 1;
+	if (multiplier_times_8 == 0)
+		multiplier_times_8 = 1;
+	__m128i palette = _mm_add_epi16(_mm_set1_epi16(base_codeword * 8),
+		_mm_mullo_epi16(GetModifiersEACSSSE3(bitstring), _mm_set1_epi16(multiplier_times_8)));
+	palette = _mm_min_epi16(_mm_max_epi16(palette, _mm_set1_epi16(- 1023)), _mm_set1_epi16(1023));
+	// Replicate the bits of the magnitude to 16-bit and restore the sign.
+	__m128i magnitude = _mm_abs_epi16(palette);
+	magnitude = _mm_or_si128(_mm_slli_epi16(magnitude, 5), _mm_srli_epi16(magnitude, 5));
+	palette = _mm_sign_epi16(magnitude, palette);
+	__m128i indices[2];
+	GetIndicesEACSSSE3(bitstring, indices);
+	LookupPalette16SSSE3(palette, indices, pixels);
+	return true;
+}
+
+static DETEX_TARGET_SSSE3 void DecompressBlockEAC_R11SSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i red[2];
+	DecodeBlockEAC11BitSSSE3(bitstring, red);
+	_mm_storeu_si128((__m128i *)pixel_buffer, red[0]);
+	_mm_storeu_si128((__m128i *)&pixel_buffer[16], red[1]);
+}
+
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 void StorePixelsRG16SSSE3(const __m128i * DETEX_RESTRICT red,
+const __m128i * DETEX_RESTRICT green, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	_mm_storeu_si128((__m128i *)pixel_buffer, _mm_unpacklo_epi16(red[0], green[0]));
+	_mm_storeu_si128((__m128i *)&pixel_buffer[16], _mm_unpackhi_epi16(red[0], green[0]));
+	_mm_storeu_si128((__m128i *)&pixel_buffer[32], _mm_unpacklo_epi16(red[1], green[1]));
+	_mm_storeu_si128((__m128i *)&pixel_buffer[48], _mm_unpackhi_epi16(red[1], green[1]));
+}
+
+static DETEX_TARGET_SSSE3 void DecompressBlockEAC_RG11SSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i red[2];
+	__m128i green[2];
+	DecodeBlockEAC11BitSSSE3(bitstring, red);
+	DecodeBlockEAC11BitSSSE3(&bitstring[8], green);
+	StorePixelsRG16SSSE3(red, green, pixel_buffer);
+}
+
+static DETEX_TARGET_SSSE3 bool DecompressBlockEAC_SIGNED_R11SSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i red[2];
+	if (!DecodeBlockEACSigned11BitSSSE3(bitstring, red))
+		return false;
+	_mm_storeu_si128((__m128i *)pixel_buffer, red[0]);
+	_mm_storeu_si128((__m128i *)&pixel_buffer[16], red[1]);
+	return true;
+}
+
+static DETEX_TARGET_SSSE3 bool DecompressBlockEAC_SIGNED_RG11SSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i red[2];
+	__m128i green[2];
+	if (!DecodeBlockEACSigned11BitSSSE3(bitstring, red))
+		return false;
+	if (!DecodeBlockEACSigned11BitSSSE3(&bitstring[8], green))
+		return false;
+	StorePixelsRG16SSSE3(red, green, pixel_buffer);
+	return true;
+}
+
+// Decode the alpha values of an ETC2_EAC block and merge them into the RGBA8 pixels
+// decoded from the color part.
+static DETEX_TARGET_SSSE3 void ProcessAlphaEACSSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	int multiplier = (bitstring[1] & 0xF0) >> 4;
+	__m128i palette = _mm_add_epi16(_mm_set1_epi16(bitstring[0]),
+		_mm_mullo_epi16(GetModifiersEACSSSE3(bitstring), _mm_set1_epi16(multiplier)));
+	// The saturating pack clamps to [0, 255].
+	palette = _mm_packus_epi16(palette, palette);
+	__m128i indices[2];
+	GetIndicesEACSSSE3(bitstring, indices);
+	__m128i alpha = _mm_shuffle_epi8(palette, _mm_packus_epi16(indices[0], indices[1]));
+	const __m128i color_mask = _mm_set1_epi32(0x00FFFFFF);
+	for (int y = 0; y < 4; y++) {
+		__m128i alpha_row = _mm_shuffle_epi8(alpha, _mm_add_epi8(_mm_setr_epi8(-1, -1, -1, 0,
+			-1, -1, -1, 1, -1, -1, -1, 2, -1, -1, -1, 3), _mm_setr_epi8(0, 0, 0, y * 4,
+			0, 0, 0, y * 4, 0, 0, 0, y * 4, 0, 0, 0, y * 4)));
+		__m128i colors = _mm_loadu_si128((__m128i *)&pixel_buffer[y * 16]);
+		_mm_storeu_si128((__m128i *)&pixel_buffer[y * 16],
+			_mm_or_si128(_mm_and_si128(colors, color_mask), alpha_row));
+	}
+}
+
+#endif
+
 static DETEX_INLINE_ONLY int modifier_times_multiplier(int modifier, int multiplier) {
 	return modifier * multiplier;
 }
@@ -63,6 +209,12 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 	if (multiplier == 0 && (flags & DETEX_DECOMPRESS_FLAG_ENCODE))
 		// Not allowed in encoding. Decoder should handle it.
 		return false;
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3()) {
+		ProcessAlphaEACSSSE3(bitstring, pixel_buffer);
+		return true;
+	}
+#endif
 	uint64_t pixels = ((uint64_t)bitstring[2] << 40) | ((uint64_t)bitstring[3] << 32) |
 		((uint64_t)bitstring[4] << 24)
 		| ((uint64_t)bitstring[5] << 16) | ((uint64_t)bitstring[6] << 8) | bitstring[7];
@@ -131,6 +283,12 @@ uint8_t * DETEX_RESTRICT pixel_buffer) {
 /* EAC_R11 format. */
 bool detexDecompressBlockEAC_R11(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
 uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3()) {
+		DecompressBlockEAC_R11SSSE3(bitstring, pixel_buffer);
+		return true;
+	}
+#endif
 	uint64_t qword = ((uint64_t)bitstring[0] << 56) | ((uint64_t)bitstring[1] << 48) |
 		((uint64_t)bitstring[2] << 40) |
 		((uint64_t)bitstring[3] << 32) | ((uint64_t)bitstring[4] << 24) |
@@ -143,6 +301,12 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 /* EAC_RG11 format. */
 bool detexDecompressBlockEAC_RG11(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
 uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3()) {
+		DecompressBlockEAC_RG11SSSE3(bitstring, pixel_buffer);
+		return true;
+	}
+#endif
 	uint64_t red_qword = ((uint64_t)bitstring[0] << 56) | ((uint64_t)bitstring[1] << 48) |
 		((uint64_t)bitstring[2] << 40) |
 		((uint64_t)bitstring[3] << 32) | ((uint64_t)bitstring[4] << 24) |
@@ -205,6 +369,10 @@ uint8_t *pixel_buffer) {
 /* EAC_SIGNED_R11 format. */
 bool detexDecompressBlockEAC_SIGNED_R11(const uint8_t * DETEX_RESTRICT bitstring,
 uint32_t mode_mask, uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3())
+		return DecompressBlockEAC_SIGNED_R11SSSE3(bitstring, pixel_buffer);
+#endif
 	uint64_t qword = ((uint64_t)bitstring[0] << 56) | ((uint64_t)bitstring[1] << 48) |
 		((uint64_t)bitstring[2] << 40) |
 		((uint64_t)bitstring[3] << 32) | ((uint64_t)bitstring[4] << 24) |
@@ -216,6 +384,10 @@ uint32_t mode_mask, uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 /* EAC_SIGNED_RG11 format. */
 bool detexDecompressBlockEAC_SIGNED_RG11(const uint8_t * DETEX_RESTRICT bitstring,
 uint32_t mode_mask, uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3())
+		return DecompressBlockEAC_SIGNED_RG11SSSE3(bitstring, pixel_buffer);
+#endif
 	uint64_t red_qword = ((uint64_t)bitstring[0] << 56) | ((uint64_t)bitstring[1] << 48) |
 		((uint64_t)bitstring[2] << 40) |
 		((uint64_t)bitstring[3] << 32) | ((uint64_t)bitstring[4] << 24) |
@@ -17,6 +17,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
 #include "detex.h"
+#include "simd.h"
 
 static const int complement3bitshifted_table[8] = {
 	0, 8, 16, 24, -32, -24, -16, -8
@@ -67,6 +68,92 @@ static DETEX_INLINE_ONLY int complement3bit(int x) {
 	return x;
 }
 
+#ifdef DETEX_SIMD_X86
+
+// Return the 2-bit pixel index of each of the 16 pixels in row-major order, one per byte and
+// multiplied by four (the byte offset of the color in a palette of four 32-bit colors).
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 __m128i GetPixelIndicesSSSE3(const uint8_t * DETEX_RESTRICT bitstring) {
+	__m128i bytes = _mm_loadl_epi64((const __m128i *)bitstring);
+	// Pixel x, y (index x * 4 + y in the pixel index word) uses bit (x & 1) * 4 + y of
+	// byte 7 - (x >> 1) for the least significant bit and of byte 5 - (x >> 1) for the most
+	// significant bit.
+	const __m128i bit_mask = _mm_setr_epi8(1, 16, 1, 16, 2, 32, 2, 32, 4, 64, 4, 64,
+		8, -128, 8, -128);
+	__m128i lsb = _mm_shuffle_epi8(bytes, _mm_setr_epi8(7, 7, 6, 6, 7, 7, 6, 6, 7, 7, 6, 6,
+		7, 7, 6, 6));
+	__m128i msb = _mm_shuffle_epi8(bytes, _mm_setr_epi8(5, 5, 4, 4, 5, 5, 4, 4, 5, 5, 4, 4,
+		5, 5, 4, 4));
+	lsb = _mm_cmpeq_epi8(_mm_and_si128(lsb, bit_mask), bit_mask);
+	msb = _mm_cmpeq_epi8(_mm_and_si128(msb, bit_mask), bit_mask);
+	return _mm_or_si128(_mm_and_si128(lsb, _mm_set1_epi8(4)), _mm_and_si128(msb, _mm_set1_epi8(8)));
+}
+
+// Return the byte shuffle that looks up the colors of row y in a palette of four colors.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 __m128i GetRowShuffleSSSE3(__m128i indices, int y) {
+	__m128i shuffle = _mm_shuffle_epi8(indices, _mm_add_epi8(_mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1,
+		2, 2, 2, 2, 3, 3, 3, 3), _mm_set1_epi8(y * 4)));
+	return _mm_add_epi8(shuffle, _mm_setr_epi8(0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3));
+}
+
+// Build the palette of four colors of an ETC1 sub-block from the base color and the
+// modifiers. The saturating pack clamps the components to [0, 255].
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 __m128i GetPaletteETC1SSSE3(const int * DETEX_RESTRICT base_color,
+const int * DETEX_RESTRICT modifiers) {
+	__m128i base = _mm_setr_epi16(base_color[0], base_color[1], base_color[2], 0xFF,
+		base_color[0], base_color[1], base_color[2], 0xFF);
+	__m128i modifiers01 = _mm_setr_epi16(modifiers[0], modifiers[0], modifiers[0], 0,
+		modifiers[1], modifiers[1], modifiers[1], 0);
+	__m128i modifiers23 = _mm_setr_epi16(modifiers[2], modifiers[2], modifiers[2], 0,
+		modifiers[3], modifiers[3], modifiers[3], 0);
+	return _mm_packus_epi16(_mm_add_epi16(base, modifiers01), _mm_add_epi16(base, modifiers23));
+}
+
+// Decode the pixels of an ETC1 (or ETC2 individual/differential mode) block given the
+// base colors and modifiers of both sub-blocks. For punchthrough alpha, pixel index 2
+// is transparent black.
+static DETEX_TARGET_SSSE3 void ProcessBlockETC1SSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+const int * DETEX_RESTRICT base_color_subblock1, const int * DETEX_RESTRICT base_color_subblock2,
+const int * DETEX_RESTRICT modifiers1, const int * DETEX_RESTRICT modifiers2, bool punchthrough,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i palette1 = GetPaletteETC1SSSE3(base_color_subblock1, modifiers1);
+	__m128i palette2 = GetPaletteETC1SSSE3(base_color_subblock2, modifiers2);
+	if (punchthrough) {
+		const __m128i mask = _mm_setr_epi32(-1, -1, 0, -1);
+		palette1 = _mm_and_si128(palette1, mask);
+		palette2 = _mm_and_si128(palette2, mask);
+	}
+	__m128i indices = GetPixelIndicesSSSE3(bitstring);
+	int flipbit = bitstring[3] & 1;
+	for (int y = 0; y < 4; y++) {
+		__m128i shuffle = GetRowShuffleSSSE3(indices, y);
+		__m128i colors;
+		if (flipbit)
+			// Sub-blocks are the top and bottom halves.
+			colors = _mm_shuffle_epi8(y < 2 ? palette1 : palette2, shuffle);
+		else {
+			// Sub-blocks are the left and right halves; shuffle indices with the
+			// sign bit set produce zero bytes.
+			const __m128i left = _mm_setr_epi32(0, 0, 0x80808080, 0x80808080);
+			const __m128i right = _mm_setr_epi32(0x80808080, 0x80808080, 0, 0);
+			colors = _mm_or_si128(_mm_shuffle_epi8(palette1, _mm_or_si128(shuffle, left)),
+				_mm_shuffle_epi8(palette2, _mm_or_si128(shuffle, right)));
+		}
+		_mm_storeu_si128((__m128i *)&pixel_buffer[y * 16], colors);
+	}
+}
+
+// Decode the pixels of a block using a palette of four colors selected by the pixel index.
+static DETEX_TARGET_SSSE3 void ProcessPixelsPaletteSSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+const uint32_t * DETEX_RESTRICT palette, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i palette4 = _mm_loadu_si128((const __m128i *)palette);
+	__m128i indices = GetPixelIndicesSSSE3(bitstring);
+	for (int y = 0; y < 4; y++)
+		_mm_storeu_si128((__m128i *)&pixel_buffer[y * 16],
+			_mm_shuffle_epi8(palette4, GetRowShuffleSSSE3(indices, y)));
+}
+
+#endif
+
 // Define inline function to speed up ETC1 decoding.
 
 static DETEX_INLINE_ONLY void ProcessPixelETC1(uint8_t i, uint32_t pixel_index_word,
@@ -138,6 +225,13 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 	}
 	uint32_t table_codeword1 = (bitstring[3] & 224) >> 5;
 	uint32_t table_codeword2 = (bitstring[3] & 28) >> 2;
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3()) {
+		ProcessBlockETC1SSSE3(bitstring, base_color_subblock1, base_color_subblock2,
+			modifier_table[table_codeword1], modifier_table[table_codeword2], false, pixel_buffer);
+		return true;
+	}
+#endif
 	uint32_t pixel_index_word = ((uint32_t)bitstring[4] << 24) | ((uint32_t)bitstring[5] << 16) |
 		((uint32_t)bitstring[6] << 8) | bitstring[7];
 	if (flipbit == 0) {
@@ -271,6 +365,15 @@ uint8_t * DETEX_RESTRICT pixel_buffer) {
 		paint_color_G[3] = detexClamp0To255(base_color2_G - distance);
 		paint_color_B[3] = detexClamp0To255(base_color2_B - distance);
 	}
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3()) {
+		uint32_t palette[4];
+		for (int i = 0; i < 4; i++)
+			palette[i] = detexPack32RGB8Alpha0xFF(paint_color_R[i], paint_color_G[i], paint_color_B[i]);
+		ProcessPixelsPaletteSSSE3(bitstring, palette, pixel_buffer);
+		return;
+	}
+#endif
 	uint32_t pixel_index_word = ((uint32_t)bitstring[4] << 24) | ((uint32_t)bitstring[5] << 16) |
 		((uint32_t)bitstring[6] << 8) | bitstring[7];
 	uint32_t *buffer = (uint32_t *)pixel_buffer;
@@ -284,6 +387,30 @@ uint8_t * DETEX_RESTRICT pixel_buffer) {
 	}
 }
 
+#ifdef DETEX_SIMD_X86
+
+// Calculate the planar mode pixels four at a time using 16-bit components. The alpha
+// component evaluates to 0xFF; the saturating pack clamps the components to [0, 255].
+static DETEX_TARGET_SSE2 void ProcessPixelsETC2PlanarModeSSE2(int RO, int GO, int BO, int RH, int GH,
+int BH, int RV, int GV, int BV, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i O = _mm_setr_epi16(RO, GO, BO, 0xFF, RO, GO, BO, 0xFF);
+	__m128i dH = _mm_sub_epi16(_mm_setr_epi16(RH, GH, BH, 0xFF, RH, GH, BH, 0xFF), O);
+	__m128i dV = _mm_sub_epi16(_mm_setr_epi16(RV, GV, BV, 0xFF, RV, GV, BV, 0xFF), O);
+	// x * (H - O) for x = 0, 1 and x = 2, 3.
+	__m128i x01 = _mm_unpackhi_epi64(_mm_setzero_si128(), dH);
+	__m128i x23 = _mm_add_epi16(x01, _mm_add_epi16(dH, dH));
+	// y * (V - O) + 4 * O + 2
+	__m128i row = _mm_add_epi16(_mm_slli_epi16(O, 2), _mm_set1_epi16(2));
+	for (int y = 0; y < 4; y++) {
+		__m128i pixels01 = _mm_srai_epi16(_mm_add_epi16(row, x01), 2);
+		__m128i pixels23 = _mm_srai_epi16(_mm_add_epi16(row, x23), 2);
+		_mm_storeu_si128((__m128i *)&pixel_buffer[y * 16], _mm_packus_epi16(pixels01, pixels23));
+		row = _mm_add_epi16(row, dV);
+	}
+}
+
+#endif
+
 static void ProcessBlockETC2PlanarMode(const uint8_t * DETEX_RESTRICT bitstring,
 uint8_t * DETEX_RESTRICT pixel_buffer) {
 	// Each color O, H and V is in 6-7-6 format.
@@ -306,6 +433,12 @@ uint8_t * DETEX_RESTRICT pixel_buffer) {
 	RV = (RV << 2) | ((RV & 0x30) >> 4);
 	GV = (GV << 1) | ((GV & 0x40) >> 6);
 	BV = (BV << 2) | ((BV & 0x30) >> 4);
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSE2()) {
+		ProcessPixelsETC2PlanarModeSSE2(RO, GO, BO, RH, GH, BH, RV, GV, BV, pixel_buffer);
+		return;
+	}
+#endif
 	uint32_t *buffer = (uint32_t *)pixel_buffer;
 	for (int y = 0; y < 4; y++)
 		for (int x = 0; x < 4; x++) {
@@ -522,6 +655,14 @@ uint8_t * DETEX_RESTRICT pixel_buffer) {
 	base_color_subblock2[2] |= (base_color_subblock2[2] & 224) >> 5;
 	uint32_t table_codeword1 = (bitstring[3] & 224) >> 5;
 	uint32_t table_codeword2 = (bitstring[3] & 28) >> 2;
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3()) {
+		ProcessBlockETC1SSSE3(bitstring, base_color_subblock1, base_color_subblock2,
+			punchthrough_modifier_table[table_codeword1], punchthrough_modifier_table[table_codeword2],
+			true, pixel_buffer);
+		return;
+	}
+#endif
 	uint32_t pixel_index_word = ((uint32_t)bitstring[4] << 24) | ((uint32_t)bitstring[5] << 16) |
 		((uint32_t)bitstring[6] << 8) | bitstring[7];
 	if (flipbit == 0) {
@@ -634,6 +775,16 @@ int mode, uint8_t * DETEX_RESTRICT pixel_buffer) {
 		paint_color_G[3] = detexClamp0To255(base_color2_G - distance);
 		paint_color_B[3] = detexClamp0To255(base_color2_B - distance);
 	}
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3()) {
+		uint32_t palette[4];
+		for (int i = 0; i < 4; i++)
+			palette[i] = detexPack32RGB8Alpha0xFF(paint_color_R[i], paint_color_G[i], paint_color_B[i])
+				& punchthrough_mask_table[i];
+		ProcessPixelsPaletteSSSE3(bitstring, palette, pixel_buffer);
+		return;
+	}
+#endif
 	uint32_t pixel_index_word = ((uint32_t)bitstring[4] << 24) | ((uint32_t)bitstring[5] << 16) |
 		((uint32_t)bitstring[6] << 8) | bitstring[7];
 	uint32_t *buffer = (uint32_t *)pixel_buffer;
@@ -17,6 +17,32 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
 #include "detex.h"
+#include "simd.h"
+
+// Build the palette of eight values of an unsigned RGTC block.
+static DETEX_INLINE_ONLY void GetPaletteRGTC(const uint8_t * DETEX_RESTRICT bitstring,
+uint8_t * DETEX_RESTRICT palette) {
+	int lum0 = bitstring[0];
+	int lum1 = bitstring[1];
+	palette[0] = lum0;
+	palette[1] = lum1;
+	if (lum0 > lum1) {
+		palette[2] = detexDivide0To1791By7(6 * lum0 + lum1);
+		palette[3] = detexDivide0To1791By7(5 * lum0 + 2 * lum1);
+		palette[4] = detexDivide0To1791By7(4 * lum0 + 3 * lum1);
+		palette[5] = detexDivide0To1791By7(3 * lum0 + 4 * lum1);
+		palette[6] = detexDivide0To1791By7(2 * lum0 + 5 * lum1);
+		palette[7] = detexDivide0To1791By7(lum0 + 6 * lum1);
+	}
+	else {
+		palette[2] = detexDivide0To1279By5(4 * lum0 + lum1);
+		palette[3] = detexDivide0To1279By5(3 * lum0 + 2 * lum1);
+		palette[4] = detexDivide0To1279By5(2 * lum0 + 3 * lum1);
+		palette[5] = detexDivide0To1279By5(lum0 + 4 * lum1);
+		palette[6] = 0;
+		palette[7] = 0xFF;
+	}
+}
 
 // For each pixel, decode an 8-bit integer and store as follows:
 // If shift and offset are zero, store each value in consecutive 8 bit values in pixel_buffer.
@@ -25,54 +51,52 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 // 16-bit word.
 static DETEX_INLINE_ONLY void DecodeBlockRGTC(const uint8_t * DETEX_RESTRICT bitstring, int shift,
 int offset, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	uint8_t palette[8];
+	GetPaletteRGTC(bitstring, palette);
 	// LSBFirst byte order only.
 	uint64_t bits = (*(uint64_t *)&bitstring[0]) >> 16;
-	int lum0 = bitstring[0];
-	int lum1 = bitstring[1];
 	for (int i = 0; i < 16; i++) {
-		int control_code = bits & 0x7;
-		uint8_t output;
-		if (lum0 > lum1)
-			switch (control_code) {
-			case 0 : output = lum0; break;
-			case 1 : output = lum1; break;
-			case 2 : output = detexDivide0To1791By7(6 * lum0 + lum1); break;
-			case 3 : output = detexDivide0To1791By7(5 * lum0 + 2 * lum1); break;
-			case 4 : output = detexDivide0To1791By7(4 * lum0 + 3 * lum1); break;
-			case 5 : output = detexDivide0To1791By7(3 * lum0 + 4 * lum1); break;
-			case 6 : output = detexDivide0To1791By7(2 * lum0 + 5 * lum1); break;
-			case 7 : output = detexDivide0To1791By7(lum0 + 6 * lum1); break;
-			}
-		else
-			switch (control_code) {
-			case 0 : output = lum0; break;
-			case 1 : output = lum1; break;
-			case 2 : output = detexDivide0To1279By5(4 * lum0 + lum1); break;
-			case 3 : output = detexDivide0To1279By5(3 * lum0 + 2 * lum1); break;
-			case 4 : output = detexDivide0To1279By5(2 * lum0 + 3 * lum1); break;
-			case 5 : output = detexDivide0To1279By5(lum0 + 4 * lum1); break;
-			case 6 : output = 0; break;
-			case 7 : output = 0xFF; break;
-			}
-		pixel_buffer[(i << shift) + offset] = output;
+		pixel_buffer[(i << shift) + offset] = palette[bits & 0x7];
 		bits >>= 3;
 	}
 }
 
-/* Decompress a 64-bit 4x4 pixel texture block compressed using the */
-/* unsigned RGTC1 (BC4) format. */
-bool detexDecompressBlockRGTC1(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
-uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
-	DecodeBlockRGTC(bitstring, 0, 0, pixel_buffer);
-	return true;
-}
-
-/* Decompress a 128-bit 4x4 pixel texture block compressed using the */
-/* unsigned RGTC2 (BC5) format. */
-bool detexDecompressBlockRGTC2(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
-uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
-	DecodeBlockRGTC(bitstring, 1, 0, pixel_buffer);
-	DecodeBlockRGTC(&bitstring[8], 1, 1, pixel_buffer);
+// Build the palette of eight values of a signed RGTC block, mapped from [-127, 127] to
+// [-32768, 32767]. Returns false if the block is invalid.
+static DETEX_INLINE_ONLY bool GetPaletteSignedRGTC(const uint8_t * DETEX_RESTRICT bitstring,
+uint16_t * DETEX_RESTRICT palette) {
+	int lum0 = (int8_t)bitstring[0];
+	int lum1 = (int8_t)bitstring[1];
+	if (lum0 == - 127 && lum1 == - 128)
+		// Not allowed.
+		return false;
+	if (lum0 == - 128)
+		lum0 = - 127;
+	if (lum1 == - 128)
+		lum1 = - 127;
+	// Note: values are mapped to a red value of -127 to 127.
+	int32_t result[8];
+	result[0] = lum0;
+	result[1] = lum1;
+	if (lum0 > lum1) {
+		result[2] = detexDivideMinus895To895By7(6 * lum0 + lum1);
+		result[3] = detexDivideMinus895To895By7(5 * lum0 + 2 * lum1);
+		result[4] = detexDivideMinus895To895By7(4 * lum0 + 3 * lum1);
+		result[5] = detexDivideMinus895To895By7(3 * lum0 + 4 * lum1);
+		result[6] = detexDivideMinus895To895By7(2 * lum0 + 5 * lum1);
+		result[7] = detexDivideMinus895To895By7(lum0 + 6 * lum1);
+	}
+	else {
+		result[2] = detexDivideMinus639To639By5(4 * lum0 + lum1);
+		result[3] = detexDivideMinus639To639By5(3 * lum0 + 2 * lum1);
+		result[4] = detexDivideMinus639To639By5(2 * lum0 + 3 * lum1);
+		result[5] = detexDivideMinus639To639By5(lum0 + 4 * lum1);
+		result[6] = - 127;
+		result[7] = 127;
+	}
+	// Map from [-127, 127] to [-32768, 32767].
+	for (int i = 0; i < 8; i++)
+		palette[i] = (uint16_t)(int16_t)((result[i] + 127) * 65535 / 254 - 32768);
 	return true;
 }
 
@@ -83,56 +107,138 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 // 32-bit word. Returns true if the compressed block is valid.
 static DETEX_INLINE_ONLY bool DecodeBlockSignedRGTC(const uint8_t * DETEX_RESTRICT bitstring, int shift,
 int offset, uint8_t * DETEX_RESTRICT pixel_buffer) {
+	uint16_t palette[8];
+	if (!GetPaletteSignedRGTC(bitstring, palette))
+		return false;
 	// LSBFirst byte order only.
 	uint64_t bits = (*(uint64_t *)&bitstring[0]) >> 16;
-	int lum0 = (int8_t)bitstring[0];
-	int lum1 = (int8_t)bitstring[1];
-	if (lum0 == - 127 && lum1 == - 128)
-		// Not allowed.
-		return false;
-	if (lum0 == - 128)
-		lum0 = - 127;
-	if (lum1 == - 128)
-		lum1 = - 127;
-	// Note: values are mapped to a red value of -127 to 127.
 	uint16_t *pixel16_buffer = (uint16_t *)pixel_buffer;
 	for (int i = 0; i < 16; i++) {
-		int control_code = bits & 0x7;
-		int32_t result;
-		if (lum0 > lum1)
-			switch (control_code) {
-			case 0 : result = lum0; break;
-			case 1 : result = lum1; break;
-			case 2 : result = detexDivideMinus895To895By7(6 * lum0 + lum1); break;
-			case 3 : result = detexDivideMinus895To895By7(5 * lum0 + 2 * lum1); break;
-			case 4 : result = detexDivideMinus895To895By7(4 * lum0 + 3 * lum1); break;
-			case 5 : result = detexDivideMinus895To895By7(3 * lum0 + 4 * lum1); break;
-			case 6 : result = detexDivideMinus895To895By7(2 * lum0 + 5 * lum1); break;
-			case 7 : result = detexDivideMinus895To895By7(lum0 + 6 * lum1); break;
-			}
-		else
-			switch (control_code) {
-			case 0 : result = lum0; break;
-			case 1 : result = lum1; break;
-			case 2 : result = detexDivideMinus639To639By5(4 * lum0 + lum1); break;
-			case 3 : result = detexDivideMinus639To639By5(3 * lum0 + 2 * lum1); break;
-			case 4 : result = detexDivideMinus639To639By5(2 * lum0 + 3 * lum1); break;
-			case 5 : result = detexDivideMinus639To639By5(lum0 + 4 * lum1); break;
-			case 6 : result = - 127; break;
-			case 7 : result = 127; break;
-			}
-		// Map from [-127, 127] to [-32768, 32767].
-		pixel16_buffer[(i << shift) + offset] = (uint16_t)(int16_t)
-			((result + 127) * 65535 / 254 - 32768);
+		pixel16_buffer[(i << shift) + offset] = palette[bits & 0x7];
 		bits >>= 3;
 	}
 	return true;
 }
 
+#ifdef DETEX_SIMD_X86
+
+// Expand the 48 index bits of a block to one byte per pixel. Each 16-bit lane receives
+// the two bytes containing the 3-bit index of a pixel, which is then shifted to the top of
+// the lane by a multiplication (the shift amount differs per lane) and down to bit 0.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 __m128i GetIndicesRGTCSSSE3(const uint8_t * DETEX_RESTRICT bitstring) {
+	__m128i bytes = _mm_loadl_epi64((const __m128i *)bitstring);
+	const __m128i multiplier = _mm_setr_epi16(1 << 13, 1 << 10, 1 << 7, 1 << 12, 1 << 9, 1 << 6,
+		1 << 11, 1 << 8);
+	__m128i indices0 = _mm_shuffle_epi8(bytes, _mm_setr_epi8(2, 3, 2, 3, 2, 3, 3, 4, 3, 4, 3, 4,
+		4, 5, 4, 5));
+	__m128i indices1 = _mm_shuffle_epi8(bytes, _mm_setr_epi8(5, 6, 5, 6, 5, 6, 6, 7, 6, 7, 6, 7,
+		7, -1, 7, -1));
+	indices0 = _mm_srli_epi16(_mm_mullo_epi16(indices0, multiplier), 13);
+	indices1 = _mm_srli_epi16(_mm_mullo_epi16(indices1, multiplier), 13);
+	return _mm_packus_epi16(indices0, indices1);
+}
+
+// Decode the 16 pixels of an unsigned RGTC block to one byte each.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 __m128i DecodeBlockRGTCSSSE3(const uint8_t * DETEX_RESTRICT bitstring) {
+	uint8_t palette[16];
+	GetPaletteRGTC(bitstring, palette);
+	return _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)palette), GetIndicesRGTCSSSE3(bitstring));
+}
+
+// Decode the 16 pixels of a signed RGTC block to one 16-bit value each, pixels 0-7 in
+// pixels[0] and pixels 8-15 in pixels[1]. Returns false if the block is invalid.
+static DETEX_INLINE_ONLY DETEX_TARGET_SSSE3 bool DecodeBlockSignedRGTCSSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+__m128i * DETEX_RESTRICT pixels) {
+	uint16_t palette[8];
+	if (!GetPaletteSignedRGTC(bitstring, palette))
+		return false;
+	__m128i palette8 = _mm_loadu_si128((const __m128i *)palette);
+	// Byte shuffles selecting bytes 2 * index and 2 * index + 1.
+	__m128i indices = GetIndicesRGTCSSSE3(bitstring);
+	indices = _mm_add_epi8(indices, indices);
+	__m128i indices_plus_one = _mm_add_epi8(indices, _mm_set1_epi8(1));
+	pixels[0] = _mm_shuffle_epi8(palette8, _mm_unpacklo_epi8(indices, indices_plus_one));
+	pixels[1] = _mm_shuffle_epi8(palette8, _mm_unpackhi_epi8(indices, indices_plus_one));
+	return true;
+}
+
+static DETEX_TARGET_SSSE3 void DecompressBlockRGTC1SSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	_mm_storeu_si128((__m128i *)pixel_buffer, DecodeBlockRGTCSSSE3(bitstring));
+}
+
+static DETEX_TARGET_SSSE3 void DecompressBlockRGTC2SSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i red = DecodeBlockRGTCSSSE3(bitstring);
+	__m128i green = DecodeBlockRGTCSSSE3(&bitstring[8]);
+	_mm_storeu_si128((__m128i *)pixel_buffer, _mm_unpacklo_epi8(red, green));
+	_mm_storeu_si128((__m128i *)&pixel_buffer[16], _mm_unpackhi_epi8(red, green));
+}
+
+static DETEX_TARGET_SSSE3 bool DecompressBlockSignedRGTC1SSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i red[2];
+	if (!DecodeBlockSignedRGTCSSSE3(bitstring, red))
+		return false;
+	_mm_storeu_si128((__m128i *)pixel_buffer, red[0]);
+	_mm_storeu_si128((__m128i *)&pixel_buffer[16], red[1]);
+	return true;
+}
+
+static DETEX_TARGET_SSSE3 bool DecompressBlockSignedRGTC2SSSE3(const uint8_t * DETEX_RESTRICT bitstring,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	__m128i red[2];
+	__m128i green[2];
+	if (!DecodeBlockSignedRGTCSSSE3(bitstring, red))
+		return false;
+	if (!DecodeBlockSignedRGTCSSSE3(&bitstring[8], green))
+		return false;
+	_mm_storeu_si128((__m128i *)pixel_buffer, _mm_unpacklo_epi16(red[0], green[0]));
+	_mm_storeu_si128((__m128i *)&pixel_buffer[16], _mm_unpackhi_epi16(red[0], green[0]));
+	_mm_storeu_si128((__m128i *)&pixel_buffer[32], _mm_unpacklo_epi16(red[1], green[1]));
+	_mm_storeu_si128((__m128i *)&pixel_buffer[48], _mm_unpackhi_epi16(red[1], green[1]));
+	return true;
+}
+
+#endif
+
+/* Decompress a 64-bit 4x4 pixel texture block compressed using the */
+/* unsigned RGTC1 (BC4) format. */
+bool detexDecompressBlockRGTC1(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
+uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3()) {
+		DecompressBlockRGTC1SSSE3(bitstring, pixel_buffer);
+		return true;
+	}
+#endif
+	DecodeBlockRGTC(bitstring, 0, 0, pixel_buffer);
+	return true;
+}
+
+/* Decompress a 128-bit 4x4 pixel texture block compressed using the */
+/* unsigned RGTC2 (BC5) format. */
+bool detexDecompressBlockRGTC2(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
+uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3()) {
+		DecompressBlockRGTC2SSSE3(bitstring, pixel_buffer);
+		return true;
+	}
+#endif
+	DecodeBlockRGTC(bitstring, 1, 0, pixel_buffer);
+	DecodeBlockRGTC(&bitstring[8], 1, 1, pixel_buffer);
+	return true;
+}
+
 /* Decompress a 64-bit 4x4 pixel texture block compressed using the */
 /* signed RGTC1 (signed BC4) format. */
 bool detexDecompressBlockSIGNED_RGTC1(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
 uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3())
+		return DecompressBlockSignedRGTC1SSSE3(bitstring, pixel_buffer);
+#endif
 	return DecodeBlockSignedRGTC(bitstring, 0, 0, pixel_buffer);
 }
 
@@ -140,6 +246,10 @@ uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
 /* signed RGTC2 (signed BC5) format. */
 bool detexDecompressBlockSIGNED_RGTC2(const uint8_t * DETEX_RESTRICT bitstring, uint32_t mode_mask,
 uint32_t flags, uint8_t * DETEX_RESTRICT pixel_buffer) {
+#ifdef DETEX_SIMD_X86
+	if (detexCPUSupportsSSSE3())
+		return DecompressBlockSignedRGTC2SSSE3(bitstring, pixel_buffer);
+#endif
 	bool r = DecodeBlockSignedRGTC(bitstring, 1, 0, pixel_buffer);
 	if (!r)
 		return false;
@@ -0,0 +1,152 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+/* Microbenchmarks. Only the public API is used, so that the program can also be */
+/* built against an older version of the library to compare the results. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "detex.h"
+
+// Number of runs of each benchmark, of which the fastest is reported.
+#define NU_RUNS 20
+
+static __attribute ((noreturn)) void FatalError(const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	exit(1);
+}
+
+static void Usage() {
+	printf("detex-benchmark %s\n", DETEX_VERSION);
+	printf("Usage: detex-benchmark <BENCHMARK> [<ARGUMENTS>]\n");
+	printf("Benchmarks:\n");
+	printf("    bptc [<ITERATIONS>]\n");
+	printf("        Decompress every block of test-texture-BPTC.ktx and\n");
+	printf("        test-texture-BPTC_FLOAT.ktx with detexDecompressBlock.\n");
+	printf("    half-float [<THREADS> [<ITERATIONS>]]\n");
+	printf("        Convert a single FLOAT_RGBA16 pixel to RGBA16 with\n");
+	printf("        detexConvertPixels in each thread, which measures the cost of\n");
+	printf("        the half-float table check when many threads convert small buffers.\n");
+}
+
+static double GetTime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 0.000000001;
+}
+
+// Decompress every block of a texture file in its native pixel format, and report the
+// best time per block.
+static void BenchmarkBlockDecompression(const char *filename, int nu_iterations) {
+	detexTexture *texture;
+	if (!detexLoadTextureFile(filename, &texture))
+		FatalError("%s\n", detexGetErrorMessage());
+	int nu_blocks = texture->width_in_blocks * texture->height_in_blocks;
+	int block_size = detexGetCompressedBlockSize(texture->format);
+	uint32_t pixel_format = detexGetPixelFormat(texture->format);
+	uint8_t pixel_buffer[DETEX_MAX_BLOCK_SIZE];
+	double best_time = 0;
+	for (int run = 0; run < NU_RUNS; run++) {
+		double start_time = GetTime();
+		for (int i = 0; i < nu_iterations; i++)
+			for (int j = 0; j < nu_blocks; j++)
+				if (!detexDecompressBlock(texture->data + j * block_size, texture->format,
+				DETEX_MODE_MASK_ALL, 0, pixel_buffer, pixel_format))
+					FatalError("%s: Block %d is invalid\n", filename, j);
+		double time = GetTime() - start_time;
+		if (run == 0 || time < best_time)
+			best_time = time;
+	}
+	printf("%-12s %6d blocks  %8.1f ns/block\n", detexGetTextureFormatText(texture->format),
+		nu_blocks, best_time * 1000000000.0 / ((double)nu_iterations * nu_blocks));
+	free(texture->data);
+	free(texture);
+}
+
+static void BenchmarkBPTC(int argc, char **argv) {
+	int nu_iterations = 100;
+	if (argc >= 1)
+		nu_iterations = atoi(argv[0]);
+	if (nu_iterations <= 0)
+		FatalError("Fatal error: Invalid number of iterations\n");
+	BenchmarkBlockDecompression("test-texture-BPTC.ktx", nu_iterations);
+	BenchmarkBlockDecompression("test-texture-BPTC_FLOAT.ktx", nu_iterations);
+}
+
+static int nu_half_float_iterations;
+
+static void *HalfFloatThread(void *data) {
+	const uint16_t source_pixel[4] = { 0x0000, 0x3400, 0x3800, 0x3C00 };
+	uint16_t pixel[4];
+	for (int i = 0; i < nu_half_float_iterations; i++) {
+		memcpy(pixel, source_pixel, sizeof(pixel));
+		detexConvertPixels((uint8_t *)pixel, 1, DETEX_PIXEL_FORMAT_FLOAT_RGBA16,
+			(uint8_t *)pixel, DETEX_PIXEL_FORMAT_RGBA16);
+	}
+	return NULL;
+}
+
+// Run the conversion in a number of threads at the same time, and report the best
+// wall-clock time per call over all threads.
+static void BenchmarkHalfFloat(int argc, char **argv) {
+	int nu_threads = 1;
+	nu_half_float_iterations = 1000000;
+	if (argc >= 1)
+		nu_threads = atoi(argv[0]);
+	if (argc >= 2)
+		nu_half_float_iterations = atoi(argv[1]);
+	if (nu_threads <= 0 || nu_threads > 256 || nu_half_float_iterations <= 0)
+		FatalError("Fatal error: Invalid number of threads or iterations\n");
+	pthread_t threads[256];
+	double best_time = 0;
+	for (int run = 0; run < NU_RUNS; run++) {
+		double start_time = GetTime();
+		for (int i = 0; i < nu_threads; i++)
+			if (pthread_create(&threads[i], NULL, HalfFloatThread, NULL) != 0)
+				FatalError("Fatal error: Could not create thread\n");
+		for (int i = 0; i < nu_threads; i++)
+			pthread_join(threads[i], NULL);
+		double time = GetTime() - start_time;
+		if (run == 0 || time < best_time)
+			best_time = time;
+	}
+	printf("%3d threads  %8.1f ns/call\n", nu_threads, best_time * 1000000000.0 /
+		((double)nu_half_float_iterations * nu_threads));
+}
+
+int main(int argc, char **argv) {
+	if (argc == 1) {
+		Usage();
+		exit(0);
+	}
+	if (strcmp(argv[1], "bptc") == 0)
+		BenchmarkBPTC(argc - 2, argv + 2);
+	else if (strcmp(argv[1], "half-float") == 0)
+		BenchmarkHalfFloat(argc - 2, argv + 2);
+	else
+		FatalError("Fatal error: Unknown benchmark %s\n", argv[1]);
+	exit(0);
+}
@@ -21,9 +21,18 @@ extern "C" {
 #endif
 
 /* Load texture from PNG file (first mip-map only). Returns true if successful. */
-/* The texture is allocated, free with free(). */
+/* The texture and its data are allocated, free with detexFree(). */
 bool detexLoadPNGFile(const char *filename, detexTexture **texture_out);
 
+/* Load texture from PNG data in memory (first mip-map only). Returns true if */
+/* successful. The texture and its data are allocated, free with detexFree(). */
+bool detexLoadPNGMemory(const uint8_t *data, size_t size, detexTexture **texture_out);
+
+/* Load texture from PNG data provided by read callbacks (first mip-map only). */
+/* Returns true if successful. The texture and its data are allocated, free with */
+/* detexFree(). */
+bool detexLoadPNGCallbacks(const detexReadCallbacks *callbacks, detexTexture **texture_out);
+
 /* Save texture to PNG file (single mip-map level). Returns true if succesful. */
 bool detexSavePNGFile(detexTexture *texture, const char *filename);
 
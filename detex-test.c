@@ -0,0 +1,775 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+/* Behavior checks of the library, run with make test from the source directory */
+/* since they use the test texture files. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "detex.h"
+
+// Test textures used by the decompression checks.
+static const char *texture_files[] = {
+	"test-texture-BC1.ktx",
+	"test-texture-BC3.ktx",
+	"test-texture-RGTC2.ktx",
+	"test-texture-BPTC.ktx",
+	"test-texture-BPTC_FLOAT.ktx",
+	"test-texture-ETC2_EAC.ktx",
+	"test-texture-EAC_RG11.ktx",
+	"test-texture-RGBA8.ktx",
+	NULL
+};
+
+// Test texture files used by the loader checks.
+static const char *loader_files[] = {
+	"test-texture-BC1.ktx",
+	"test-texture-BPTC_FLOAT.ktx",
+	"test-texture-RGBA8.dds",
+	NULL
+};
+
+static int nu_checks;
+static int nu_failures;
+
+static void Check(bool condition, const char *format, ...) {
+	nu_checks++;
+	if (condition)
+		return;
+	nu_failures++;
+	va_list args;
+	va_start(args, format);
+	printf("FAILED: ");
+	vprintf(format, args);
+	printf("\n");
+	va_end(args);
+}
+
+static detexTexture *LoadTexture(const char *filename) {
+	detexTexture *texture;
+	if (!detexLoadTextureFile(filename, &texture)) {
+		printf("Fatal error: %s\n", detexGetErrorMessage());
+		exit(1);
+	}
+	return texture;
+}
+
+static void FreeTexture(detexTexture *texture) {
+	free(texture->data);
+	free(texture);
+}
+
+static void FreeTextures(detexTexture **textures, int nu_levels) {
+	for (int i = 0; i < nu_levels; i++)
+		FreeTexture(textures[i]);
+	free(textures);
+}
+
+// Return the size of the pixel data of a texture as stored in a file.
+static size_t GetTextureDataSize(const detexTexture *texture) {
+	size_t nu_blocks = (size_t)texture->width_in_blocks * texture->height_in_blocks;
+	if (detexFormatIsCompressed(texture->format))
+		return nu_blocks * detexGetCompressedBlockSize(texture->format);
+	return nu_blocks * detexGetPixelSize(texture->format);
+}
+
+// Check that the levels returned by a loader match those returned by the file loader.
+static void CheckTextureLevels(const char *filename, const char *loader,
+detexTexture **expected, int nu_expected_levels, detexTexture **textures, int nu_levels) {
+	bool match = nu_levels == nu_expected_levels;
+	for (int i = 0; i < nu_levels && match; i++) {
+		const detexTexture *a = expected[i];
+		const detexTexture *b = textures[i];
+		if (a->format != b->format || a->width != b->width || a->height != b->height ||
+		a->width_in_blocks != b->width_in_blocks || a->height_in_blocks != b->height_in_blocks ||
+		memcmp(a->data, b->data, GetTextureDataSize(a)) != 0)
+			match = false;
+	}
+	Check(match, "%s: Textures loaded with %s differ", filename, loader);
+}
+
+// Pixel format used for the decompression checks, one that every texture format can
+// be converted to.
+static uint32_t GetTestPixelFormat(const detexTexture *texture) {
+	if (detexGetPixelFormat(texture->format) & DETEX_PIXEL_FORMAT_FLOAT_BIT)
+		return DETEX_PIXEL_FORMAT_FLOAT_RGBX16;
+	return DETEX_PIXEL_FORMAT_RGBA8;
+}
+
+// Task runner that runs the tasks in reverse order in the calling thread.
+static void RunTasksReversed(detexTaskFunc task_func, void *task_data, int nu_tasks,
+void *user_data) {
+	for (int i = nu_tasks - 1; i >= 0; i--)
+		task_func(task_data, i);
+}
+
+// The multithreaded decompression functions must give the same output as the
+// single-threaded ones for any number of threads, with or without a task runner.
+// Tiled decompression is only checked for compressed textures.
+static void TestMultithreadedDecompression() {
+	const int nu_threads[] = { 0, 1, 2, 3, 7, 64 };
+	for (int i = 0; texture_files[i] != NULL; i++) {
+		detexTexture *texture = LoadTexture(texture_files[i]);
+		uint32_t pixel_format = GetTestPixelFormat(texture);
+		size_t size = (size_t)texture->width_in_blocks * texture->height_in_blocks * 16 *
+			detexGetPixelSize(pixel_format);
+		uint8_t *expected = (uint8_t *)malloc(size);
+		uint8_t *pixel_buffer = (uint8_t *)malloc(size);
+		int nu_layouts = detexFormatIsCompressed(texture->format) ? 2 : 1;
+		for (int tiled = 0; tiled < nu_layouts; tiled++) {
+			bool r;
+			if (tiled)
+				r = detexDecompressTextureTiled(texture, expected, pixel_format);
+			else
+				r = detexDecompressTextureLinear(texture, expected, pixel_format);
+			Check(r, "%s: Decompression failed", texture_files[i]);
+			size_t compare_size = tiled ? size : (size_t)texture->width * texture->height *
+				detexGetPixelSize(pixel_format);
+			for (int j = 0; j < sizeof(nu_threads) / sizeof(nu_threads[0]); j++)
+				for (int k = 0; k < 2; k++) {
+					detexRunTasksFunc run_tasks = k ? RunTasksReversed : NULL;
+					memset(pixel_buffer, 0xCD, size);
+					if (tiled)
+						r = detexDecompressTextureTiledMultithreaded(texture, pixel_buffer,
+							pixel_format, nu_threads[j], run_tasks, NULL);
+					else
+						r = detexDecompressTextureLinearMultithreaded(texture, pixel_buffer,
+							pixel_format, nu_threads[j], run_tasks, NULL);
+					Check(r && memcmp(pixel_buffer, expected, compare_size) == 0,
+						"%s: Multithreaded %s decompression with %d threads%s differs",
+						texture_files[i], tiled ? "tiled" : "linear", nu_threads[j],
+						k ? " and a task runner" : "");
+				}
+		}
+		free(pixel_buffer);
+		free(expected);
+		FreeTexture(texture);
+	}
+}
+
+// Decompressed regions must match the corresponding pixels of the whole decompressed
+// texture, with contiguous rows and with padding between rows that must be left
+// untouched. The texture is given a size that is not a multiple of the block size, so
+// that partial blocks are clipped at every edge.
+static void TestRegionDecompression() {
+	const int regions[][4] = {
+		{ 0, 0, 61, 47 }, { 1, 2, 5, 7 }, { 3, 3, 1, 1 }, { 4, 4, 8, 8 },
+		{ 56, 44, 5, 3 }, { 0, 46, 61, 1 }, { 13, 0, 17, 47 }
+	};
+	for (int i = 0; texture_files[i] != NULL; i++) {
+		detexTexture *file_texture = LoadTexture(texture_files[i]);
+		detexTexture texture = *file_texture;
+		texture.width = 61;
+		texture.height = 47;
+		if (detexFormatIsCompressed(texture.format)) {
+			texture.width_in_blocks = 16;
+			texture.height_in_blocks = 12;
+		}
+		else {
+			texture.width_in_blocks = texture.width;
+			texture.height_in_blocks = texture.height;
+		}
+		uint32_t pixel_format = GetTestPixelFormat(&texture);
+		int pixel_size = detexGetPixelSize(pixel_format);
+		uint8_t *expected = (uint8_t *)malloc((size_t)texture.width * texture.height * pixel_size);
+		bool r = detexDecompressTextureLinear(&texture, expected, pixel_format);
+		Check(r, "%s: Decompression failed", texture_files[i]);
+		for (int j = 0; j < sizeof(regions) / sizeof(regions[0]); j++) {
+			int x = regions[j][0];
+			int y = regions[j][1];
+			int width = regions[j][2];
+			int height = regions[j][3];
+			size_t row_size = (size_t)width * pixel_size;
+			for (int padding = 0; padding <= 12; padding += 12) {
+				size_t stride = row_size + padding;
+				size_t size = stride * height;
+				uint8_t *pixel_buffer = (uint8_t *)malloc(size);
+				memset(pixel_buffer, 0xCD, size);
+				r = detexDecompressTextureRegion(&texture, x, y, width, height, pixel_buffer,
+					padding == 0 ? 0 : stride, pixel_format);
+				bool match = r;
+				for (int k = 0; k < height && match; k++) {
+					const uint8_t *row = pixel_buffer + k * stride;
+					if (memcmp(row, expected + ((size_t)(y + k) * texture.width + x) *
+					pixel_size, row_size) != 0)
+						match = false;
+					for (int l = 0; l < padding; l++)
+						if (row[row_size + l] != 0xCD)
+							match = false;
+				}
+				Check(match, "%s: Region (%d, %d, %d, %d) with stride %d differs",
+					texture_files[i], x, y, width, height, (int)stride);
+				free(pixel_buffer);
+			}
+		}
+		uint8_t pixel_buffer[2 * 16];
+		Check(!detexDecompressTextureRegion(&texture, texture.width - 1, 0, 2, 1, pixel_buffer,
+			0, pixel_format), "%s: Region outside the texture accepted", texture_files[i]);
+		free(expected);
+		FreeTexture(file_texture);
+	}
+}
+
+// Memory-mapped files must give the same textures as the file loader.
+static void TestMappedFileLoading() {
+	for (int i = 0; loader_files[i] != NULL; i++) {
+		detexTexture **expected;
+		int nu_expected_levels;
+		if (!detexLoadTextureFileWithMipmaps(loader_files[i], 32, &expected,
+		&nu_expected_levels)) {
+			Check(false, "%s: %s", loader_files[i], detexGetErrorMessage());
+			continue;
+		}
+		detexMappedFile *file;
+		detexTexture **textures;
+		int nu_levels;
+		bool r = detexMapTextureFileWithMipmaps(loader_files[i], 32, &file, &textures, &nu_levels);
+		Check(r, "%s: Mapping failed", loader_files[i]);
+		if (r) {
+			CheckTextureLevels(loader_files[i], "detexMapTextureFileWithMipmaps", expected,
+				nu_expected_levels, textures, nu_levels);
+			detexUnmapFile(file);
+		}
+		FreeTextures(expected, nu_expected_levels);
+	}
+}
+
+static uint8_t *ReadFile(const char *filename, size_t *size_out) {
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL) {
+		printf("Fatal error: Could not open file %s\n", filename);
+		exit(1);
+	}
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *data = (uint8_t *)malloc(size);
+	if (fread(data, 1, size, f) < size) {
+		printf("Fatal error: Error reading file %s\n", filename);
+		exit(1);
+	}
+	fclose(f);
+	*size_out = size;
+	return data;
+}
+
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+	size_t position;
+} MemoryStream;
+
+static size_t ReadMemoryStream(void *user_data, void *buffer, size_t size) {
+	MemoryStream *stream = (MemoryStream *)user_data;
+	if (size > stream->size - stream->position)
+		size = stream->size - stream->position;
+	memcpy(buffer, stream->data + stream->position, size);
+	stream->position += size;
+	return size;
+}
+
+static bool SkipMemoryStream(void *user_data, size_t size) {
+	MemoryStream *stream = (MemoryStream *)user_data;
+	if (size > stream->size - stream->position)
+		return false;
+	stream->position += size;
+	return true;
+}
+
+static bool FileIsKTX(const char *filename) {
+	size_t length = strlen(filename);
+	return length > 4 && strcmp(filename + length - 4, ".ktx") == 0;
+}
+
+// The memory and callback loaders must give the same textures as the file loader. The
+// callback loaders are checked both with and without a skip callback.
+static void TestMemoryLoading() {
+	for (int i = 0; loader_files[i] != NULL; i++) {
+		detexTexture **expected;
+		int nu_expected_levels;
+		if (!detexLoadTextureFileWithMipmaps(loader_files[i], 32, &expected,
+		&nu_expected_levels)) {
+			Check(false, "%s: %s", loader_files[i], detexGetErrorMessage());
+			continue;
+		}
+		size_t size;
+		uint8_t *data = ReadFile(loader_files[i], &size);
+		bool ktx = FileIsKTX(loader_files[i]);
+		detexTexture **textures;
+		int nu_levels;
+		bool r;
+		if (ktx)
+			r = detexLoadKTXMemoryWithMipmaps(data, size, 32, &textures, &nu_levels);
+		else
+			r = detexLoadDDSMemoryWithMipmaps(data, size, 32, &textures, &nu_levels);
+		Check(r, "%s: Loading from memory failed", loader_files[i]);
+		if (r) {
+			CheckTextureLevels(loader_files[i], "the memory loader", expected,
+				nu_expected_levels, textures, nu_levels);
+			FreeTextures(textures, nu_levels);
+		}
+		for (int skip = 0; skip < 2; skip++) {
+			MemoryStream stream;
+			stream.data = data;
+			stream.size = size;
+			stream.position = 0;
+			detexReadCallbacks callbacks;
+			callbacks.read = ReadMemoryStream;
+			callbacks.skip = skip ? SkipMemoryStream : NULL;
+			callbacks.user_data = &stream;
+			if (ktx)
+				r = detexLoadKTXCallbacksWithMipmaps(&callbacks, 32, &textures, &nu_levels);
+			else
+				r = detexLoadDDSCallbacksWithMipmaps(&callbacks, 32, &textures, &nu_levels);
+			Check(r, "%s: Loading with callbacks failed", loader_files[i]);
+			if (r) {
+				CheckTextureLevels(loader_files[i], "the callback loader", expected,
+					nu_expected_levels, textures, nu_levels);
+				FreeTextures(textures, nu_levels);
+			}
+		}
+		// A truncated file must be rejected.
+		r = ktx ? detexLoadKTXMemoryWithMipmaps(data, size - 1, 32, &textures, &nu_levels) :
+			detexLoadDDSMemoryWithMipmaps(data, size - 1, 32, &textures, &nu_levels);
+		Check(!r, "%s: Truncated data accepted by the memory loader", loader_files[i]);
+		if (r)
+			FreeTextures(textures, nu_levels);
+		free(data);
+		FreeTextures(expected, nu_expected_levels);
+	}
+}
+
+// Levels loaded from a texture file index must match those of the file loader, and
+// levels outside the index must be rejected.
+static void TestIndexedLoading() {
+	for (int i = 0; loader_files[i] != NULL; i++) {
+		detexTexture **expected;
+		int nu_expected_levels;
+		if (!detexLoadTextureFileWithMipmaps(loader_files[i], 32, &expected,
+		&nu_expected_levels)) {
+			Check(false, "%s: %s", loader_files[i], detexGetErrorMessage());
+			continue;
+		}
+		detexTextureFileIndex *index;
+		bool r = detexIndexTextureFile(loader_files[i], &index);
+		Check(r, "%s: Indexing failed", loader_files[i]);
+		if (!r) {
+			FreeTextures(expected, nu_expected_levels);
+			continue;
+		}
+		Check(index->nu_levels == nu_expected_levels, "%s: Index has %d levels instead of %d",
+			loader_files[i], index->nu_levels, nu_expected_levels);
+		detexTexture **textures;
+		r = detexLoadTextureFileLevels(index, 0, index->nu_levels, &textures);
+		Check(r, "%s: Loading indexed levels failed", loader_files[i]);
+		if (r) {
+			CheckTextureLevels(loader_files[i], "detexLoadTextureFileLevels", expected,
+				nu_expected_levels, textures, index->nu_levels);
+			FreeTextures(textures, index->nu_levels);
+		}
+		// Load the levels one by one in reverse order.
+		for (int j = index->nu_levels - 1; j >= 0; j--) {
+			detexTexture *texture;
+			r = detexLoadTextureFileLevel(index, j, &texture);
+			Check(r, "%s: Loading indexed level %d failed", loader_files[i], j);
+			if (r) {
+				if (j < nu_expected_levels)
+					CheckTextureLevels(loader_files[i], "detexLoadTextureFileLevel",
+						&expected[j], 1, &texture, 1);
+				FreeTexture(texture);
+			}
+		}
+		detexTexture *texture;
+		Check(!detexLoadTextureFileLevel(index, index->nu_levels, &texture),
+			"%s: Level past the index accepted", loader_files[i]);
+		Check(!detexLoadTextureFileLevels(index, 0, index->nu_levels + 1, &textures),
+			"%s: Level range past the index accepted", loader_files[i]);
+		detexFreeTextureFileIndex(index);
+		FreeTextures(expected, nu_expected_levels);
+	}
+}
+
+static uint8_t GetSlicePattern(int layer, int face, int level, size_t i) {
+	return (uint8_t)(i * 7 + layer * 61 + face * 13 + level * 101);
+}
+
+// Write a KTX file with the format of the 2D test file template_filename and the given
+// dimensions, number of array elements (0 for a texture that is not an array), faces and
+// mip-map levels. Every slice is filled with a different pattern.
+static void WriteKTXSetFile(const char *filename, const char *template_filename, int width,
+int height, int nu_layers, int nu_faces, int nu_levels) {
+	size_t template_size;
+	uint8_t *template_data = ReadFile(template_filename, &template_size);
+	uint32_t header[16];
+	memcpy(header, template_data, 64);
+	free(template_data);
+	int pixel_size = header[5] * (header[6] == 0x1908 ? 4 : 3);	// GL_RGBA or GL_RGB.
+	header[9] = width;
+	header[10] = height;
+	header[12] = nu_layers;
+	header[13] = nu_faces;
+	header[14] = nu_levels;
+	header[15] = 0;
+	FILE *f = fopen(filename, "wb");
+	if (f == NULL) {
+		printf("Fatal error: Could not create file %s\n", filename);
+		exit(1);
+	}
+	fwrite(header, 1, 64, f);
+	int nu_file_layers = nu_layers == 0 ? 1 : nu_layers;
+	const uint8_t zero_padding[3] = { 0, 0, 0 };
+	for (int level = 0; level < nu_levels; level++) {
+		uint32_t face_size = (width >> level) * (height >> level) * pixel_size;
+		// The image size of non-array cube maps is the size of one face, which is padded.
+		uint32_t image_size = face_size * nu_file_layers * nu_faces;
+		int face_padding = 0;
+		if (nu_layers == 0 && nu_faces == 6) {
+			image_size = face_size;
+			face_padding = (4 - face_size % 4) % 4;
+		}
+		fwrite(&image_size, 1, 4, f);
+		for (int layer = 0; layer < nu_file_layers; layer++)
+			for (int face = 0; face < nu_faces; face++) {
+				for (size_t i = 0; i < face_size; i++)
+					fputc(GetSlicePattern(layer, face, level, i), f);
+				fwrite(zero_padding, 1, face_padding, f);
+			}
+		long position = ftell(f);
+		fwrite(zero_padding, 1, (4 - position % 4) % 4, f);
+	}
+	fclose(f);
+}
+
+// Texture sets must hold every array element, face and level of a file, and the first
+// array element and face must match the textures returned by the other loaders.
+static void TestTextureSetLoading() {
+	const struct {
+		const char *template_filename;
+		int width;
+		int height;
+		int nu_layers;
+		int nu_faces;
+	} set_files[] = {
+		{ "test-texture-RGBA8.ktx", 8, 4, 3, 6 },	// Cube map array.
+		{ "test-texture-RGBA8.ktx", 8, 4, 2, 1 },	// 2D array.
+		{ "test-texture-RGB8.ktx", 5, 3, 0, 6 },	// Cube map with padded faces.
+	};
+	const char *filename = "test-output-set.ktx";
+	for (int i = 0; i < sizeof(set_files) / sizeof(set_files[0]); i++) {
+		int nu_layers = set_files[i].nu_layers == 0 ? 1 : set_files[i].nu_layers;
+		int nu_faces = set_files[i].nu_faces;
+		WriteKTXSetFile(filename, set_files[i].template_filename, set_files[i].width,
+			set_files[i].height, set_files[i].nu_layers, nu_faces, 2);
+		detexTextureSet *set;
+		bool r = detexLoadTextureSetFile(filename, 32, &set);
+		Check(r, "Texture set %d: %s", i, r ? "" : detexGetErrorMessage());
+		if (!r)
+			continue;
+		bool match = set->nu_levels == 2 && set->nu_layers == nu_layers &&
+			set->nu_faces == nu_faces;
+		for (int layer = 0; layer < nu_layers && match; layer++)
+			for (int face = 0; face < nu_faces && match; face++)
+				for (int level = 0; level < 2 && match; level++) {
+					const detexTexture *slice = detexGetTextureSetSlice(set, layer, face, level);
+					if (slice->width != set_files[i].width >> level ||
+					slice->height != set_files[i].height >> level)
+						match = false;
+					size_t size = GetTextureDataSize(slice);
+					for (size_t j = 0; j < size && match; j++)
+						if (slice->data[j] != GetSlicePattern(layer, face, level, j))
+							match = false;
+				}
+		Check(match, "Texture set %d: Slices differ", i);
+		detexTexture **textures;
+		int nu_levels;
+		r = detexLoadTextureFileWithMipmaps(filename, 32, &textures, &nu_levels);
+		Check(r, "Texture set %d: %s", i, r ? "" : detexGetErrorMessage());
+		if (r) {
+			detexTexture *first_slices[2];
+			for (int level = 0; level < 2; level++)
+				first_slices[level] = detexGetTextureSetSlice(set, 0, 0, level);
+			CheckTextureLevels(filename, "the file loader", first_slices, 2, textures, nu_levels);
+			FreeTextures(textures, nu_levels);
+		}
+		detexFreeTextureSet(set);
+	}
+	remove(filename);
+}
+
+// Load the loader test files with the current allocator and compare them with the
+// expected textures. The loaded textures are not freed.
+static void LoadAndCheckTextures(const char *allocator_name, detexTexture ***expected,
+int *nu_expected_levels) {
+	for (int i = 0; loader_files[i] != NULL; i++) {
+		detexTexture **textures;
+		int nu_levels;
+		bool r = detexLoadTextureFileWithMipmaps(loader_files[i], 32, &textures, &nu_levels);
+		Check(r, "%s: Loading with %s failed", loader_files[i], allocator_name);
+		if (r)
+			CheckTextureLevels(loader_files[i], allocator_name, expected[i],
+				nu_expected_levels[i], textures, nu_levels);
+	}
+}
+
+// Textures loaded from an arena must be the same before and after resetting it. A
+// reset must release all allocations and reuse the first block of the arena.
+static void TestArenaReset() {
+	detexTexture **expected[sizeof(loader_files) / sizeof(loader_files[0])];
+	int nu_expected_levels[sizeof(loader_files) / sizeof(loader_files[0])];
+	for (int i = 0; loader_files[i] != NULL; i++)
+		if (!detexLoadTextureFileWithMipmaps(loader_files[i], 32, &expected[i],
+		&nu_expected_levels[i])) {
+			printf("Fatal error: %s\n", detexGetErrorMessage());
+			exit(1);
+		}
+	// Use a small block size so that the textures need several blocks, as well as
+	// blocks of their own for the larger textures.
+	detexArena *arena = detexCreateArena(4096);
+	Check(arena != NULL, "Creating an arena failed");
+	if (arena != NULL) {
+		detexAllocator allocator;
+		detexGetArenaAllocator(arena, &allocator);
+		detexSetAllocator(&allocator);
+		void *first_allocation = detexAllocate(16);
+		LoadAndCheckTextures("an arena", expected, nu_expected_levels);
+		size_t usage = detexGetArenaUsage(arena);
+		Check(usage > 64 * 64 * 4, "Arena usage %u too small", (unsigned int)usage);
+		for (int i = 0; i < 2; i++) {
+			detexResetArena(arena);
+			Check(detexGetArenaUsage(arena) == 0, "Arena usage not zero after a reset");
+			void *allocation = detexAllocate(16);
+			Check(allocation == first_allocation, "First block of the arena not reused");
+			LoadAndCheckTextures("an arena after a reset", expected, nu_expected_levels);
+			Check(detexGetArenaUsage(arena) == usage, "Arena usage differs after a reset");
+		}
+		detexSetAllocator(NULL);
+		detexDestroyArena(arena);
+	}
+	for (int i = 0; loader_files[i] != NULL; i++)
+		FreeTextures(expected[i], nu_expected_levels[i]);
+}
+
+// Conversion plans must give the same result as detexConvertPixels, with and without a
+// scratch buffer and in-place when supported, and must not exist for pairs that
+// detexConvertPixels does not support.
+static void TestConversionPlans() {
+	const uint32_t pairs[][2] = {
+		{ DETEX_PIXEL_FORMAT_RGBA8, DETEX_PIXEL_FORMAT_RGBA8 },
+		{ DETEX_PIXEL_FORMAT_RGBA8, DETEX_PIXEL_FORMAT_BGRA8 },
+		{ DETEX_PIXEL_FORMAT_RGBX8, DETEX_PIXEL_FORMAT_RGB8 },
+		{ DETEX_PIXEL_FORMAT_RGB8, DETEX_PIXEL_FORMAT_RGBA8 },
+		{ DETEX_PIXEL_FORMAT_RGBA8, DETEX_PIXEL_FORMAT_FLOAT_RGBX32 },
+		{ DETEX_PIXEL_FORMAT_FLOAT_RGBX16, DETEX_PIXEL_FORMAT_FLOAT_RGBX32 },
+		{ DETEX_PIXEL_FORMAT_FLOAT_RGBA16, DETEX_PIXEL_FORMAT_RGBA16 },
+		{ DETEX_PIXEL_FORMAT_R8, DETEX_PIXEL_FORMAT_RGBA8 },
+	};
+	const int nu_pixels = 1001;
+	size_t size = nu_pixels * 16;
+	uint8_t *source = (uint8_t *)malloc(size);
+	uint8_t *source_copy = (uint8_t *)malloc(size);
+	uint8_t *expected = (uint8_t *)malloc(size);
+	uint8_t *pixel_buffer = (uint8_t *)malloc(size);
+	uint32_t seed = 1;
+	for (size_t i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		source[i] = seed >> 16;
+	}
+	// Keep half-floats finite and within [0, 1] so that the results are well-defined.
+	for (size_t i = 0; i < size; i += 2)
+		*(uint16_t *)&source[i] %= 0x3C00;
+	for (int i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+		const char *source_text = detexGetTextureFormatText(pairs[i][0]);
+		const char *target_text = detexGetTextureFormatText(pairs[i][1]);
+		size_t target_size = (size_t)nu_pixels * detexGetPixelSize(pairs[i][1]);
+		memcpy(source_copy, source, size);
+		bool r = detexConvertPixels(source_copy, nu_pixels, pairs[i][0], expected, pairs[i][1]);
+		Check(r, "%s to %s: detexConvertPixels failed", source_text, target_text);
+		detexConversionPlan *plan;
+		r = detexCreateConversionPlan(pairs[i][0], pairs[i][1], &plan);
+		Check(r, "%s to %s: Creating a conversion plan failed", source_text, target_text);
+		if (!r)
+			continue;
+		size_t scratch_size = detexGetConversionPlanScratchSize(plan, nu_pixels);
+		uint8_t *scratch_buffer = (uint8_t *)malloc(scratch_size + 1);
+		for (int use_scratch = 0; use_scratch < 2; use_scratch++) {
+			memcpy(source_copy, source, size);
+			memset(pixel_buffer, 0xCD, size);
+			r = detexExecuteConversionPlan(plan, source_copy, nu_pixels, pixel_buffer,
+				use_scratch ? scratch_buffer : NULL, use_scratch ? scratch_size : 0);
+			Check(r && memcmp(pixel_buffer, expected, target_size) == 0,
+				"%s to %s: Conversion plan %s a scratch buffer differs", source_text,
+				target_text, use_scratch ? "with" : "without");
+		}
+		if (detexConversionPlanIsInPlace(plan)) {
+			memcpy(source_copy, source, size);
+			r = detexExecuteConversionPlan(plan, source_copy, nu_pixels, NULL, NULL, 0);
+			Check(r && memcmp(source_copy, expected, target_size) == 0,
+				"%s to %s: In-place conversion plan differs", source_text, target_text);
+		}
+		free(scratch_buffer);
+		detexFreeConversionPlan(plan);
+	}
+	detexConversionPlan *plan;
+	Check(!detexCreateConversionPlan(DETEX_PIXEL_FORMAT_FLOAT_RGBA16,
+		DETEX_PIXEL_FORMAT_FLOAT_RGBA32, &plan), "Conversion plan for an unsupported pair");
+	free(pixel_buffer);
+	free(expected);
+	free(source_copy);
+	free(source);
+}
+
+static bool DynamicRangesAreEqual(const detexDynamicRange *a, const detexDynamicRange *b) {
+	if (a->range_min != b->range_min || a->range_max != b->range_max ||
+	a->nu_components != b->nu_components)
+		return false;
+	for (int i = 0; i < 4; i++)
+		if (a->component_min[i] != b->component_min[i] ||
+		a->component_max[i] != b->component_max[i])
+			return false;
+	return memcmp(a->histogram, b->histogram, sizeof(a->histogram)) == 0;
+}
+
+// NaNs are detected from the bit pattern, since comparisons with NaN are not reliable
+// when compiling with -ffast-math.
+static bool IsNaN(float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, 4);
+	return (bits & 0x7FFFFFFF) > 0x7F800000;
+}
+
+// Check the dynamic range of a float or half-float buffer against the expected range
+// calculated from pixels, a float version of the buffer with nu_slots slots per pixel.
+static void CheckDynamicRange(const char *name, uint8_t *pixel_buffer, int nu_pixels,
+uint32_t pixel_format, const float *pixels, int nu_slots) {
+	int nu_components = detexGetNumberOfComponents(pixel_format);
+	detexDynamicRange expected;
+	memset(&expected, 0, sizeof(expected));
+	expected.range_min = 1.0e10f;
+	expected.range_max = - 1.0e10f;
+	expected.nu_components = nu_components;
+	for (int j = 0; j < nu_components; j++) {
+		expected.component_min[j] = 1.0e10f;
+		expected.component_max[j] = - 1.0e10f;
+	}
+	uint64_t nu_values = 0;
+	for (int i = 0; i < nu_pixels; i++)
+		for (int j = 0; j < nu_components; j++) {
+			float f = pixels[i * nu_slots + j];
+			if (IsNaN(f))
+				continue;
+			if (f < expected.component_min[j])
+				expected.component_min[j] = f;
+			if (f > expected.component_max[j])
+				expected.component_max[j] = f;
+			if (f < expected.range_min)
+				expected.range_min = f;
+			if (f > expected.range_max)
+				expected.range_max = f;
+			nu_values++;
+		}
+	float range_min, range_max;
+	bool r = detexCalculateDynamicRange(pixel_buffer, nu_pixels, pixel_format, &range_min,
+		&range_max);
+	Check(r && range_min == expected.range_min && range_max == expected.range_max,
+		"%s: Dynamic range [%f, %f] instead of [%f, %f]", name, range_min, range_max,
+		expected.range_min, expected.range_max);
+	const int nu_threads[] = { 1, 3, 0 };
+	detexDynamicRange first_range;
+	for (int k = 0; k < sizeof(nu_threads) / sizeof(nu_threads[0]); k++) {
+		detexDynamicRange range;
+		r = detexCalculateDynamicRangeStatistics(pixel_buffer, nu_pixels, pixel_format,
+			nu_threads[k], NULL, NULL, &range);
+		bool match = r && range.range_min == expected.range_min &&
+			range.range_max == expected.range_max && range.nu_components == nu_components;
+		for (int j = 0; j < nu_components; j++)
+			if (range.component_min[j] != expected.component_min[j] ||
+			range.component_max[j] != expected.component_max[j])
+				match = false;
+		uint64_t nu_histogram_values = 0;
+		for (int j = 0; j < DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE; j++)
+			nu_histogram_values += range.histogram[j];
+		if (nu_histogram_values != nu_values)
+			match = false;
+		if (k == 0)
+			first_range = range;
+		else if (!DynamicRangesAreEqual(&range, &first_range))
+			match = false;
+		Check(match, "%s: Dynamic range statistics with %d threads differ", name,
+			nu_threads[k]);
+	}
+}
+
+// The dynamic range of float and half-float buffers must leave out padding components
+// and NaNs. The number of pixels is chosen so that both the SIMD paths and the remaining
+// pixels are used.
+static void TestDynamicRange() {
+	const int nu_pixels = 1037;
+	float *pixels = (float *)malloc(nu_pixels * 4 * sizeof(float));
+	uint16_t *half_float_pixels = (uint16_t *)malloc(nu_pixels * 4 * sizeof(uint16_t));
+	const uint32_t nan_bits = 0x7FC00001;
+	for (int i = 0; i < nu_pixels; i++)
+		for (int j = 0; j < 4; j++) {
+			pixels[i * 4 + j] = (float)((i * 37 + j * 11) % 401 - 100) * 0.25f;
+			if (j == 3)
+				pixels[i * 4 + j] = i % 2 == 0 ? 1.0e30f : - 1.0e30f;
+		}
+	CheckDynamicRange("FLOAT_RGBX32", (uint8_t *)pixels, nu_pixels,
+		DETEX_PIXEL_FORMAT_FLOAT_RGBX32, pixels, 4);
+	for (int i = 0; i < nu_pixels; i += 5)
+		memcpy(&pixels[i * 4 + 1], &nan_bits, 4);
+	CheckDynamicRange("FLOAT_RGBX32 with NaNs", (uint8_t *)pixels, nu_pixels,
+		DETEX_PIXEL_FORMAT_FLOAT_RGBX32, pixels, 4);
+	CheckDynamicRange("FLOAT_RGB32 with NaNs", (uint8_t *)pixels, nu_pixels * 4 / 3,
+		DETEX_PIXEL_FORMAT_FLOAT_RGB32, pixels, 3);
+	// The values are multiples of 0.25 within [-25, 75], which are exact in half-float.
+	for (int i = 0; i < nu_pixels; i++)
+		for (int j = 0; j < 3; j++)
+			pixels[i * 4 + j] = (float)((i * 37 + j * 11) % 401 - 100) * 0.25f;
+	detexConvertPixels((uint8_t *)pixels, nu_pixels, DETEX_PIXEL_FORMAT_FLOAT_RGBX32,
+		(uint8_t *)half_float_pixels, DETEX_PIXEL_FORMAT_FLOAT_RGBX16);
+	for (int i = 0; i < nu_pixels; i++)
+		half_float_pixels[i * 4 + 3] = 0x7BFF;	// Largest finite half-float as padding.
+	CheckDynamicRange("FLOAT_RGBX16", (uint8_t *)half_float_pixels, nu_pixels,
+		DETEX_PIXEL_FORMAT_FLOAT_RGBX16, pixels, 4);
+	float range_min, range_max;
+	Check(!detexCalculateDynamicRange((uint8_t *)pixels, nu_pixels, DETEX_PIXEL_FORMAT_RGBA8,
+		&range_min, &range_max), "Dynamic range of an RGBA8 buffer accepted");
+	free(half_float_pixels);
+	free(pixels);
+}
+
+int main(int argc, char **argv) {
+	TestMultithreadedDecompression();
+	TestRegionDecompression();
+	TestMappedFileLoading();
+	TestMemoryLoading();
+	TestIndexedLoading();
+	TestTextureSetLoading();
+	TestArenaReset();
+	TestConversionPlans();
+	TestDynamicRange();
+	if (nu_failures > 0) {
+		printf("%d of %d checks failed\n", nu_failures, nu_checks);
+		exit(1);
+	}
+	printf("All %d checks passed\n", nu_checks);
+	exit(0);
+}
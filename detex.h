@@ -464,6 +464,17 @@ DETEX_API bool detexDecompressBlockBC2(const uint8_t *bitstring, uint32_t mode_m
 /* format. */
 DETEX_API bool detexDecompressBlockBC3(const uint8_t *bitstring, uint32_t mode_mask,
 	uint32_t flags, uint8_t *pixel_buffer);
+/* Decompress nu_blocks consecutive blocks compressed using the BC1, BC1A, BC2 */
+/* or BC3 format, storing the 16 pixels of each block consecutively (64 bytes */
+/* per block). SSE2 or AVX2 is used when supported by the CPU. */
+DETEX_API void detexDecompressBlocksBC1(const uint8_t *bitstring, int nu_blocks,
+	uint8_t *pixel_buffer);
+DETEX_API void detexDecompressBlocksBC1A(const uint8_t *bitstring, int nu_blocks,
+	uint8_t *pixel_buffer);
+DETEX_API void detexDecompressBlocksBC2(const uint8_t *bitstring, int nu_blocks,
+	uint8_t *pixel_buffer);
+DETEX_API void detexDecompressBlocksBC3(const uint8_t *bitstring, int nu_blocks,
+	uint8_t *pixel_buffer);
 /* Decompress a 128-bit 4x4 pixel texture block compressed using the BPTC */
 /* (BC7) format. */
 DETEX_API bool detexDecompressBlockBPTC(const uint8_t *bitstring, uint32_t mode_mask,
@@ -764,6 +775,46 @@ DETEX_API bool detexDecompressTextureTiled(const detexTexture *texture, uint8_t
 DETEX_API bool detexDecompressTextureLinear(const detexTexture *texture, uint8_t *pixel_buffer,
 	uint32_t pixel_format);
 
+/*
+ * Decode a rectangular region of a texture. Only the blocks overlapping the
+ * rectangle (x, y, width, height) are decompressed, with partial blocks at the
+ * edges clipped. Pixels are stored row-by-row in the given pixel format, with
+ * rows stride bytes apart (0 for contiguous rows). The rectangle must lie
+ * within the texture.
+ */
+DETEX_API bool detexDecompressTextureRegion(const detexTexture *texture, int x, int y,
+	int width, int height, uint8_t *pixel_buffer, size_t stride, uint32_t pixel_format);
+
+/*
+ * Thread pool hook for the multithreaded decompression functions. A task
+ * runner must call task_func(task_data, i) for every i from 0 to nu_tasks - 1,
+ * in any order and possibly in parallel, and only return when all tasks have
+ * completed. user_data is passed unchanged from the decompression function.
+ */
+typedef void (*detexTaskFunc)(void *task_data, int task_index);
+typedef void (*detexRunTasksFunc)(detexTaskFunc task_func, void *task_data, int nu_tasks,
+	void *user_data);
+
+/*
+ * Multithreaded version of detexDecompressTextureTiled. Block rows are divided
+ * over nu_threads tasks (nu_threads <= 0 selects the number of online
+ * processors). When run_tasks is NULL, a thread is created for each task.
+ * The output is identical to that of the single-threaded function.
+ */
+DETEX_API bool detexDecompressTextureTiledMultithreaded(const detexTexture *texture,
+	uint8_t *pixel_buffer, uint32_t pixel_format, int nu_threads,
+	detexRunTasksFunc run_tasks, void *run_tasks_user_data);
+
+/*
+ * Multithreaded version of detexDecompressTextureLinear. Rows are divided over
+ * nu_threads tasks (nu_threads <= 0 selects the number of online processors).
+ * When run_tasks is NULL, a thread is created for each task. The output is
+ * identical to that of the single-threaded function.
+ */
+DETEX_API bool detexDecompressTextureLinearMultithreaded(const detexTexture *texture,
+	uint8_t *pixel_buffer, uint32_t pixel_format, int nu_threads,
+	detexRunTasksFunc run_tasks, void *run_tasks_user_data);
+
 
 /*
  * Miscellaneous functions.
@@ -783,6 +834,53 @@ DETEX_API bool detexConvertPixels(uint8_t *source_pixel_buffer, uint32_t nu_pixe
 DETEX_API bool detexConvertPixelsInPlace(uint8_t * DETEX_RESTRICT source_pixel_buffer,
 	uint32_t nu_pixels, uint32_t source_pixel_format, uint32_t target_pixel_format);
 
+/* Return the size in bytes of the scratch buffer that detexConvertPixelsWithScratch requires */
+/* to convert nu_pixels pixels between the given formats (0 when no intermediate buffer is */
+/* needed). Returns true if successful. */
+DETEX_API bool detexGetConvertPixelsScratchSize(uint32_t nu_pixels, uint32_t source_pixel_format,
+	uint32_t target_pixel_format, size_t *size_out);
+
+/* Convert pixels between different formats like detexConvertPixels, storing intermediate */
+/* results in the given scratch buffer (aligned as returned by malloc) instead of allocating */
+/* memory, so that it can be used in real-time threads. Returns false if scratch_size is */
+/* smaller than the size returned by detexGetConvertPixelsScratchSize. */
+DETEX_API bool detexConvertPixelsWithScratch(uint8_t *source_pixel_buffer, uint32_t nu_pixels,
+	uint32_t source_pixel_format, uint8_t *target_pixel_buffer, uint32_t target_pixel_format,
+	uint8_t *scratch_buffer, size_t scratch_size);
+
+/*
+ * Conversion plans. A conversion plan holds the resolved conversion path between
+ * two pixel formats, including the conversion steps and the layout of the
+ * intermediate buffers, so that it can be executed many times without looking
+ * up the path again.
+ */
+typedef struct detexConversionPlan detexConversionPlan;
+
+/* Create a conversion plan. The plan is allocated, free with detexFreeConversionPlan(). */
+/* Returns true if successful. */
+DETEX_API bool detexCreateConversionPlan(uint32_t source_pixel_format, uint32_t target_pixel_format,
+	detexConversionPlan **plan_out);
+
+/* Return the size in bytes of the scratch buffer required to convert nu_pixels pixels with */
+/* a plan. */
+DETEX_API size_t detexGetConversionPlanScratchSize(const detexConversionPlan *plan, uint32_t nu_pixels);
+
+/* Return the number of conversion steps of a plan (0 when the formats are identical). */
+DETEX_API int detexGetConversionPlanNumberOfSteps(const detexConversionPlan *plan);
+
+/* Return whether a plan can be executed in-place (with a NULL target pixel buffer). */
+DETEX_API bool detexConversionPlanIsInPlace(const detexConversionPlan *plan);
+
+/* Convert nu_pixels pixels with a plan. When target_pixel_buffer is NULL, the conversion is */
+/* performed in-place. When scratch_buffer is NULL, a temporary buffer is used as with */
+/* detexConvertPixels; otherwise scratch_size must be at least the size returned by */
+/* detexGetConversionPlanScratchSize and no memory is allocated. Returns true if successful. */
+DETEX_API bool detexExecuteConversionPlan(const detexConversionPlan *plan, uint8_t *source_pixel_buffer,
+	uint32_t nu_pixels, uint8_t *target_pixel_buffer, uint8_t *scratch_buffer, size_t scratch_size);
+
+/* Free a conversion plan. */
+DETEX_API void detexFreeConversionPlan(detexConversionPlan *plan);
+
 /* Return the component bitfield masks for a pixel format (pixel size must be at most 64 bits). */
 /* Return true if succesful. */
 DETEX_API bool detexGetComponentMasks(uint32_t texture_format, uint64_t *red_mask, uint64_t *green_mask,
@@ -806,6 +904,62 @@ DETEX_API bool detexGetDX10Parameters(uint32_t texture_format, uint32_t *dx10_fo
 DETEX_API const char *detexGetErrorMessage();
 
 
+/*
+ * Memory allocation. Memory allocated by the library on behalf of the caller,
+ * such as textures returned by the loaders and texture sets, as well as the
+ * temporary buffers used by pixel format conversion and multithreaded
+ * decompression, is obtained from the allocator of the calling thread, which
+ * defaults to malloc() and free(). Memory returned to the caller must be freed
+ * with the allocator that was current when it was allocated; with the default
+ * allocator, free() can be used. Handles that own system resources (mapped
+ * files and texture file indices) and the library's internal tables are always
+ * allocated with malloc().
+ */
+typedef struct {
+	void *(*alloc)(void *user_data, size_t size);
+	void (*free)(void *user_data, void *ptr);
+	void *user_data;
+} detexAllocator;
+
+/* Set the allocator of the calling thread. The allocator is copied. When allocator is */
+/* NULL, malloc() and free() are used. */
+DETEX_API void detexSetAllocator(const detexAllocator *allocator);
+
+/* Return the allocator of the calling thread. */
+DETEX_API void detexGetAllocator(detexAllocator *allocator_out);
+
+/* Allocate memory with the allocator of the calling thread. Returns NULL on failure. */
+DETEX_API void *detexAllocate(size_t size);
+
+/* Free memory with the allocator of the calling thread. ptr may be NULL. */
+DETEX_API void detexFree(void *ptr);
+
+/*
+ * Bump arena. Allocations are carved sequentially from large blocks and
+ * individual frees are ignored, so that everything allocated from the arena,
+ * such as a batch of loaded textures, is released at once by resetting or
+ * destroying the arena. An arena is not thread-safe.
+ */
+typedef struct detexArena detexArena;
+
+/* Create an arena that allocates memory in blocks of block_size bytes (a default size */
+/* is used when block_size is 0). Larger allocations get a block of their own. Returns */
+/* NULL on failure. */
+DETEX_API detexArena *detexCreateArena(size_t block_size);
+
+/* Return an allocator that allocates from arena. Set it with detexSetAllocator(). */
+DETEX_API void detexGetArenaAllocator(detexArena *arena, detexAllocator *allocator_out);
+
+/* Release all allocations of an arena at once, keeping its first block for reuse. */
+DETEX_API void detexResetArena(detexArena *arena);
+
+/* Release all allocations of an arena and the arena itself. */
+DETEX_API void detexDestroyArena(detexArena *arena);
+
+/* Return the number of bytes allocated from an arena since it was created or reset. */
+DETEX_API size_t detexGetArenaUsage(const detexArena *arena);
+
+
 /*
  * HDR-related functions.
  */
@@ -814,25 +968,79 @@ DETEX_API const char *detexGetErrorMessage();
 DETEX_API void detexSetHDRParameters(float gamma, float range_min, float range_max);
 
 /* Calculate the dynamic range of a pixel buffer. Valid for float and half-float formats. */
-/* Returns true if successful. */
+/* Padding components are ignored. Returns true if successful. */
 DETEX_API bool detexCalculateDynamicRange(uint8_t *pixel_buffer, int nu_pixels, uint32_t pixel_format,
 	float *range_min_out, float *range_max_out);
 
+/* Number of bins of the histogram of detexDynamicRange. */
+#define DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE 32
+
+/*
+ * Dynamic range statistics of a float or half-float pixel buffer. Padding
+ * components are ignored and NaNs are left out of the ranges and the histogram.
+ * Bin i of the histogram counts the components with a magnitude in
+ * [2^(i - 16), 2^(i - 15)); the first bin also counts smaller magnitudes including
+ * zero and the last bin larger magnitudes and infinity.
+ */
+typedef struct {
+	float range_min;
+	float range_max;
+	int nu_components;
+	float component_min[4];
+	float component_max[4];
+	uint64_t histogram[DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE];
+} detexDynamicRange;
+
+/*
+ * Calculate the dynamic range, the range of each component and the histogram of a
+ * pixel buffer. The pixels are divided over nu_threads tasks (nu_threads <= 0
+ * selects the number of online processors), which are run as in the multithreaded
+ * decompression functions. The result does not depend on the number of threads.
+ * Returns true if successful.
+ */
+DETEX_API bool detexCalculateDynamicRangeStatistics(uint8_t *pixel_buffer, int nu_pixels,
+	uint32_t pixel_format, int nu_threads, detexRunTasksFunc run_tasks,
+	void *run_tasks_user_data, detexDynamicRange *range_out);
+
 
 /*
  * Texture file loading.
  */
 
+/*
+ * Read callbacks for loading texture files from a custom source, such as an
+ * archive or a network buffer. read reads up to size bytes into buffer and
+ * returns the number of bytes read, which is smaller than size only at the end
+ * of the data or on error. skip advances the read position by size bytes and
+ * returns true if successful; it may be NULL, in which case skipped data is read
+ * and discarded. user_data is passed to both callbacks.
+ */
+typedef struct {
+	size_t (*read)(void *user_data, void *buffer, size_t size);
+	bool (*skip)(void *user_data, size_t size);
+	void *user_data;
+} detexReadCallbacks;
+
 /* Load texture from KTX file with mip-maps. Returns true if successful. */
 /* nu_levels is a return parameter that returns the number of mipmap levels found. */
 /* textures_out is a return parameter for an array of detexTexture pointers that is allocated, */
-/* free with free(). textures_out[i] are allocated textures corresponding to each level, free */
-/* with free().	 */
+/* free with detexFree(). textures_out[i] are allocated textures corresponding to each level, */
+/* free with detexFree() after freeing textures_out[i]->data with detexFree(). */
 DETEX_API bool detexLoadKTXFileWithMipmaps(const char *filename, int max_mipmaps, detexTexture ***textures_out,
 	int *nu_levels_out);
 
+/* Load texture from KTX file data in memory with mip-maps. The textures are allocated */
+/* as with detexLoadKTXFileWithMipmaps and do not refer to data. */
+DETEX_API bool detexLoadKTXMemoryWithMipmaps(const uint8_t *data, size_t size, int max_mipmaps,
+	detexTexture ***textures_out, int *nu_levels_out);
+
+/* Load texture from KTX file data provided by read callbacks, with mip-maps. The */
+/* textures are allocated as with detexLoadKTXFileWithMipmaps. */
+DETEX_API bool detexLoadKTXCallbacksWithMipmaps(const detexReadCallbacks *callbacks, int max_mipmaps,
+	detexTexture ***textures_out, int *nu_levels_out);
+
 /* Load texture from KTX file (first mip-map only). Returns true if successful. */
-/* The texture is allocated, free with free(). */
+/* The texture and its data are allocated, free with detexFree(). */
 DETEX_API bool detexLoadKTXFile(const char *filename, detexTexture **texture_out);
 
 /* Save textures to KTX file (multiple mip-maps levels). Return true if succesful. */
@@ -844,13 +1052,23 @@ DETEX_API bool detexSaveKTXFile(detexTexture *texture, const char *filename);
 /* Load texture from DDS file with mip-maps. Returns true if successful. */
 /* nu_levels is a return parameter that returns the number of mipmap levels found. */
 /* textures_out is a return parameter for an array of detexTexture pointers that is allocated, */
-/* free with free(). textures_out[i] are allocated textures corresponding to each level, free */
-/* with free(). */
+/* free with detexFree(). textures_out[i] are allocated textures corresponding to each level, */
+/* free with detexFree() after freeing textures_out[i]->data with detexFree(). */
 DETEX_API bool detexLoadDDSFileWithMipmaps(const char *filename, int max_mipmaps, detexTexture ***textures_out,
 	int *nu_levels_out);
 
+/* Load texture from DDS file data in memory with mip-maps. The textures are allocated */
+/* as with detexLoadDDSFileWithMipmaps and do not refer to data. */
+DETEX_API bool detexLoadDDSMemoryWithMipmaps(const uint8_t *data, size_t size, int max_mipmaps,
+	detexTexture ***textures_out, int *nu_levels_out);
+
+/* Load texture from DDS file data provided by read callbacks, with mip-maps. The */
+/* textures are allocated as with detexLoadDDSFileWithMipmaps. */
+DETEX_API bool detexLoadDDSCallbacksWithMipmaps(const detexReadCallbacks *callbacks, int max_mipmaps,
+	detexTexture ***textures_out, int *nu_levels_out);
+
 /* Load texture from DDS file (first mip-map only). Returns true if successful. */
-/* The texture is allocated, free with free(). */
+/* The texture and its data are allocated, free with detexFree(). */
 DETEX_API bool detexLoadDDSFile(const char *filename, detexTexture **texture_out);
 
 /* Save textures to DDS file (multiple mip-maps levels). Return true if succesful. */
@@ -866,11 +1084,139 @@ DETEX_API bool detexLoadTextureFileWithMipmaps(const char *filename, int max_mip
 /* Load texture file (type autodetected from extension). */
 DETEX_API bool detexLoadTextureFile(const char *filename, detexTexture **texture_out);
 
+/*
+ * Memory-mapped texture file loading. The data pointers of the returned textures
+ * point directly into a read-only mapping of the file, so that no pixel data is
+ * copied and only the parts of the file that are used are read from disk.
+ * The textures array and the textures are owned by the mapped file.
+ */
+
+typedef struct detexMappedFile detexMappedFile;
+
+/* Map KTX file into memory with mip-maps. Returns true if successful. */
+/* file_out returns the mapped file, release it with detexUnmapFile(). */
+DETEX_API bool detexMapKTXFileWithMipmaps(const char *filename, int max_mipmaps, detexMappedFile **file_out,
+	detexTexture ***textures_out, int *nu_levels_out);
+
+/* Map DDS file into memory with mip-maps. Returns true if successful. */
+/* file_out returns the mapped file, release it with detexUnmapFile(). */
+DETEX_API bool detexMapDDSFileWithMipmaps(const char *filename, int max_mipmaps, detexMappedFile **file_out,
+	detexTexture ***textures_out, int *nu_levels_out);
+
+/* Map texture file (type autodetected from extension) into memory with mip-maps. */
+DETEX_API bool detexMapTextureFileWithMipmaps(const char *filename, int max_mipmaps, detexMappedFile **file_out,
+	detexTexture ***textures_out, int *nu_levels_out);
+
+/* Release a mapped texture file, including the textures returned for it. */
+DETEX_API void detexUnmapFile(detexMappedFile *file);
+
+/*
+ * Lazy per-level loading. Indexing a texture file reads only its header (and
+ * the level size fields of KTX files) and records the file offset, size and
+ * dimensions of each mip-map level. The pixel data of any level or range of
+ * levels can then be loaded on demand, in any order. Levels are read with
+ * pread(), so different levels may be loaded from multiple threads at once.
+ */
+
+typedef struct {
+	uint32_t format;
+	int width;
+	int height;
+	int width_in_blocks;
+	int height_in_blocks;
+	uint64_t offset;	/* Offset of the pixel data in the file. */
+	size_t size;		/* Size of the pixel data in bytes. */
+} detexTextureLevelInfo;
+
+/*
+ * The index holds nu_layers * nu_faces * nu_levels entries, with the entry for
+ * a mip-map level of an array element (layer) and cube map face at index
+ * (layer * nu_faces + face) * nu_levels + level. For regular 2D textures,
+ * nu_layers and nu_faces are 1 and levels[i] describes mip-map level i.
+ */
+typedef struct {
+	int nu_levels;
+	int nu_layers;
+	int nu_faces;
+	detexTextureLevelInfo *levels;
+	int fd;			/* File descriptor, owned by the index. */
+	uint64_t file_size;
+} detexTextureFileIndex;
+
+/* Build an index of the mip-map levels of a KTX file. Returns true if successful. */
+/* Free the index with detexFreeTextureFileIndex(). */
+DETEX_API bool detexIndexKTXFile(const char *filename, detexTextureFileIndex **index_out);
+
+/* Build an index of the mip-map levels of a DDS file. Returns true if successful. */
+/* Free the index with detexFreeTextureFileIndex(). */
+DETEX_API bool detexIndexDDSFile(const char *filename, detexTextureFileIndex **index_out);
+
+/* Build an index of a texture file (type autodetected from extension). */
+DETEX_API bool detexIndexTextureFile(const char *filename, detexTextureFileIndex **index_out);
+
+/* Load mip-map levels first_level to first_level + nu_levels - 1 of an indexed */
+/* texture file (of the first array element and face for array textures and cube */
+/* maps). textures_out is allocated as with detexLoadKTXFileWithMipmaps. */
+DETEX_API bool detexLoadTextureFileLevels(const detexTextureFileIndex *index, int first_level,
+	int nu_levels, detexTexture ***textures_out);
+
+/* Load a single mip-map level of an indexed texture file. The texture and its */
+/* data are allocated, free with detexFree(). */
+DETEX_API bool detexLoadTextureFileLevel(const detexTextureFileIndex *index, int level,
+	detexTexture **texture_out);
+
+/* Free a texture file index and close its file. */
+DETEX_API void detexFreeTextureFileIndex(detexTextureFileIndex *index);
+
+/*
+ * Cube map and array texture loading. All array elements (layers), cube map
+ * faces and mip-map levels of a texture file are loaded into a single
+ * allocation with one read, and described by a slice for each combination.
+ */
+
+typedef struct {
+	int nu_levels;
+	int nu_layers;
+	int nu_faces;
+	/* nu_layers * nu_faces * nu_levels slices, ordered as in detexTextureFileIndex. */
+	/* The data pointers of the slices point into data. */
+	detexTexture *slices;
+	uint8_t *data;
+} detexTextureSet;
+
+/* Return the slice of a texture set for an array element, cube map face and mip-map level. */
+static DETEX_INLINE_ONLY detexTexture *detexGetTextureSetSlice(const detexTextureSet *set, int layer,
+int face, int level) {
+	return &set->slices[(layer * set->nu_faces + face) * set->nu_levels + level];
+}
+
+/* Load all array elements and faces of an indexed texture file, with at most max_mipmaps */
+/* mip-map levels. Returns true if successful. Free with detexFreeTextureSet(). */
+DETEX_API bool detexLoadTextureSetFromIndex(const detexTextureFileIndex *index, int max_mipmaps,
+	detexTextureSet **set_out);
+
+/* Load all array elements and faces of a texture file (type autodetected from */
+/* extension), with at most max_mipmaps mip-map levels. Returns true if successful. */
+/* Free with detexFreeTextureSet(). */
+DETEX_API bool detexLoadTextureSetFile(const char *filename, int max_mipmaps, detexTextureSet **set_out);
+
+/* Free a texture set, including its pixel data. */
+DETEX_API void detexFreeTextureSet(detexTextureSet *set);
+
 /* Load texture from raw file (first mip-map only) given the format and dimensions */
 /* in texture. Returns true if successful. */
-/* The texture->data is allocated, free with free(). */
+/* The texture->data is allocated, free with detexFree(). */
 DETEX_API bool detexLoadRawFile(const char *filename, detexTexture *texture);
 
+/* Load texture from raw data in memory given the format and dimensions in texture. */
+/* Returns true if successful. The texture->data is allocated, free with detexFree(). */
+DETEX_API bool detexLoadRawMemory(const uint8_t *data, size_t size, detexTexture *texture);
+
+/* Load texture from raw data provided by read callbacks given the format and */
+/* dimensions in texture. Returns true if successful. The texture->data is */
+/* allocated, free with detexFree(). */
+DETEX_API bool detexLoadRawCallbacks(const detexReadCallbacks *callbacks, detexTexture *texture);
+
 /* Save texture to raw file (first mip-map only) given the format and dimensions */
 /* in texture. Returns true if successful. */
 DETEX_API bool detexSaveRawFile(detexTexture *texture, const char *filename);
@@ -19,11 +19,11 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdlib.h>
 #include <math.h>
 #include <float.h>
-#include <fenv.h>
 #include <pthread.h>
 
 #include "detex.h"
 #include "half-float.h"
+#include "simd.h"
 
 /******************************************************************************
  *
@@ -266,6 +266,120 @@ void * DETEX_RESTRICT source, int numel)
     }
 }
 
+#ifdef DETEX_SIMD_X86
+
+// Hardware half-float conversion using the F16C and AVX-512 instructions. The results
+// are identical to those of halfp2singles() and singles2halfp(): NaNs are replaced by
+// the same canonical NaN, and float to half-float conversion rounds halfway cases away
+// from zero instead of to even. Each kernel returns the number of values converted.
+
+// Bit pattern of the NaN returned by halfp2singles().
+#define DETEX_CANONICAL_NAN_BITS 0xFFC00000u
+
+static DETEX_TARGET_F16C int ConvertHalfFloatToFloatF16C(const uint16_t * DETEX_RESTRICT source_buffer,
+int n, float * DETEX_RESTRICT target_buffer) {
+	__m256 canonical_nan = _mm256_castsi256_ps(_mm256_set1_epi32(DETEX_CANONICAL_NAN_BITS));
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 v = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(source_buffer + i)));
+		__m256 nan = _mm256_cmp_ps(v, v, _CMP_UNORD_Q);
+		_mm256_storeu_ps(target_buffer + i, _mm256_blendv_ps(v, canonical_nan, nan));
+	}
+	return i;
+}
+
+static DETEX_TARGET_AVX512 int ConvertHalfFloatToFloatAVX512(const uint16_t * DETEX_RESTRICT source_buffer,
+int n, float * DETEX_RESTRICT target_buffer) {
+	__m512 canonical_nan = _mm512_castsi512_ps(_mm512_set1_epi32(DETEX_CANONICAL_NAN_BITS));
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512 v = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(source_buffer + i)));
+		__mmask16 nan = _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q);
+		_mm512_storeu_ps(target_buffer + i, _mm512_mask_mov_ps(v, nan, canonical_nan));
+	}
+	return i;
+}
+
+// For floats whose magnitude lies in the normal half-float range (after rounding) and
+// for zero, adding half a half-float unit in the last place to the bit pattern and
+// truncating gives the rounding of singles2halfp(). Other values (denormal half-float
+// results, overflow, infinity and NaN) are converted again with singles2halfp().
+
+// Smallest magnitude (bit pattern) that converts to a normal half-float.
+#define DETEX_HALF_FLOAT_MIN_NORMAL_BITS 0x38800000
+// Smallest magnitude (bit pattern) that rounds to a half-float infinity.
+#define DETEX_HALF_FLOAT_OVERFLOW_BITS 0x477FF000
+
+static DETEX_TARGET_F16C int ConvertFloatToHalfFloatF16C(float * DETEX_RESTRICT source_buffer,
+int n, uint16_t * DETEX_RESTRICT target_buffer) {
+	__m128i abs_mask = _mm_set1_epi32(0x7FFFFFFF);
+	__m128i round_bit = _mm_set1_epi32(0x1000);
+	__m128i min_normal = _mm_set1_epi32(DETEX_HALF_FLOAT_MIN_NORMAL_BITS - 1);
+	__m128i overflow = _mm_set1_epi32(DETEX_HALF_FLOAT_OVERFLOW_BITS);
+	__m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(source_buffer + i));
+		__m128i a = _mm_and_si128(x, abs_mask);
+		__m128i normal = _mm_and_si128(_mm_cmpgt_epi32(a, min_normal),
+			_mm_cmplt_epi32(a, overflow));
+		__m128i valid = _mm_or_si128(normal, _mm_cmpeq_epi32(a, zero));
+		__m128 v = _mm_castsi128_ps(_mm_add_epi32(x, round_bit));
+		_mm_storel_epi64((__m128i *)(target_buffer + i),
+			_mm_cvtps_ph(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+		unsigned int invalid = ~_mm_movemask_ps(_mm_castsi128_ps(valid)) & 0xF;
+		for (; invalid != 0; invalid &= invalid - 1) {
+			int j = i + __builtin_ctz(invalid);
+			singles2halfp(target_buffer + j, source_buffer + j, 1);
+		}
+	}
+	return i;
+}
+
+static DETEX_TARGET_AVX512 int ConvertFloatToHalfFloatAVX512(float * DETEX_RESTRICT source_buffer,
+int n, uint16_t * DETEX_RESTRICT target_buffer) {
+	__m512i abs_mask = _mm512_set1_epi32(0x7FFFFFFF);
+	__m512i round_bit = _mm512_set1_epi32(0x1000);
+	__m512i min_normal = _mm512_set1_epi32(DETEX_HALF_FLOAT_MIN_NORMAL_BITS);
+	__m512i overflow = _mm512_set1_epi32(DETEX_HALF_FLOAT_OVERFLOW_BITS);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512i x = _mm512_loadu_si512(source_buffer + i);
+		__m512i a = _mm512_and_si512(x, abs_mask);
+		__mmask16 valid = _mm512_cmpge_epi32_mask(a, min_normal) &
+			_mm512_cmplt_epi32_mask(a, overflow);
+		valid |= _mm512_cmpeq_epi32_mask(a, _mm512_setzero_si512());
+		__m512 v = _mm512_castsi512_ps(_mm512_add_epi32(x, round_bit));
+		_mm256_storeu_si256((__m256i *)(target_buffer + i),
+			_mm512_cvtps_ph(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+		for (unsigned int invalid = (uint16_t)~valid; invalid != 0; invalid &= invalid - 1) {
+			int j = i + __builtin_ctz(invalid);
+			singles2halfp(target_buffer + j, source_buffer + j, 1);
+		}
+	}
+	return i;
+}
+
+static int ConvertHalfFloatToFloatSIMD(const uint16_t * DETEX_RESTRICT source_buffer, int n,
+float * DETEX_RESTRICT target_buffer) {
+	if (detexCPUSupportsAVX512())
+		return ConvertHalfFloatToFloatAVX512(source_buffer, n, target_buffer);
+	if (detexCPUSupportsF16C())
+		return ConvertHalfFloatToFloatF16C(source_buffer, n, target_buffer);
+	return 0;
+}
+
+static int ConvertFloatToHalfFloatSIMD(float * DETEX_RESTRICT source_buffer, int n,
+uint16_t * DETEX_RESTRICT target_buffer) {
+	if (detexCPUSupportsAVX512())
+		return ConvertFloatToHalfFloatAVX512(source_buffer, n, target_buffer);
+	if (detexCPUSupportsF16C())
+		return ConvertFloatToHalfFloatF16C(source_buffer, n, target_buffer);
+	return 0;
+}
+
+#endif
+
 // Precalculated half-float table management.
 
 float *detex_half_float_table = NULL;
@@ -279,34 +393,50 @@ static void detexCalculateHalfFloatTable() {
 	free(hf_buffer);
 }
 
-static pthread_mutex_t mutex_half_float_table = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t half_float_table_once = PTHREAD_ONCE_INIT;
 
+// Calculate the table on first use. Once it has been calculated, this does not take a
+// lock, so that threads converting small buffers do not serialize on it.
 void detexValidateHalfFloatTable() {
-	pthread_mutex_lock(&mutex_half_float_table);
-	if (detex_half_float_table == NULL)
-		detexCalculateHalfFloatTable();
-	pthread_mutex_unlock(&mutex_half_float_table);
+	pthread_once(&half_float_table_once, detexCalculateHalfFloatTable);
 }
 
 // Conversion functions.
 
 void detexConvertHalfFloatToFloat(uint16_t *source_buffer, int n, float *target_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int i = ConvertHalfFloatToFloatSIMD(source_buffer, n, target_buffer);
+		source_buffer += i;
+		target_buffer += i;
+		n -= i;
+		if (n == 0)
+			return;
+	}
+#endif
 	detexValidateHalfFloatTable();
 	for (int i = 0; i < n; i++)
 		target_buffer[i] = detexGetFloatFromHalfFloat(source_buffer[i]);
 }
  
 void detexConvertFloatToHalfFloat(float *source_buffer, int n, uint16_t *target_buffer) {
+#ifdef DETEX_SIMD_X86
+	{
+		int i = ConvertFloatToHalfFloatSIMD(source_buffer, n, target_buffer);
+		source_buffer += i;
+		target_buffer += i;
+		n -= i;
+	}
+#endif
 	singles2halfp(target_buffer, source_buffer, n);
 }
 
 // Convert normalized half floats to unsigned 16-bit integers in place.
 void detexConvertNormalizedHalfFloatToUInt16(uint16_t *buffer, int n) {
 	detexValidateHalfFloatTable();
-	fesetround(FE_DOWNWARD);
 	for (int i = 0; i < n; i++) {
 		float f = detexGetFloatFromHalfFloat(buffer[i]);
-		int u = lrintf(detexClamp0To1(f) * 65535.0f + 0.5f);
+		int u = (int)lrint(detexClamp0To1(f) * 65535.0);
 		buffer[i] = (uint16_t)u;
 	}
 }
@@ -314,9 +444,8 @@ void detexConvertNormalizedHalfFloatToUInt16(uint16_t *buffer, int n) {
 // Convert normalized floats to unsigned 16-bit integers.
 void detexConvertNormalizedFloatToUInt16(float * DETEX_RESTRICT source_buffer, int n,
 uint16_t * DETEX_RESTRICT target_buffer) {
-	fesetround(FE_DOWNWARD);
 	for (int i = 0; i < n; i++) {
-		int u = lrintf(detexClamp0To1(source_buffer[i]) * 65535.0f + 0.5f);
+		int u = (int)lrint(detexClamp0To1(source_buffer[i]) * 65535.0);
 		target_buffer[i] = (uint16_t)u;
 	}
 }
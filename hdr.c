@@ -20,36 +20,68 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <string.h>
 #include <math.h>
 #include <float.h>
-#include <fenv.h>
+#include <pthread.h>
 
 #include "detex.h"
 #include "half-float.h"
 #include "hdr.h"
 #include "misc.h"
+#include "simd.h"
 
 // Gamma/HDR parameters.
 
 __thread float detex_gamma = 1.0f;
 __thread float detex_gamma_range_min = 0.0f;
 __thread float detex_gamma_range_max = 1.0f;
-__thread float *detex_gamma_corrected_half_float_table = NULL;
-__thread float detex_corrected_half_float_table_gamma;
 
-void detexSetHDRParameters(float gamma, float range_min, float range_max) {
-	detex_gamma = gamma;
-	detex_gamma_range_min = range_min;
-	detex_gamma_range_max = range_max;
-	detex_gamma_corrected_half_float_table = NULL;
+// Gamma-corrected half-float tables are shared by all threads. Each table is kept in a
+// process-wide list with a reference count, and every thread holds a reference to the
+// table for its current gamma value, so that threads using the same gamma value only
+// calculate the table once. A table is freed when the last thread that uses it switches
+// to another gamma value or exits.
+
+typedef struct GammaTable {
+	float gamma;
+	int ref_count;
+	float *table;
+	struct GammaTable *next;
+} GammaTable;
+
+static GammaTable *gamma_table_list = NULL;
+static pthread_mutex_t mutex_gamma_table_list = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t gamma_table_key;
+static pthread_once_t gamma_table_key_once = PTHREAD_ONCE_INIT;
+
+// Table referenced by the current thread.
+static __thread GammaTable *detex_gamma_table = NULL;
+
+static void ReleaseGammaTable(GammaTable *gamma_table) {
+	pthread_mutex_lock(&mutex_gamma_table_list);
+	gamma_table->ref_count--;
+	if (gamma_table->ref_count == 0) {
+		GammaTable **link = &gamma_table_list;
+		while (*link != gamma_table)
+			link = &(*link)->next;
+		*link = gamma_table->next;
+		free(gamma_table->table);
+		free(gamma_table);
+	}
+	pthread_mutex_unlock(&mutex_gamma_table_list);
 }
 
-// Update gamma-corrected half-float table when required.
-static void ValidateGammaCorrectedHalfFloatTable(float gamma) {
-	if (detex_gamma_corrected_half_float_table != NULL &&
-	detex_corrected_half_float_table_gamma == gamma)
-		return;
-	if (detex_gamma_corrected_half_float_table == NULL)
-		detex_gamma_corrected_half_float_table = malloc(65536 * sizeof(float));
-	float *float_table = detex_gamma_corrected_half_float_table;
+// Called at thread exit for threads that hold a reference.
+static void ReleaseThreadGammaTable(void *gamma_table) {
+	ReleaseGammaTable((GammaTable *)gamma_table);
+}
+
+static void CreateGammaTableKey() {
+	pthread_key_create(&gamma_table_key, ReleaseThreadGammaTable);
+}
+
+static float *CalculateGammaCorrectedHalfFloatTable(float gamma) {
+	float *float_table = malloc(65536 * sizeof(float));
+	if (float_table == NULL)
+		return NULL;
 	detexValidateHalfFloatTable();
 	memcpy(float_table, detex_half_float_table, 65536 * sizeof(float));
 	for (int i = 0; i <= 0xFFFF; i++)
@@ -57,109 +89,683 @@ static void ValidateGammaCorrectedHalfFloatTable(float gamma) {
 			float_table[i] = powf(float_table[i], 1.0f / gamma);
 		else
 			float_table[i] = - powf(- float_table[i], 1.0f / gamma);
+	return float_table;
 }
 
-static DETEX_INLINE_ONLY void CalculateRangeFloat(float *buffer, int n,
-float *range_min_out, float *range_max_out) {
-	float range_min = FLT_MAX;
-	float range_max = - FLT_MAX;
-	for (int i = 0; i < n; i++) {
-		float f = buffer[i];
-		if (f < range_min)
-			range_min = f;
-		if (f > range_max)
-			range_max = f;
+// Look up the table for a gamma value in the shared list, calculating it if it is not
+// present, and take a reference to it. The list lock is held while calculating, so that
+// threads that need the same table at the same time wait for it instead of calculating
+// it as well.
+static GammaTable *AcquireGammaTable(float gamma) {
+	pthread_mutex_lock(&mutex_gamma_table_list);
+	GammaTable *gamma_table = gamma_table_list;
+	while (gamma_table != NULL && gamma_table->gamma != gamma)
+		gamma_table = gamma_table->next;
+	if (gamma_table == NULL) {
+		gamma_table = malloc(sizeof(GammaTable));
+		float *float_table = CalculateGammaCorrectedHalfFloatTable(gamma);
+		if (gamma_table == NULL || float_table == NULL) {
+			free(gamma_table);
+			free(float_table);
+			pthread_mutex_unlock(&mutex_gamma_table_list);
+			return NULL;
+		}
+		gamma_table->gamma = gamma;
+		gamma_table->ref_count = 0;
+		gamma_table->table = float_table;
+		gamma_table->next = gamma_table_list;
+		gamma_table_list = gamma_table;
 	}
-	*range_min_out = range_min;
-	*range_max_out = range_max;
+	gamma_table->ref_count++;
+	pthread_mutex_unlock(&mutex_gamma_table_list);
+	return gamma_table;
 }
 
-static DETEX_INLINE_ONLY void CalculateRangeHalfFloat(uint16_t *buffer, int n,
-float *range_min_out, float *range_max_out) {
+// Release the reference of the current thread.
+static void ReleaseCurrentGammaTable() {
+	if (detex_gamma_table == NULL)
+		return;
+	pthread_setspecific(gamma_table_key, NULL);
+	ReleaseGammaTable(detex_gamma_table);
+	detex_gamma_table = NULL;
+}
+
+void detexSetHDRParameters(float gamma, float range_min, float range_max) {
+	detex_gamma = gamma;
+	detex_gamma_range_min = range_min;
+	detex_gamma_range_max = range_max;
+	if (detex_gamma_table != NULL && detex_gamma_table->gamma != gamma)
+		ReleaseCurrentGammaTable();
+}
+
+// Return the gamma-corrected half-float table of the current thread, updating it when
+// required. Returns NULL when memory could not be allocated.
+static const float *ValidateGammaCorrectedHalfFloatTable(float gamma) {
+	if (detex_gamma_table != NULL && detex_gamma_table->gamma == gamma)
+		return detex_gamma_table->table;
+	pthread_once(&gamma_table_key_once, CreateGammaTableKey);
+	ReleaseCurrentGammaTable();
+	detex_gamma_table = AcquireGammaTable(gamma);
+	if (detex_gamma_table == NULL)
+		return NULL;
+	pthread_setspecific(gamma_table_key, detex_gamma_table);
+	return detex_gamma_table->table;
+}
+
+// Dynamic range calculation. The components of a pixel are handled as slots, with the
+// number of slots given by the pixel size. The range is accumulated for every slot,
+// including padding slots, which are only left out of the histogram and the result.
+
+typedef struct {
+	float slot_min[4];
+	float slot_max[4];
+	uint64_t histogram[DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE];
+} RangeAccumulator;
+
+static void InitializeRangeAccumulator(RangeAccumulator *acc) {
+	for (int i = 0; i < 4; i++) {
+		acc->slot_min[i] = FLT_MAX;
+		acc->slot_max[i] = - FLT_MAX;
+	}
+	memset(acc->histogram, 0, sizeof(acc->histogram));
+}
+
+static void MergeRangeAccumulator(RangeAccumulator *acc, const RangeAccumulator *other) {
+	for (int i = 0; i < 4; i++) {
+		if (other->slot_min[i] < acc->slot_min[i])
+			acc->slot_min[i] = other->slot_min[i];
+		if (other->slot_max[i] > acc->slot_max[i])
+			acc->slot_max[i] = other->slot_max[i];
+	}
+	for (int i = 0; i < DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE; i++)
+		acc->histogram[i] += other->histogram[i];
+}
+
+// The histogram bin is derived from the exponent of the float.
+#define DETEX_HISTOGRAM_EXPONENT_BIAS (127 - 16)
+
+static DETEX_INLINE_ONLY int GetHistogramBin(float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, 4);
+	int bin = (int)((bits >> 23) & 0xFF) - DETEX_HISTOGRAM_EXPONENT_BIAS;
+	if (bin < 0)
+		return 0;
+	if (bin >= DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE)
+		return DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE - 1;
+	return bin;
+}
+
+// NaNs are left out of the range and the histogram. They are detected from the bit pattern, since
+// comparisons with NaN are not reliable when compiling with -ffast-math.
+static DETEX_INLINE_ONLY bool IsNaN(float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, 4);
+	return (bits & 0x7FFFFFFF) > 0x7F800000;
+}
+
+static DETEX_INLINE_ONLY void AccumulateComponent(float f, int slot, int nu_components,
+bool histogram, RangeAccumulator *acc) {
+	if (IsNaN(f))
+		return;
+	if (histogram && slot < nu_components)
+		acc->histogram[GetHistogramBin(f)]++;
+	if (f < acc->slot_min[slot])
+		acc->slot_min[slot] = f;
+	if (f > acc->slot_max[slot])
+		acc->slot_max[slot] = f;
+}
+
+#ifdef DETEX_SIMD_X86
+
+// SIMD kernels for the dynamic range. A group of pixels with the same number of
+// components as the vector length is loaded as nu_slots vectors, so that each lane of
+// each vector always holds the same slot. Each kernel returns the number of pixels
+// processed. NaN lanes are replaced before taking the minimum and maximum, using an
+// integer comparison since the operand order of the min/max intrinsics is not reliable
+// for NaNs when compiling with -ffast-math. The range update returns the NaN lanes as a
+// bit mask, so that they can also be left out of the histogram.
+
+// Lanes of vector v of a group that hold components rather than padding, as a bit mask.
+static uint32_t GetComponentLaneMask(int v, int nu_lanes, int nu_slots, int nu_components) {
+	uint32_t mask = 0;
+	for (int j = 0; j < nu_lanes; j++)
+		if ((v * nu_lanes + j) % nu_slots < nu_components)
+			mask |= 1 << j;
+	return mask;
+}
+
+// Fold the lanes of the range vectors into the slots of the accumulator.
+static void FoldRangeLanes(const float *lane_min, const float *lane_max, int nu_lanes,
+int nu_slots, RangeAccumulator *acc) {
+	for (int v = 0; v < nu_slots; v++)
+		for (int j = 0; j < nu_lanes; j++) {
+			int slot = (v * nu_lanes + j) % nu_slots;
+			if (lane_min[v * nu_lanes + j] < acc->slot_min[slot])
+				acc->slot_min[slot] = lane_min[v * nu_lanes + j];
+			if (lane_max[v * nu_lanes + j] > acc->slot_max[slot])
+				acc->slot_max[slot] = lane_max[v * nu_lanes + j];
+		}
+}
+
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 uint32_t UpdateRangeSSE2(__m128 f, __m128 *range_min,
+__m128 *range_max) {
+	__m128i bits = _mm_and_si128(_mm_castps_si128(f), _mm_set1_epi32(0x7FFFFFFF));
+	__m128 nan = _mm_castsi128_ps(_mm_cmpgt_epi32(bits, _mm_set1_epi32(0x7F800000)));
+	*range_min = _mm_min_ps(*range_min, _mm_or_ps(_mm_andnot_ps(nan, f),
+		_mm_and_ps(nan, _mm_set1_ps(FLT_MAX))));
+	*range_max = _mm_max_ps(*range_max, _mm_or_ps(_mm_andnot_ps(nan, f),
+		_mm_and_ps(nan, _mm_set1_ps(- FLT_MAX))));
+	return (uint32_t)_mm_movemask_ps(nan);
+}
+
+static DETEX_INLINE_ONLY DETEX_TARGET_AVX2 uint32_t UpdateRangeAVX2(__m256 f, __m256 *range_min,
+__m256 *range_max) {
+	__m256i bits = _mm256_and_si256(_mm256_castps_si256(f), _mm256_set1_epi32(0x7FFFFFFF));
+	__m256 nan = _mm256_castsi256_ps(_mm256_cmpgt_epi32(bits, _mm256_set1_epi32(0x7F800000)));
+	*range_min = _mm256_min_ps(*range_min, _mm256_blendv_ps(f, _mm256_set1_ps(FLT_MAX), nan));
+	*range_max = _mm256_max_ps(*range_max, _mm256_blendv_ps(f, _mm256_set1_ps(- FLT_MAX), nan));
+	return (uint32_t)_mm256_movemask_ps(nan);
+}
+
+// The histogram is counted separately for each lane, so that consecutive increments of
+// the same bin do not depend on each other.
+typedef uint32_t LaneHistogram[DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE];
+
+static void AddLaneHistograms(LaneHistogram *lane_histogram, int nu_lanes,
+RangeAccumulator *acc) {
+	for (int j = 0; j < nu_lanes; j++)
+		for (int i = 0; i < DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE; i++)
+			acc->histogram[i] += lane_histogram[j][i];
+}
+
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 void UpdateHistogramSSE2(__m128 f, uint32_t lane_mask,
+LaneHistogram *lane_histogram) {
+	__m128i bin = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(_mm_castps_si128(f), 23),
+		_mm_set1_epi32(0xFF)), _mm_set1_epi32(DETEX_HISTOGRAM_EXPONENT_BIAS));
+	uint32_t bins[4];
+	_mm_storeu_si128((__m128i *)bins, bin);
+	for (int j = 0; j < 4; j++)
+		if (lane_mask & (1 << j)) {
+			int b = (int)bins[j];
+			b = b < 0 ? 0 : (b >= DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE ?
+				DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE - 1 : b);
+			lane_histogram[j][b]++;
+		}
+}
+
+static DETEX_INLINE_ONLY DETEX_TARGET_AVX2 void UpdateHistogramAVX2(__m256 f, uint32_t lane_mask,
+LaneHistogram *lane_histogram) {
+	__m256i bin = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(_mm256_castps_si256(f), 23),
+		_mm256_set1_epi32(0xFF)), _mm256_set1_epi32(DETEX_HISTOGRAM_EXPONENT_BIAS));
+	bin = _mm256_max_epi32(_mm256_min_epi32(bin,
+		_mm256_set1_epi32(DETEX_DYNAMIC_RANGE_HISTOGRAM_SIZE - 1)), _mm256_setzero_si256());
+	uint32_t bins[8];
+	_mm256_storeu_si256((__m256i *)bins, bin);
+	for (int j = 0; j < 8; j++)
+		if (lane_mask & (1 << j))
+			lane_histogram[j][bins[j]]++;
+}
+
+static DETEX_TARGET_SSE2 int AccumulateRangeFloatSSE2(const float *buffer, int nu_pixels,
+int nu_slots, int nu_components, bool histogram, RangeAccumulator *acc) {
+	__m128 range_min[4], range_max[4];
+	uint32_t lane_mask[4];
+	LaneHistogram lane_histogram[4];
+	if (histogram)
+		memset(lane_histogram, 0, sizeof(lane_histogram));
+	for (int v = 0; v < nu_slots; v++) {
+		range_min[v] = _mm_set1_ps(FLT_MAX);
+		range_max[v] = _mm_set1_ps(- FLT_MAX);
+		lane_mask[v] = GetComponentLaneMask(v, 4, nu_slots, nu_components);
+	}
+	int i = 0;
+	for (; i + 4 <= nu_pixels; i += 4) {
+		const float *p = buffer + (size_t)i * nu_slots;
+		for (int v = 0; v < nu_slots; v++) {
+			__m128 f = _mm_loadu_ps(p + v * 4);
+			uint32_t nan_mask = UpdateRangeSSE2(f, &range_min[v], &range_max[v]);
+			if (histogram)
+				UpdateHistogramSSE2(f, lane_mask[v] & ~nan_mask, lane_histogram);
+		}
+	}
+	float lane_min[16], lane_max[16];
+	for (int v = 0; v < nu_slots; v++) {
+		_mm_storeu_ps(lane_min + v * 4, range_min[v]);
+		_mm_storeu_ps(lane_max + v * 4, range_max[v]);
+	}
+	FoldRangeLanes(lane_min, lane_max, 4, nu_slots, acc);
+	if (histogram)
+		AddLaneHistograms(lane_histogram, 4, acc);
+	return i;
+}
+
+static DETEX_TARGET_AVX2 int AccumulateRangeFloatAVX2(const float *buffer, int nu_pixels,
+int nu_slots, int nu_components, bool histogram, RangeAccumulator *acc) {
+	__m256 range_min[4], range_max[4];
+	uint32_t lane_mask[4];
+	LaneHistogram lane_histogram[8];
+	if (histogram)
+		memset(lane_histogram, 0, sizeof(lane_histogram));
+	for (int v = 0; v < nu_slots; v++) {
+		range_min[v] = _mm256_set1_ps(FLT_MAX);
+		range_max[v] = _mm256_set1_ps(- FLT_MAX);
+		lane_mask[v] = GetComponentLaneMask(v, 8, nu_slots, nu_components);
+	}
+	int i = 0;
+	for (; i + 8 <= nu_pixels; i += 8) {
+		const float *p = buffer + (size_t)i * nu_slots;
+		for (int v = 0; v < nu_slots; v++) {
+			__m256 f = _mm256_loadu_ps(p + v * 8);
+			uint32_t nan_mask = UpdateRangeAVX2(f, &range_min[v], &range_max[v]);
+			if (histogram)
+				UpdateHistogramAVX2(f, lane_mask[v] & ~nan_mask, lane_histogram);
+		}
+	}
+	float lane_min[32], lane_max[32];
+	for (int v = 0; v < nu_slots; v++) {
+		_mm256_storeu_ps(lane_min + v * 8, range_min[v]);
+		_mm256_storeu_ps(lane_max + v * 8, range_max[v]);
+	}
+	FoldRangeLanes(lane_min, lane_max, 8, nu_slots, acc);
+	if (histogram)
+		AddLaneHistograms(lane_histogram, 8, acc);
+	return i;
+}
+
+// Half-floats are converted with F16C, which gives the same values as the half-float
+// table apart from the bits of NaNs.
+static DETEX_TARGET_AVX2_F16C int AccumulateRangeHalfFloatF16C(const uint16_t *buffer,
+int nu_pixels, int nu_slots, int nu_components, bool histogram, RangeAccumulator *acc) {
+	__m256 range_min[4], range_max[4];
+	uint32_t lane_mask[4];
+	LaneHistogram lane_histogram[8];
+	if (histogram)
+		memset(lane_histogram, 0, sizeof(lane_histogram));
+	for (int v = 0; v < nu_slots; v++) {
+		range_min[v] = _mm256_set1_ps(FLT_MAX);
+		range_max[v] = _mm256_set1_ps(- FLT_MAX);
+		lane_mask[v] = GetComponentLaneMask(v, 8, nu_slots, nu_components);
+	}
+	int i = 0;
+	for (; i + 8 <= nu_pixels; i += 8) {
+		const uint16_t *p = buffer + (size_t)i * nu_slots;
+		for (int v = 0; v < nu_slots; v++) {
+			__m256 f = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(p + v * 8)));
+			uint32_t nan_mask = UpdateRangeAVX2(f, &range_min[v], &range_max[v]);
+			if (histogram)
+				UpdateHistogramAVX2(f, lane_mask[v] & ~nan_mask, lane_histogram);
+		}
+	}
+	float lane_min[32], lane_max[32];
+	for (int v = 0; v < nu_slots; v++) {
+		_mm256_storeu_ps(lane_min + v * 8, range_min[v]);
+		_mm256_storeu_ps(lane_max + v * 8, range_max[v]);
+	}
+	FoldRangeLanes(lane_min, lane_max, 8, nu_slots, acc);
+	if (histogram)
+		AddLaneHistograms(lane_histogram, 8, acc);
+	return i;
+}
+
+static int AccumulateRangeFloatSIMD(const float *buffer, int nu_pixels, int nu_slots,
+int nu_components, bool histogram, RangeAccumulator *acc) {
+	if (detexCPUSupportsAVX2())
+		return AccumulateRangeFloatAVX2(buffer, nu_pixels, nu_slots, nu_components, histogram,
+			acc);
+	if (detexCPUSupportsSSE2())
+		return AccumulateRangeFloatSSE2(buffer, nu_pixels, nu_slots, nu_components, histogram,
+			acc);
+	return 0;
+}
+
+static int AccumulateRangeHalfFloatSIMD(const uint16_t *buffer, int nu_pixels, int nu_slots,
+int nu_components, bool histogram, RangeAccumulator *acc) {
+	if (detexCPUSupportsAVX2() && detexCPUSupportsF16C())
+		return AccumulateRangeHalfFloatF16C(buffer, nu_pixels, nu_slots, nu_components,
+			histogram, acc);
+	return 0;
+}
+
+#endif
+
+static void AccumulateRangeFloat(const float *buffer, int nu_pixels, int nu_slots,
+int nu_components, bool histogram, RangeAccumulator *acc) {
+#ifdef DETEX_SIMD_X86
+	{
+		int i = AccumulateRangeFloatSIMD(buffer, nu_pixels, nu_slots, nu_components, histogram,
+			acc);
+		buffer += (size_t)i * nu_slots;
+		nu_pixels -= i;
+	}
+#endif
+	for (int i = 0; i < nu_pixels; i++)
+		for (int j = 0; j < nu_slots; j++)
+			AccumulateComponent(buffer[(size_t)i * nu_slots + j], j, nu_components, histogram, acc);
+}
+
+static void AccumulateRangeHalfFloat(const uint16_t *buffer, int nu_pixels, int nu_slots,
+int nu_components, bool histogram, RangeAccumulator *acc) {
+#ifdef DETEX_SIMD_X86
+	{
+		int i = AccumulateRangeHalfFloatSIMD(buffer, nu_pixels, nu_slots, nu_components,
+			histogram, acc);
+		buffer += (size_t)i * nu_slots;
+		nu_pixels -= i;
+		if (nu_pixels == 0)
+			return;
+	}
+#endif
 	detexValidateHalfFloatTable();
+	for (int i = 0; i < nu_pixels; i++)
+		for (int j = 0; j < nu_slots; j++)
+			AccumulateComponent(detexGetFloatFromHalfFloat(buffer[(size_t)i * nu_slots + j]), j,
+				nu_components, histogram, acc);
+}
+
+static bool CheckDynamicRangePixelFormat(uint32_t pixel_format, const char *func_name) {
+	if (!(pixel_format & DETEX_PIXEL_FORMAT_FLOAT_BIT)) {
+		detexSetErrorMessage("%s: Pixel buffer not in float format", func_name);
+		return false;
+	}
+	if (detexGetComponentSize(pixel_format) != 2 && detexGetComponentSize(pixel_format) != 4) {
+		detexSetErrorMessage("%s: Unable to handle pixel buffer format", func_name);
+		return false;
+	}
+	return true;
+}
+
+static void AccumulateRange(uint8_t *pixel_buffer, int nu_pixels, uint32_t pixel_format,
+bool histogram, RangeAccumulator *acc) {
+	int nu_slots = detexGetPixelSize(pixel_format) / detexGetComponentSize(pixel_format);
+	int nu_components = detexGetNumberOfComponents(pixel_format);
+	if (detexGetComponentSize(pixel_format) == 2)
+		AccumulateRangeHalfFloat((uint16_t *)pixel_buffer, nu_pixels, nu_slots, nu_components,
+			histogram, acc);
+	else
+		AccumulateRangeFloat((float *)pixel_buffer, nu_pixels, nu_slots, nu_components,
+			histogram, acc);
+}
+
+bool detexCalculateDynamicRange(uint8_t *pixel_buffer, int nu_pixels, uint32_t pixel_format,
+float *range_min_out, float *range_max_out) {
+	if (!CheckDynamicRangePixelFormat(pixel_format, "detexCalculateDynamicRange"))
+		return false;
+	RangeAccumulator acc;
+	InitializeRangeAccumulator(&acc);
+	AccumulateRange(pixel_buffer, nu_pixels, pixel_format, false, &acc);
 	float range_min = FLT_MAX;
 	float range_max = - FLT_MAX;
-	for (int i = 0; i < n; i ++) {
-		float f = detexGetFloatFromHalfFloat(buffer[i]);
-		if (f < range_min)
-			range_min = f;
-		if (f > range_max)
-			range_max = f;
+	for (int i = 0; i < detexGetNumberOfComponents(pixel_format); i++) {
+		if (acc.slot_min[i] < range_min)
+			range_min = acc.slot_min[i];
+		if (acc.slot_max[i] > range_max)
+			range_max = acc.slot_max[i];
 	}
 	*range_min_out = range_min;
 	*range_max_out = range_max;
+	return true;
 }
 
+// Multithreaded dynamic range statistics. The pixels are divided into nu_tasks
+// contiguous ranges, each of which is accumulated separately by one task.
 
-bool detexCalculateDynamicRange(uint8_t *pixel_buffer, int nu_pixels, uint32_t pixel_format,
-float *range_min_out, float *range_max_out) {
-	if (~(pixel_format & DETEX_PIXEL_FORMAT_FLOAT_BIT)) {
-		detexSetErrorMessage("detexCalculateDynamicRange: Pixel buffer not in float format");
+// Minimum number of pixels per task.
+#define DETEX_DYNAMIC_RANGE_TASK_SIZE 65536
+
+typedef struct {
+	uint8_t *pixel_buffer;
+	int nu_pixels;
+	uint32_t pixel_format;
+	int nu_tasks;
+	RangeAccumulator *task_acc;
+} detexDynamicRangeTaskInfo;
+
+static void DynamicRangeTask(void *task_data, int task_index) {
+	detexDynamicRangeTaskInfo *info = (detexDynamicRangeTaskInfo *)task_data;
+	int start = (int)((int64_t)info->nu_pixels * task_index / info->nu_tasks);
+	int end = (int)((int64_t)info->nu_pixels * (task_index + 1) / info->nu_tasks);
+	InitializeRangeAccumulator(&info->task_acc[task_index]);
+	AccumulateRange(info->pixel_buffer + (size_t)start * detexGetPixelSize(info->pixel_format),
+		end - start, info->pixel_format, true, &info->task_acc[task_index]);
+}
+
+bool detexCalculateDynamicRangeStatistics(uint8_t *pixel_buffer, int nu_pixels,
+uint32_t pixel_format, int nu_threads, detexRunTasksFunc run_tasks, void *run_tasks_user_data,
+detexDynamicRange *range_out) {
+	if (!CheckDynamicRangePixelFormat(pixel_format, "detexCalculateDynamicRangeStatistics"))
 		return false;
+	if (nu_threads <= 0)
+		nu_threads = detexGetDefaultNumberOfThreads();
+	int nu_tasks = nu_pixels / DETEX_DYNAMIC_RANGE_TASK_SIZE;
+	if (nu_tasks > nu_threads)
+		nu_tasks = nu_threads;
+	RangeAccumulator acc;
+	InitializeRangeAccumulator(&acc);
+	if (nu_tasks <= 1)
+		AccumulateRange(pixel_buffer, nu_pixels, pixel_format, true, &acc);
+	else {
+		detexDynamicRangeTaskInfo info;
+		info.pixel_buffer = pixel_buffer;
+		info.nu_pixels = nu_pixels;
+		info.pixel_format = pixel_format;
+		info.nu_tasks = nu_tasks;
+		info.task_acc = (RangeAccumulator *)detexAllocate(sizeof(RangeAccumulator) * nu_tasks);
+		if (info.task_acc == NULL) {
+			detexSetErrorMessage("detexCalculateDynamicRangeStatistics: Memory allocation failed");
+			return false;
+		}
+		if (run_tasks == NULL)
+			run_tasks = detexRunTasksPthreads;
+		run_tasks(DynamicRangeTask, &info, nu_tasks, run_tasks_user_data);
+		for (int i = 0; i < nu_tasks; i++)
+			MergeRangeAccumulator(&acc, &info.task_acc[i]);
+		detexFree(info.task_acc);
 	}
-	if (pixel_format & DETEX_PIXEL_FORMAT_16BIT_COMPONENT_BIT) {
-		CalculateRangeHalfFloat((uint16_t *)pixel_buffer,
-			nu_pixels * detexGetPixelSize(pixel_format) / 2,
-			range_min_out, range_max_out);
-		return true;
+	int nu_components = detexGetNumberOfComponents(pixel_format);
+	range_out->nu_components = nu_components;
+	range_out->range_min = FLT_MAX;
+	range_out->range_max = - FLT_MAX;
+	for (int i = 0; i < 4; i++) {
+		if (i >= nu_components) {
+			range_out->component_min[i] = 0.0f;
+			range_out->component_max[i] = 0.0f;
+			continue;
+		}
+		range_out->component_min[i] = acc.slot_min[i];
+		range_out->component_max[i] = acc.slot_max[i];
+		if (acc.slot_min[i] < range_out->range_min)
+			range_out->range_min = acc.slot_min[i];
+		if (acc.slot_max[i] > range_out->range_max)
+			range_out->range_max = acc.slot_max[i];
 	}
-	else if (pixel_format & DETEX_PIXEL_FORMAT_32BIT_COMPONENT_BIT) {
-		CalculateRangeFloat((float *)pixel_buffer,
-			nu_pixels * detexGetPixelSize(pixel_format) / 4,
-			range_min_out, range_max_out);
-		return true;
+	memcpy(range_out->histogram, acc.histogram, sizeof(acc.histogram));
+	return true;
+}
+
+// The HDR conversions map the range [range_min, range_max] to [0, 1] as
+// (f - range_min) * factor and clamp the result. Conversion to 16-bit integers
+// scales in double precision, where the product with 65535 is exact, and rounds to
+// nearest in the default rounding mode (which the library does not change).
+
+#ifdef DETEX_SIMD_X86
+
+// SIMD kernels for the HDR conversions, giving the same results as the scalar code.
+// The clamp takes the minimum with 1 before the maximum with 0, which is what the
+// compiler generates for detexClamp0To1() with the default (fast-math) flags, so that
+// NaN is clamped to 1 in both. Each kernel returns the number of values converted.
+
+static DETEX_INLINE_ONLY DETEX_TARGET_SSE2 __m128 MapRangeSSE2(__m128 f, __m128 range_min,
+__m128 factor) {
+	__m128 x = _mm_mul_ps(_mm_sub_ps(f, range_min), factor);
+	return _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(1.0f)), _mm_setzero_ps());
+}
+
+static DETEX_INLINE_ONLY DETEX_TARGET_AVX2 __m256 MapRangeAVX2(__m256 f, __m256 range_min,
+__m256 factor) {
+	__m256 x = _mm256_mul_ps(_mm256_sub_ps(f, range_min), factor);
+	return _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(1.0f)), _mm256_setzero_ps());
+}
+
+// Scale mapped values in [0, 1] by 65535 in double precision and round to nearest.
+static DETEX_INLINE_ONLY DETEX_TARGET_AVX2 __m256i ScaleToUInt16AVX2(__m256 x) {
+	__m256d scale = _mm256_set1_pd(65535.0);
+	__m128i lo = _mm256_cvtpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(x)),
+		scale));
+	__m128i hi = _mm256_cvtpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)),
+		scale));
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+// Convert mapped values in [0, 1] to 16-bit integers, packed in order.
+static DETEX_INLINE_ONLY DETEX_TARGET_AVX2 __m256i PackUInt16AVX2(__m256 x0, __m256 x1) {
+	__m256i u0 = ScaleToUInt16AVX2(x0);
+	__m256i u1 = ScaleToUInt16AVX2(x1);
+	return _mm256_permute4x64_epi64(_mm256_packus_epi32(u0, u1), 0xD8);
+}
+
+// Half-floats are looked up in a float table with gathers.
+static DETEX_TARGET_AVX2 int ConvertHDRHalfFloatToUInt16AVX2(const float *table, uint16_t *buffer,
+int n, float range_min, float factor) {
+	__m256 range_min8 = _mm256_set1_ps(range_min);
+	__m256 factor8 = _mm256_set1_ps(factor);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256i h = _mm256_loadu_si256((__m256i *)(buffer + i));
+		__m256i index0 = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(h));
+		__m256i index1 = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(h, 1));
+		__m256 x0 = MapRangeAVX2(_mm256_i32gather_ps(table, index0, 4), range_min8, factor8);
+		__m256 x1 = MapRangeAVX2(_mm256_i32gather_ps(table, index1, 4), range_min8, factor8);
+		_mm256_storeu_si256((__m256i *)(buffer + i), PackUInt16AVX2(x0, x1));
 	}
-	else {
-		detexSetErrorMessage("detexCalculateDynamicRange: Unable to handle pixel buffer format");
-		return false;
+	return i;
+}
+
+// For gamma 1, half-floats are converted with F16C instead of the table. The results
+// only differ for NaNs, which are clamped to 1 either way.
+static DETEX_TARGET_AVX2_F16C int ConvertHDRHalfFloatToUInt16F16C(uint16_t *buffer, int n,
+float range_min, float factor) {
+	__m256 range_min8 = _mm256_set1_ps(range_min);
+	__m256 factor8 = _mm256_set1_ps(factor);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256 f0 = _mm256_cvtph_ps(_mm_loadu_si128((__m128i *)(buffer + i)));
+		__m256 f1 = _mm256_cvtph_ps(_mm_loadu_si128((__m128i *)(buffer + i + 8)));
+		__m256 x0 = MapRangeAVX2(f0, range_min8, factor8);
+		__m256 x1 = MapRangeAVX2(f1, range_min8, factor8);
+		_mm256_storeu_si256((__m256i *)(buffer + i), PackUInt16AVX2(x0, x1));
 	}
+	return i;
 }
 
-// Convert half floats to unsigned 16-bit integers in place with gamma value of 1.
-static DETEX_INLINE_ONLY void detexConvertHDRHalfFloatToUInt16Gamma1(uint16_t *buffer, int n) {
+static DETEX_TARGET_SSE2 int ConvertHDRFloatToFloatSSE2(float *buffer, int n, float range_min,
+float factor) {
+	__m128 range_min4 = _mm_set1_ps(range_min);
+	__m128 factor4 = _mm_set1_ps(factor);
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(buffer + i, MapRangeSSE2(_mm_loadu_ps(buffer + i), range_min4, factor4));
+	return i;
+}
+
+static DETEX_TARGET_AVX2 int ConvertHDRFloatToFloatAVX2(float *buffer, int n, float range_min,
+float factor) {
+	__m256 range_min8 = _mm256_set1_ps(range_min);
+	__m256 factor8 = _mm256_set1_ps(factor);
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(buffer + i, MapRangeAVX2(_mm256_loadu_ps(buffer + i), range_min8,
+			factor8));
+	return i;
+}
+
+// When table is NULL, the half-floats are converted directly (gamma 1).
+static int ConvertHDRHalfFloatToUInt16SIMD(const float *table, uint16_t *buffer, int n,
+float range_min, float factor) {
+	if (!detexCPUSupportsAVX2())
+		return 0;
+	if (table != NULL)
+		return ConvertHDRHalfFloatToUInt16AVX2(table, buffer, n, range_min, factor);
+	if (detexCPUSupportsF16C())
+		return ConvertHDRHalfFloatToUInt16F16C(buffer, n, range_min, factor);
 	detexValidateHalfFloatTable();
-	float range_min = detex_gamma_range_min;
-	float range_max = detex_gamma_range_max;
-	fesetround(FE_DOWNWARD);
-	if (range_min == 0.0f && range_max == 1.0f) {
-		for (int i = 0; i < n; i++) {
-			float f = detexGetFloatFromHalfFloat(buffer[i]);
-			int u = lrintf(detexClamp0To1(f) * 65535.0f + 0.5f);
-			buffer[i] = (uint16_t)u;
-		}
-		return;
-	}
+	return ConvertHDRHalfFloatToUInt16AVX2(detex_half_float_table, buffer, n, range_min, factor);
+}
+
+static int ConvertHDRFloatToFloatSIMD(float *buffer, int n, float range_min, float factor) {
+	if (detexCPUSupportsAVX2())
+		return ConvertHDRFloatToFloatAVX2(buffer, n, range_min, factor);
+	if (detexCPUSupportsSSE2())
+		return ConvertHDRFloatToFloatSSE2(buffer, n, range_min, factor);
+	return 0;
+}
+
+#endif
+
+// Convert half floats to unsigned 16-bit integers in place, using a table that maps
+// half-floats to (gamma-corrected) floats. When table is NULL, the standard half-float
+// table is used.
+static void ConvertHDRHalfFloatToUInt16WithTable(const float *table, uint16_t *buffer, int n,
+float range_min, float range_max) {
 	float factor = 1.0f / (range_max - range_min);
+#ifdef DETEX_SIMD_X86
+	{
+		int i = ConvertHDRHalfFloatToUInt16SIMD(table, buffer, n, range_min, factor);
+		buffer += i;
+		n -= i;
+		if (n == 0)
+			return;
+	}
+#endif
+	if (table == NULL) {
+		detexValidateHalfFloatTable();
+		table = detex_half_float_table;
+	}
 	for (int i = 0; i < n; i++) {
-		float f = detexGetFloatFromHalfFloat(buffer[i]);
-		int u = lrintf(detexClamp0To1((f - range_min) * factor) * 65535.0f + 0.5f);
+		float f = table[buffer[i]];
+		int u = (int)lrint(detexClamp0To1((f - range_min) * factor) * 65535.0);
 		buffer[i] = (uint16_t)u;
 	}
 }
 
-static DETEX_INLINE_ONLY void detexConvertHDRHalfFloatToUInt16SpecialGamma(uint16_t *buffer, int n) {
-	float gamma = detex_gamma;
-	float range_min = detex_gamma_range_min;
-	float range_max = detex_gamma_range_max;
-	ValidateGammaCorrectedHalfFloatTable(gamma);
-	float *corrected_half_float_table = detex_gamma_corrected_half_float_table;
-	float corrected_range_min, corrected_range_max;
-	if (range_min >= 0.0f)
-		corrected_range_min = powf(range_min, 1.0f / gamma);
-	else
-		corrected_range_min = - powf(- range_min, 1.0f / gamma);
-	if (range_max >= 0.0f)
-		corrected_range_max = powf(range_max, 1.0f / gamma);
-	else
-		corrected_range_max = - powf(- range_max, 1.0f / gamma);
-	float factor = 1.0f / (corrected_range_max - corrected_range_min);
+// Convert floats in place.
+static void ConvertHDRFloatToFloatWithRange(float *buffer, int n, float range_min,
+float range_max) {
+	float factor = 1.0f / (range_max - range_min);
+#ifdef DETEX_SIMD_X86
+	{
+		int i = ConvertHDRFloatToFloatSIMD(buffer, n, range_min, factor);
+		buffer += i;
+		n -= i;
+	}
+#endif
 	for (int i = 0; i < n; i++) {
-		float f = corrected_half_float_table[buffer[i]];
-		int u = lrintf(detexClamp0To1((f - corrected_range_min) * factor) * 65535.0f + 0.5f);
-		buffer[i] = (uint16_t)u;
+		float f = buffer[i];
+		buffer[i] = detexClamp0To1((f - range_min) * factor);
 	}
 }
 
+static float GammaCorrect(float f, float gamma) {
+	if (f >= 0.0f)
+		return powf(f, 1.0f / gamma);
+	else
+		return - powf(- f, 1.0f / gamma);
+}
+
+// Convert half floats to unsigned 16-bit integers in place with gamma value of 1.
+static DETEX_INLINE_ONLY void detexConvertHDRHalfFloatToUInt16Gamma1(uint16_t *buffer, int n) {
+	ConvertHDRHalfFloatToUInt16WithTable(NULL, buffer, n, detex_gamma_range_min,
+		detex_gamma_range_max);
+}
+
+static DETEX_INLINE_ONLY void detexConvertHDRHalfFloatToUInt16SpecialGamma(uint16_t *buffer, int n) {
+	float gamma = detex_gamma;
+	const float *corrected_half_float_table = ValidateGammaCorrectedHalfFloatTable(gamma);
+	if (corrected_half_float_table == NULL)
+		return;
+	ConvertHDRHalfFloatToUInt16WithTable(corrected_half_float_table, buffer, n,
+		GammaCorrect(detex_gamma_range_min, gamma), GammaCorrect(detex_gamma_range_max, gamma));
+}
+
 void detexConvertHDRHalfFloatToUInt16(uint16_t *buffer, int n) {
 	if (detex_gamma == 1.0f)
 		detexConvertHDRHalfFloatToUInt16Gamma1(buffer, n);
@@ -168,41 +774,13 @@ void detexConvertHDRHalfFloatToUInt16(uint16_t *buffer, int n) {
 }
 
 static DETEX_INLINE_ONLY void detexConvertHDRFloatToFloatGamma1(float *buffer, int n) {
-	float range_min = detex_gamma_range_min;
-	float range_max = detex_gamma_range_max;
-	fesetround(FE_DOWNWARD);
-	if (range_min == 0.0f && range_max == 1.0f) {
-		for (int i = 0; i < n; i++) {
-			float f = buffer[i];
-			buffer[i] = detexClamp0To1(f);
-		}
-		return;
-	}
-	float factor = 1.0f / (range_max - range_min);
-	for (int i = 0; i < n; i++) {
-		float f = buffer[i];
-		buffer[i] = detexClamp0To1((f - range_min) * factor);
-	}
+	ConvertHDRFloatToFloatWithRange(buffer, n, detex_gamma_range_min, detex_gamma_range_max);
 }
 
 static DETEX_INLINE_ONLY void detexConvertHDRFloatToFloatSpecialGamma(float *buffer, int n) {
 	float gamma = detex_gamma;
-	float range_min = detex_gamma_range_min;
-	float range_max = detex_gamma_range_max;
-	float corrected_range_min, corrected_range_max;
-	if (range_min >= 0.0f)
-		corrected_range_min = powf(range_min, 1.0f / gamma);
-	else
-		corrected_range_min = - powf(- range_min, 1.0f / gamma);
-	if (range_max >= 0.0f)
-		corrected_range_max = powf(range_max, 1.0f / gamma);
-	else
-		corrected_range_max = - powf(- range_max, 1.0f / gamma);
-	float factor = 1.0f / (corrected_range_max - corrected_range_min);
-	for (int i = 0; i < n; i++) {
-		float f = buffer[i];
-		buffer[i] = detexClamp0To1((f - corrected_range_min) * factor);
-	}
+	ConvertHDRFloatToFloatWithRange(buffer, n, GammaCorrect(detex_gamma_range_min, gamma),
+		GammaCorrect(detex_gamma_range_max, gamma));
 }
 
 void detexConvertHDRFloatToFloat(float *buffer, int n) {
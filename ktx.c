@@ -22,57 +22,46 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "detex.h"
 #include "file-info.h"
+#include "mapped-file.h"
 #include "misc.h"
 
 static const uint8_t ktx_id[12] = {
 	0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
 };
 
-// Load texture from KTX file with mip-maps. Returns true if successful.
-// nu_mipmaps is a return parameter that returns the number of mipmap levels found.
-// textures_out is a return parameter for an array of detexTexture pointers that is allocated,
-// free with free(). textures_out[i] are allocated textures corresponding to each level, free
-// with free();
-bool detexLoadKTXFileWithMipmaps(const char *filename, int max_mipmaps, detexTexture ***textures_out,
-int *nu_levels_out) {
-	FILE *f = fopen(filename, "rb");
-	if (f == NULL) {
-		detexSetErrorMessage("detexLoadKTXFileWithMipmaps: Could not open file %s", filename);
-		return false;
-	}
-	int header[16];
-	size_t s = fread(header, 1, 64, f);
+// Load texture from KTX file data provided by read callbacks, with mip-maps. filename is
+// only used for error messages and may be NULL.
+static bool LoadKTXWithMipmaps(const detexReadCallbacks *callbacks, const char *func_name,
+const char *filename, int max_mipmaps, detexTexture ***textures_out, int *nu_levels_out) {
+	uint32_t header[16];
+	size_t s = callbacks->read(callbacks->user_data, header, 64);
 	if (s != 64) {
-		detexSetErrorMessage("detexLoadKTXFileWithMipmaps: Error reading file %s", filename);
+		detexSetReadErrorMessage(func_name, filename);
 		return false;
 	}
 	if (memcmp(header, ktx_id, 12) != 0) {
 		// KTX signature not found.
-		detexSetErrorMessage("detexLoadKTXFileWithMipmaps: Couldn't find KTX signature");
+		detexSetErrorMessage("%s: Couldn't find KTX signature", func_name);
 		return false;
 	}
 	int wrong_endian = 0;
 	if (header[3] == 0x01020304) {
 		// Wrong endian .ktx file.
 		wrong_endian = 1;
-		for (int i = 3; i < 16; i++) {
-			uint8_t *b = (uint8_t *)&header[i];
-			uint8_t temp = b[0];
-			b[0] = b[3];
-			b[3] = temp;
-			temp = b[1];
-			b[1] = b[2];
-			b[2] = temp;
-		}
+		for (int i = 3; i < 16; i++)
+			header[i] = __builtin_bswap32(header[i]);
 	}
 	int glType = header[4];
 	int glFormat = header[6];
 	int glInternalFormat = header[7];
-//	int pixel_depth = header[11];
 	const detexTextureFileInfo *info = detexLookupKTXFileInfo(glInternalFormat, glFormat, glType);
 	if (info == NULL) {
-		detexSetErrorMessage("detexLoadKTXFileWithMipmaps: Unsupported format in .ktx file "
-			"(glInternalFormat = 0x%04X)", glInternalFormat);
+		detexSetErrorMessage("%s: Unsupported format in .ktx file "
+			"(glInternalFormat = 0x%04X)", func_name, glInternalFormat);
+		return false;
+	}
+	if (header[11] > 1) {
+		detexSetErrorMessage("%s: 3D textures not supported for .ktx files", func_name);
 		return false;
 	}
 	int bytes_per_block;
@@ -83,72 +72,94 @@ int *nu_levels_out) {
 	int block_width = info->block_width;
 	int block_height = info->block_height;
 //	printf("File is %s texture.\n", info->text1);
+	if (!detexTextureDimensionsAreValid(header[9], header[10])) {
+		detexSetErrorMessage("%s: Invalid texture dimensions (%u x %u)", func_name, header[9],
+			header[10]);
+		return false;
+	}
 	int width = header[9];
 	int height = header[10];
 	int extended_width = ((width + block_width - 1) / block_width) * block_width;
 	int extended_height = ((height + block_height - 1) / block_height) * block_height;
-	int nu_file_mipmaps = header[14];
+	// A mip-map level count of zero indicates a single stored level.
+	uint32_t nu_file_mipmaps = header[14] == 0 ? 1 : header[14];
+	if (nu_file_mipmaps > 32) {
+		detexSetErrorMessage("%s: Invalid number of mip-map levels (%u)", func_name,
+			nu_file_mipmaps);
+		return false;
+	}
 //	if (nu_file_mipmaps > 1 && max_mipmaps == 1) {
 //		detexSetErrorMessage("Disregarding mipmaps beyond the first level.\n");
 //	}
 	int nu_mipmaps;
-	if (nu_file_mipmaps > max_mipmaps)
+	if ((int)nu_file_mipmaps > max_mipmaps)
 		nu_mipmaps = max_mipmaps;
 	else
 		nu_mipmaps = nu_file_mipmaps;
+	// Only the first array element and face of array textures and cube maps is loaded.
+	// The image size field of non-array cube maps holds the size of one face.
+	uint64_t nu_slices = (uint64_t)(header[12] > 0 ? header[12] : 1) * header[13];
+	bool is_non_array_cube_map = (header[12] == 0 && header[13] == 6);
+	if (header[13] != 1 && header[13] != 6) {
+		detexSetErrorMessage("%s: Invalid number of faces (%u)", func_name, header[13]);
+		return false;
+	}
  	if (header[15] > 0) {
 		// Skip metadata.
-		uint8_t *metadata = (unsigned char *)malloc(header[15]);
-		if (fread(metadata, 1, header[15], f) < header[15]) {
-			detexSetErrorMessage("detexLoadKTXFileWithMipmaps: Error reading file %s", filename);
+		if (!detexSkipData(callbacks, header[15])) {
+			detexSetReadErrorMessage(func_name, filename);
 			return false;
 		}
-		free(metadata);
 	}
-	detexTexture **textures = (detexTexture **)malloc(sizeof(detexTexture *) * nu_mipmaps);
+	detexTexture **textures = (detexTexture **)detexAllocate(sizeof(detexTexture *) * nu_mipmaps);
+	if (textures == NULL && nu_mipmaps > 0) {
+		detexSetErrorMessage("%s: Out of memory", func_name);
+		return false;
+	}
 	for (int i = 0; i < nu_mipmaps; i++) {
-		uint32_t image_size_buffer[1];
-		size_t r = fread(image_size_buffer, 1, 4, f);
+		uint32_t image_size;
+		size_t r = callbacks->read(callbacks->user_data, &image_size, 4);
 		if (r != 4) {
-			for (int j = 0; j < i; j++)
-				free(textures[j]);
-			free(textures);
-			detexSetErrorMessage("detexLoadKTXFileWithMipmaps: Error reading file %s", filename);
+			detexFreeTextures(textures, i);
+			detexSetReadErrorMessage(func_name, filename);
 			return false;
 		}
-		if (wrong_endian) {
-			uint8_t *image_size_bytep = (uint8_t *)&image_size_buffer[0];
-			unsigned char temp = image_size_buffer[0];
-			image_size_bytep[0] = image_size_bytep[3];
-			image_size_bytep[3] = temp;
-			temp = image_size_bytep[1];
-			image_size_bytep[1] = image_size_bytep[2];
-			image_size_bytep[2] = temp;
-		}
-		int image_size = image_size_buffer[0];
-		int n = (extended_height / block_height) * (extended_width / block_width);
-		if (image_size != n * bytes_per_block) {
-			for (int j = 0; j < i; j++)
-				free(textures[j]);
-			free(textures);
-			detexSetErrorMessage("detexLoadKTXFileWithMipmaps: Error loading file %s: "
-				"Image size field of mipmap level %d does not match (%d vs %d)",
-				filename, i, image_size, n * bytes_per_block);
+		if (wrong_endian)
+			image_size = __builtin_bswap32(image_size);
+		size_t size = (size_t)(extended_height / block_height) * (extended_width / block_width) *
+			bytes_per_block;
+		// The image size field is 32-bit, so a level that matches it is smaller than 4 GB.
+		uint64_t level_size = (uint64_t)size * nu_slices;
+		if (is_non_array_cube_map)
+			level_size = size;
+		if (image_size != level_size) {
+			detexFreeTextures(textures, i);
+			detexSetErrorMessage("%s: Error loading %s: Image size field of mipmap level %d "
+				"does not match (%u vs %llu)", func_name, filename != NULL ? filename : "data",
+				i, image_size, (unsigned long long)level_size);
 			return false;
 		}
 		// Allocate texture.
-		textures[i] = (detexTexture *)malloc(sizeof(detexTexture));
+		textures[i] = (detexTexture *)detexAllocate(sizeof(detexTexture));
+		if (textures[i] == NULL) {
+			detexFreeTextures(textures, i);
+			detexSetErrorMessage("%s: Out of memory", func_name);
+			return false;
+		}
 		textures[i]->format = info->texture_format;
-		textures[i]->data = (uint8_t *)malloc(n * bytes_per_block);
+		textures[i]->data = (uint8_t *)detexAllocate(size);
 		textures[i]->width = width;
 		textures[i]->height = height;
 		textures[i]->width_in_blocks = extended_width / block_width;
 		textures[i]->height_in_blocks = extended_height / block_height;
-		if (fread(textures[i]->data, 1, n * bytes_per_block, f) < n * bytes_per_block) {
-			for (int j = 0; j <= i; j++)
-				free(textures[j]);
-			free(textures);
-			detexSetErrorMessage("detexLoadKTXFileWithMipmaps: Error reading file %s", filename);
+		if (textures[i]->data == NULL && size > 0) {
+			detexFreeTextures(textures, i + 1);
+			detexSetErrorMessage("%s: Out of memory", func_name);
+			return false;
+		}
+		if (callbacks->read(callbacks->user_data, textures[i]->data, size) < size) {
+			detexFreeTextures(textures, i + 1);
+			detexSetReadErrorMessage(func_name, filename);
 			return false;
 		}
 		// Divide by two for the next mipmap level, rounding down.
@@ -156,27 +167,58 @@ int *nu_levels_out) {
 		height >>= 1;
 		extended_width = ((width + block_width - 1) / block_width) * block_width;
 		extended_height = ((height + block_height - 1) / block_height) * block_height;
-		// Read mipPadding. But not if we have already read everything specified.
-		char buffer[4];
+		// Skip the other array elements and faces and mipPadding. But not if we have already
+		// read everything specified.
 		if (i + 1 < nu_mipmaps) {
-			int nu_bytes = 3 - ((image_size + 3) % 4);
-			if (fread(buffer, 1, nu_bytes, f) != nu_bytes) {
-				for (int j = 0; j <= i; j++)
-					free(textures[j]);
-				free(textures);
-				detexSetErrorMessage("detexLoadKTXFileWithMipmaps: Error reading file %s", filename);
+			uint64_t nu_bytes;
+			if (is_non_array_cube_map)
+				nu_bytes = 6 * (((uint64_t)image_size + 3) & ~3) - image_size;
+			else
+				nu_bytes = image_size - size + 3 - ((image_size + 3) % 4);
+			if (!detexSkipData(callbacks, nu_bytes)) {
+				detexFreeTextures(textures, i + 1);
+				detexSetReadErrorMessage(func_name, filename);
 				return false;
 			}
 		}
 	}
-	fclose(f);
 	*nu_levels_out = nu_mipmaps;
 	*textures_out = textures;
 	return true;
 }
 
+// Load texture from KTX file with mip-maps. Returns true if successful.
+// nu_mipmaps is a return parameter that returns the number of mipmap levels found.
+// textures_out is a return parameter for an array of detexTexture pointers that is allocated,
+// free with detexFree(). textures_out[i] are allocated textures corresponding to each level,
+// free with detexFree() after freeing textures_out[i]->data with detexFree().
+bool detexLoadKTXFileWithMipmaps(const char *filename, int max_mipmaps, detexTexture ***textures_out,
+int *nu_levels_out) {
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL) {
+		detexSetErrorMessage("detexLoadKTXFileWithMipmaps: Could not open file %s", filename);
+		return false;
+	}
+	detexReadCallbacks callbacks;
+	callbacks.read = detexReadFromFile;
+	callbacks.skip = detexSkipInFile;
+	callbacks.user_data = f;
+	bool r = LoadKTXWithMipmaps(&callbacks, "detexLoadKTXFileWithMipmaps", filename, max_mipmaps,
+		textures_out, nu_levels_out);
+	fclose(f);
+	return r;
+}
+
+// Load texture from KTX file data provided by read callbacks, with mip-maps. Returns true
+// if successful. The textures are allocated as with detexLoadKTXFileWithMipmaps.
+bool detexLoadKTXCallbacksWithMipmaps(const detexReadCallbacks *callbacks, int max_mipmaps,
+detexTexture ***textures_out, int *nu_levels_out) {
+	return LoadKTXWithMipmaps(callbacks, "detexLoadKTXCallbacksWithMipmaps", NULL, max_mipmaps,
+		textures_out, nu_levels_out);
+}
+
 // Load texture from KTX file (first mip-map only). Returns true if successful.
-// The texture is allocated, free with free().
+// The texture and its data are allocated, free with detexFree().
 bool detexLoadKTXFile(const char *filename, detexTexture **texture_out) {
 	int nu_mipmaps;
 	detexTexture **textures;
@@ -184,7 +226,220 @@ bool detexLoadKTXFile(const char *filename, detexTexture **texture_out) {
 	if (!r)
 		return false;
 	*texture_out = textures[0];
-	free(textures);
+	detexFree(textures);
+	return true;
+}
+
+// Build an index of at most max_levels mip-map levels of every array element and cube map
+// face of a KTX file without reading the pixel data. index->levels is allocated with
+// malloc(), free with free().
+static bool IndexKTX(const detexRandomAccessReader *reader, int max_levels, const char *func_name,
+detexTextureFileIndex *index) {
+	uint32_t header[16];
+	if (!detexReadAt(reader, 0, header, 64)) {
+		detexSetErrorMessage("%s: File too small for KTX header", func_name);
+		return false;
+	}
+	if (memcmp(header, ktx_id, 12) != 0) {
+		// KTX signature not found.
+		detexSetErrorMessage("%s: Couldn't find KTX signature", func_name);
+		return false;
+	}
+	bool wrong_endian = false;
+	if (header[3] == 0x01020304) {
+		// Wrong endian .ktx file.
+		wrong_endian = true;
+		for (int i = 3; i < 16; i++)
+			header[i] = __builtin_bswap32(header[i]);
+	}
+	int glType = header[4];
+	int glFormat = header[6];
+	int glInternalFormat = header[7];
+	const detexTextureFileInfo *info = detexLookupKTXFileInfo(glInternalFormat, glFormat, glType);
+	if (info == NULL) {
+		detexSetErrorMessage("%s: Unsupported format in .ktx file (glInternalFormat = 0x%04X)",
+			func_name, glInternalFormat);
+		return false;
+	}
+	if (header[11] > 1) {
+		detexSetErrorMessage("%s: 3D textures not supported for .ktx files", func_name);
+		return false;
+	}
+	if (header[13] != 1 && header[13] != 6) {
+		detexSetErrorMessage("%s: Invalid number of faces (%u)", func_name, header[13]);
+		return false;
+	}
+	int bytes_per_block;
+	if (detexFormatIsCompressed(info->texture_format))
+		bytes_per_block = detexGetCompressedBlockSize(info->texture_format);
+	else
+		bytes_per_block = detexGetPixelSize(info->texture_format);
+	int block_width = info->block_width;
+	int block_height = info->block_height;
+	if (!detexTextureDimensionsAreValid(header[9], header[10])) {
+		detexSetErrorMessage("%s: Invalid texture dimensions (%u x %u)", func_name, header[9],
+			header[10]);
+		return false;
+	}
+	int width = header[9];
+	int height = header[10];
+	// A mip-map level count of zero indicates a single stored level.
+	uint32_t nu_file_levels = header[14] == 0 ? 1 : header[14];
+	if (nu_file_levels > 32) {
+		detexSetErrorMessage("%s: Invalid number of mip-map levels (%u)", func_name,
+			nu_file_levels);
+		return false;
+	}
+	int nu_levels = nu_file_levels;
+	if (nu_levels > max_levels)
+		nu_levels = max_levels;
+	// An array element count of zero indicates a texture that is not an array.
+	bool is_array = header[12] > 0;
+	int nu_layers = is_array ? header[12] : 1;
+	int nu_faces = header[13];
+	// The image size field of non-array cube maps holds the size of one face, which is
+	// padded to a multiple of four bytes.
+	bool is_non_array_cube_map = nu_faces == 6 && !is_array;
+	if ((uint64_t)nu_layers * nu_faces > reader->size) {
+		detexSetErrorMessage("%s: Invalid number of array elements (%u)", func_name, header[12]);
+		return false;
+	}
+	// Skip metadata.
+	uint64_t offset = 64 + (uint64_t)header[15];
+	detexTextureLevelInfo *levels = (detexTextureLevelInfo *)malloc(sizeof(detexTextureLevelInfo) *
+		nu_layers * nu_faces * nu_levels);
+	if (levels == NULL && nu_levels > 0) {
+		detexSetErrorMessage("%s: Out of memory", func_name);
+		return false;
+	}
+	for (int i = 0; i < nu_levels; i++) {
+		int extended_width = ((width + block_width - 1) / block_width) * block_width;
+		int extended_height = ((height + block_height - 1) / block_height) * block_height;
+		size_t face_size = (size_t)(extended_height / block_height) * (extended_width / block_width) *
+			bytes_per_block;
+		size_t face_stride = face_size;
+		uint64_t expected_image_size = face_size * nu_layers * nu_faces;
+		if (is_non_array_cube_map) {
+			face_stride = (face_size + 3) & ~3;
+			expected_image_size = face_size;
+		}
+		uint32_t image_size;
+		if (!detexReadAt(reader, offset, &image_size, 4)) {
+			free(levels);
+			detexSetErrorMessage("%s: Unexpected end of file", func_name);
+			return false;
+		}
+		if (wrong_endian)
+			image_size = __builtin_bswap32(image_size);
+		offset += 4;
+		if (image_size != expected_image_size) {
+			free(levels);
+			detexSetErrorMessage("%s: Image size field of mipmap level %d does not match "
+				"(%u vs %llu)", func_name, i, image_size,
+				(unsigned long long)expected_image_size);
+			return false;
+		}
+		if (face_stride > reader->size ||
+		offset + face_stride * nu_layers * nu_faces > reader->size) {
+			free(levels);
+			detexSetErrorMessage("%s: Unexpected end of file", func_name);
+			return false;
+		}
+		for (int layer = 0; layer < nu_layers; layer++)
+			for (int face = 0; face < nu_faces; face++) {
+				detexTextureLevelInfo *level = &levels[(layer * nu_faces + face) * nu_levels + i];
+				level->format = info->texture_format;
+				level->width = width;
+				level->height = height;
+				level->width_in_blocks = extended_width / block_width;
+				level->height_in_blocks = extended_height / block_height;
+				level->offset = offset;
+				level->size = face_size;
+				offset += face_stride;
+			}
+		// Skip mipPadding.
+		offset = (offset + 3) & ~(uint64_t)3;
+		// Divide by two for the next mipmap level, rounding down.
+		width >>= 1;
+		height >>= 1;
+	}
+	index->nu_levels = nu_levels;
+	index->nu_layers = nu_layers;
+	index->nu_faces = nu_faces;
+	index->levels = levels;
+	return true;
+}
+
+// Load texture from KTX file data in memory with mip-maps. Returns true if successful.
+// The textures are allocated as with detexLoadKTXFileWithMipmaps and do not refer to data.
+// The data is parsed through an index, which checks every level against the size of the
+// data before anything is allocated.
+bool detexLoadKTXMemoryWithMipmaps(const uint8_t *data, size_t size, int max_mipmaps,
+detexTexture ***textures_out, int *nu_levels_out) {
+	detexRandomAccessReader reader;
+	reader.read_at = detexReadAtMemory;
+	reader.user_data = (void *)data;
+	reader.size = size;
+	detexTextureFileIndex index;
+	if (!IndexKTX(&reader, max_mipmaps, "detexLoadKTXMemoryWithMipmaps", &index))
+		return false;
+	// Return the levels of the first array element and face.
+	bool r = detexLoadLevelsFromReader(&reader, index.levels, index.nu_levels,
+		"detexLoadKTXMemoryWithMipmaps", textures_out);
+	free(index.levels);
+	if (!r)
+		return false;
+	*nu_levels_out = index.nu_levels;
+	return true;
+}
+
+// Map a KTX file into memory and return its mip-map levels. The data pointers of the
+// textures point directly into the mapping, which must be treated as read-only.
+// textures_out is owned by the mapped file; release everything with detexUnmapFile().
+bool detexMapKTXFileWithMipmaps(const char *filename, int max_mipmaps, detexMappedFile **file_out,
+detexTexture ***textures_out, int *nu_levels_out) {
+	detexMappedFile *file;
+	if (!detexMapFile(filename, "detexMapKTXFileWithMipmaps", &file))
+		return false;
+	detexRandomAccessReader reader;
+	reader.read_at = detexReadAtMemory;
+	reader.user_data = file->data;
+	reader.size = file->size;
+	detexTextureFileIndex index;
+	if (!IndexKTX(&reader, max_mipmaps, "detexMapKTXFileWithMipmaps", &index)) {
+		detexUnmapFile(file);
+		return false;
+	}
+	// Return the levels of the first array element and face.
+	bool r = detexSetMappedFileLevels(file, index.levels, index.nu_levels,
+		"detexMapKTXFileWithMipmaps");
+	free(index.levels);
+	if (!r) {
+		detexUnmapFile(file);
+		return false;
+	}
+	*file_out = file;
+	*textures_out = file->textures;
+	*nu_levels_out = file->nu_levels;
+	return true;
+}
+
+// Build an index of the mip-map levels of a KTX file. Only the header and the image size
+// fields are read; the pixel data of any level can be loaded later with
+// detexLoadTextureFileLevels(). Free the index with detexFreeTextureFileIndex().
+bool detexIndexKTXFile(const char *filename, detexTextureFileIndex **index_out) {
+	detexTextureFileIndex *index;
+	if (!detexOpenTextureFileIndex(filename, "detexIndexKTXFile", &index))
+		return false;
+	detexRandomAccessReader reader;
+	reader.read_at = detexReadAtFileDescriptor;
+	reader.user_data = &index->fd;
+	reader.size = index->file_size;
+	if (!IndexKTX(&reader, 32, "detexIndexKTXFile", index)) {
+		detexFreeTextureFileIndex(index);
+		return false;
+	}
+	*index_out = index;
 	return true;
 }
 
@@ -307,7 +562,7 @@ bool detexSaveKTXFileWithMipmaps(detexTexture **textures, int nu_levels, const c
 				detexSetErrorMessage("detexSaveKTXFileWithMipmaps: Error writing to file %s", filename);
 				return false;
 			}
-			uint8_t *row = (uint8_t *)malloc(row_size);
+			uint8_t *row = (uint8_t *)detexAllocate(row_size);
 			for (int y = 0; y < textures[i]->height; y++) {
 				memcpy(row, &textures[i]->data[y * textures[i]->width * pixel_size],
 					textures[i]->width * pixel_size);
@@ -319,7 +574,7 @@ bool detexSaveKTXFileWithMipmaps(detexTexture **textures, int nu_levels, const c
 					return false;
 				}
 			}
-			free(row);
+			detexFree(row);
 		}
 	}
 	fclose(f);
@@ -0,0 +1,105 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "detex.h"
+#include "mapped-file.h"
+#include "misc.h"
+
+// Map a file into memory for reading. Returns a mapped file without textures.
+bool detexMapFile(const char *filename, const char *func_name, detexMappedFile **file_out) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		detexSetErrorMessage("%s: Could not open file %s", func_name, filename);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		detexSetErrorMessage("%s: Error reading file %s", func_name, filename);
+		return false;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping remains valid after the file descriptor is closed.
+	close(fd);
+	if (data == MAP_FAILED) {
+		detexSetErrorMessage("%s: Could not map file %s", func_name, filename);
+		return false;
+	}
+	detexMappedFile *file = (detexMappedFile *)malloc(sizeof(detexMappedFile));
+	if (file == NULL) {
+		munmap(data, st.st_size);
+		detexSetErrorMessage("%s: Out of memory", func_name);
+		return false;
+	}
+	file->data = (uint8_t *)data;
+	file->size = st.st_size;
+	file->textures = NULL;
+	file->nu_levels = 0;
+	*file_out = file;
+	return true;
+}
+
+// Create the textures of a mapped file from an index of its levels. Returns true if
+// successful; on failure, the file is left without textures.
+bool detexSetMappedFileLevels(detexMappedFile *file, const detexTextureLevelInfo *levels,
+int nu_levels, const char *func_name) {
+	file->textures = (detexTexture **)malloc(sizeof(detexTexture *) * nu_levels);
+	if (file->textures == NULL && nu_levels > 0) {
+		detexSetErrorMessage("%s: Out of memory", func_name);
+		return false;
+	}
+	for (int i = 0; i < nu_levels; i++) {
+		detexTexture *texture = (detexTexture *)malloc(sizeof(detexTexture));
+		if (texture == NULL) {
+			for (int j = 0; j < i; j++)
+				free(file->textures[j]);
+			free(file->textures);
+			file->textures = NULL;
+			detexSetErrorMessage("%s: Out of memory", func_name);
+			return false;
+		}
+		texture->format = levels[i].format;
+		texture->data = file->data + levels[i].offset;
+		texture->width = levels[i].width;
+		texture->height = levels[i].height;
+		texture->width_in_blocks = levels[i].width_in_blocks;
+		texture->height_in_blocks = levels[i].height_in_blocks;
+		file->textures[i] = texture;
+	}
+	file->nu_levels = nu_levels;
+	return true;
+}
+
+// Release a memory-mapped texture file, including its textures.
+void detexUnmapFile(detexMappedFile *file) {
+	if (file == NULL)
+		return;
+	if (file->textures != NULL) {
+		for (int i = 0; i < file->nu_levels; i++)
+			free(file->textures[i]);
+		free(file->textures);
+	}
+	munmap(file->data, file->size);
+	free(file);
+}
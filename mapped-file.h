@@ -0,0 +1,33 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+// Memory-mapped texture file. The textures of the file point directly into
+// the mapping.
+struct detexMappedFile {
+	uint8_t *data;
+	size_t size;
+	detexTexture **textures;
+	int nu_levels;
+};
+
+// Map a file into memory for reading. Returns a mapped file without textures.
+bool detexMapFile(const char *filename, const char *func_name, detexMappedFile **file_out);
+
+// Create the textures of a mapped file from an index of its levels. Returns true if
+// successful; on failure, the file is left without textures.
+bool detexSetMappedFileLevels(detexMappedFile *file, const detexTextureLevelInfo *levels,
+	int nu_levels, const char *func_name);
@@ -22,8 +22,13 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <string.h>
 #include <strings.h>
 #include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include "detex.h"
+#include "misc.h"
 
 // Generate bit mask from bit0 to bit1 (inclusive).
 static DETEX_INLINE_ONLY uint64_t GenerateMask(int bit0, int bit1) {
@@ -92,6 +97,84 @@ const char *detexGetErrorMessage() {
 	return detex_error_message;
 }
 
+// Texture file readers.
+
+size_t detexReadFromFile(void *user_data, void *buffer, size_t size) {
+	return fread(buffer, 1, size, (FILE *)user_data);
+}
+
+bool detexSkipInFile(void *user_data, size_t size) {
+	return fseeko((FILE *)user_data, (off_t)size, SEEK_CUR) == 0;
+}
+
+size_t detexReadFromMemory(void *user_data, void *buffer, size_t size) {
+	detexMemoryReader *reader = (detexMemoryReader *)user_data;
+	if (size > reader->size - reader->position)
+		size = reader->size - reader->position;
+	memcpy(buffer, reader->data + reader->position, size);
+	reader->position += size;
+	return size;
+}
+
+bool detexSkipInMemory(void *user_data, size_t size) {
+	detexMemoryReader *reader = (detexMemoryReader *)user_data;
+	if (size > reader->size - reader->position)
+		return false;
+	reader->position += size;
+	return true;
+}
+
+// Read size bytes at offset, checking against the size of the data. Returns true if
+// successful.
+bool detexReadAt(const detexRandomAccessReader *reader, uint64_t offset, void *buffer, size_t size) {
+	if (offset > reader->size || size > reader->size - offset)
+		return false;
+	return reader->read_at(reader->user_data, offset, buffer, size);
+}
+
+bool detexReadAtFileDescriptor(void *user_data, uint64_t offset, void *buffer, size_t size) {
+	int fd = *(int *)user_data;
+	uint8_t *bufferp = (uint8_t *)buffer;
+	while (size > 0) {
+		ssize_t r = pread(fd, bufferp, size, (off_t)offset);
+		if (r <= 0)
+			return false;
+		bufferp += r;
+		offset += r;
+		size -= r;
+	}
+	return true;
+}
+
+bool detexReadAtMemory(void *user_data, uint64_t offset, void *buffer, size_t size) {
+	memcpy(buffer, (const uint8_t *)user_data + offset, size);
+	return true;
+}
+
+// Set the error message for a read error. filename may be NULL when the data does not
+// come from a file.
+void detexSetReadErrorMessage(const char *func_name, const char *filename) {
+	if (filename != NULL)
+		detexSetErrorMessage("%s: Error reading file %s", func_name, filename);
+	else
+		detexSetErrorMessage("%s: Error reading data", func_name);
+}
+
+// Skip size bytes using the skip callback when available, otherwise by reading and
+// discarding the data. Returns true if successful.
+bool detexSkipData(const detexReadCallbacks *callbacks, size_t size) {
+	if (callbacks->skip != NULL)
+		return callbacks->skip(callbacks->user_data, size);
+	uint8_t buffer[256];
+	while (size > 0) {
+		size_t n = size < sizeof(buffer) ? size : sizeof(buffer);
+		if (callbacks->read(callbacks->user_data, buffer, n) != n)
+			return false;
+		size -= n;
+	}
+	return true;
+}
+
 // General texture file loading.
 
 // Load texture file (type autodetected from extension) with mipmaps.
@@ -116,7 +199,304 @@ bool detexLoadTextureFile(const char *filename, detexTexture **texture_out) {
 	if (!r)
 		return false;
 	*texture_out = textures[0];
-	free(textures);
+	detexFree(textures);
 	return true;
 }
 
+// Map texture file (type autodetected from extension) into memory with mipmaps.
+bool detexMapTextureFileWithMipmaps(const char *filename, int max_mipmaps, detexMappedFile **file_out,
+detexTexture ***textures_out, int *nu_levels_out) {
+	int filename_length = strlen(filename);
+	if (filename_length > 4 && strncasecmp(filename + filename_length - 4, ".ktx", 4) == 0)
+		return detexMapKTXFileWithMipmaps(filename, max_mipmaps, file_out, textures_out,
+			nu_levels_out);
+	else if (filename_length > 4 && strncasecmp(filename + filename_length - 4, ".dds", 4) == 0)
+		return detexMapDDSFileWithMipmaps(filename, max_mipmaps, file_out, textures_out,
+			nu_levels_out);
+	else {
+		detexSetErrorMessage("detexMapTextureFileWithMipmaps: Do not recognize filename extension");
+		return false;
+	}
+}
+
+// Texture file indices.
+
+// Return whether texture dimensions read from a file header are within the range that the
+// loaders support. Larger dimensions would overflow the block calculations.
+bool detexTextureDimensionsAreValid(uint32_t width, uint32_t height) {
+	return width <= (1 << 24) && height <= (1 << 24);
+}
+
+// Free the first nu_textures textures of an array of allocated textures, including their
+// data, and the array itself.
+void detexFreeTextures(detexTexture **textures, int nu_textures) {
+	for (int i = 0; i < nu_textures; i++) {
+		detexFree(textures[i]->data);
+		detexFree(textures[i]);
+	}
+	detexFree(textures);
+}
+
+// Load mip-map levels described by an index from a random access reader into allocated
+// textures. Returns true if successful.
+bool detexLoadLevelsFromReader(const detexRandomAccessReader *reader,
+const detexTextureLevelInfo *levels, int nu_levels, const char *func_name,
+detexTexture ***textures_out) {
+	detexTexture **textures = (detexTexture **)detexAllocate(sizeof(detexTexture *) * nu_levels);
+	if (textures == NULL && nu_levels > 0) {
+		detexSetErrorMessage("%s: Out of memory", func_name);
+		return false;
+	}
+	for (int i = 0; i < nu_levels; i++) {
+		detexTexture *texture = (detexTexture *)detexAllocate(sizeof(detexTexture));
+		if (texture == NULL) {
+			detexFreeTextures(textures, i);
+			detexSetErrorMessage("%s: Out of memory", func_name);
+			return false;
+		}
+		texture->format = levels[i].format;
+		texture->data = (uint8_t *)detexAllocate(levels[i].size);
+		texture->width = levels[i].width;
+		texture->height = levels[i].height;
+		texture->width_in_blocks = levels[i].width_in_blocks;
+		texture->height_in_blocks = levels[i].height_in_blocks;
+		textures[i] = texture;
+		if (texture->data == NULL && levels[i].size > 0) {
+			detexFreeTextures(textures, i + 1);
+			detexSetErrorMessage("%s: Out of memory", func_name);
+			return false;
+		}
+		if (!detexReadAt(reader, levels[i].offset, texture->data, levels[i].size)) {
+			detexFreeTextures(textures, i + 1);
+			detexSetErrorMessage("%s: Error reading mip-map level %d", func_name, i);
+			return false;
+		}
+	}
+	*textures_out = textures;
+	return true;
+}
+
+// Open a file for indexing. Returns an index without levels.
+bool detexOpenTextureFileIndex(const char *filename, const char *func_name,
+detexTextureFileIndex **index_out) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		detexSetErrorMessage("%s: Could not open file %s", func_name, filename);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		detexSetErrorMessage("%s: Error reading file %s", func_name, filename);
+		return false;
+	}
+	detexTextureFileIndex *index = (detexTextureFileIndex *)malloc(sizeof(detexTextureFileIndex));
+	if (index == NULL) {
+		close(fd);
+		detexSetErrorMessage("%s: Out of memory", func_name);
+		return false;
+	}
+	index->nu_levels = 0;
+	index->nu_layers = 1;
+	index->nu_faces = 1;
+	index->levels = NULL;
+	index->fd = fd;
+	index->file_size = st.st_size;
+	*index_out = index;
+	return true;
+}
+
+// Build an index of the mip-map levels of a texture file (type autodetected from extension).
+bool detexIndexTextureFile(const char *filename, detexTextureFileIndex **index_out) {
+	int filename_length = strlen(filename);
+	if (filename_length > 4 && strncasecmp(filename + filename_length - 4, ".ktx", 4) == 0)
+		return detexIndexKTXFile(filename, index_out);
+	else if (filename_length > 4 && strncasecmp(filename + filename_length - 4, ".dds", 4) == 0)
+		return detexIndexDDSFile(filename, index_out);
+	else {
+		detexSetErrorMessage("detexIndexTextureFile: Do not recognize filename extension");
+		return false;
+	}
+}
+
+// Load the mip-map levels first_level to first_level + nu_levels - 1 of an indexed texture
+// file. textures_out is a return parameter for an array of detexTexture pointers that is
+// allocated, free with detexFree(). textures_out[i] are allocated textures, free with
+// detexFree() after freeing textures_out[i]->data with detexFree().
+bool detexLoadTextureFileLevels(const detexTextureFileIndex *index, int first_level, int nu_levels,
+detexTexture ***textures_out) {
+	if (first_level < 0 || nu_levels <= 0 || first_level + nu_levels > index->nu_levels) {
+		detexSetErrorMessage("detexLoadTextureFileLevels: Invalid level range (%d, %d)",
+			first_level, nu_levels);
+		return false;
+	}
+	detexRandomAccessReader reader;
+	reader.read_at = detexReadAtFileDescriptor;
+	reader.user_data = (void *)&index->fd;
+	reader.size = index->file_size;
+	return detexLoadLevelsFromReader(&reader, &index->levels[first_level], nu_levels,
+		"detexLoadTextureFileLevels", textures_out);
+}
+
+// Load a single mip-map level of an indexed texture file. The texture is allocated, free
+// with detexFree() after freeing texture_out->data with detexFree().
+bool detexLoadTextureFileLevel(const detexTextureFileIndex *index, int level,
+detexTexture **texture_out) {
+	detexTexture **textures;
+	if (!detexLoadTextureFileLevels(index, level, 1, &textures))
+		return false;
+	*texture_out = textures[0];
+	detexFree(textures);
+	return true;
+}
+
+// Free a texture file index and close its file.
+void detexFreeTextureFileIndex(detexTextureFileIndex *index) {
+	if (index == NULL)
+		return;
+	close(index->fd);
+	free(index->levels);
+	free(index);
+}
+
+// Texture sets.
+
+// Load all array elements and faces of an indexed texture file, with at most max_mipmaps
+// mip-map levels. The pixel data of all slices is read into a single allocation with one
+// read. For file layouts in which the selected levels are not contiguous, the skipped
+// smaller levels in between are read as well.
+bool detexLoadTextureSetFromIndex(const detexTextureFileIndex *index, int max_mipmaps,
+detexTextureSet **set_out) {
+	int nu_levels = index->nu_levels;
+	if (nu_levels > max_mipmaps)
+		nu_levels = max_mipmaps;
+	if (nu_levels <= 0) {
+		detexSetErrorMessage("detexLoadTextureSetFromIndex: No mip-map levels selected");
+		return false;
+	}
+	int nu_slices = index->nu_layers * index->nu_faces;
+	// Determine the range of the file that holds the selected levels.
+	uint64_t start = UINT64_MAX;
+	uint64_t end = 0;
+	for (int i = 0; i < nu_slices; i++)
+		for (int j = 0; j < nu_levels; j++) {
+			const detexTextureLevelInfo *level = &index->levels[i * index->nu_levels + j];
+			if (level->offset < start)
+				start = level->offset;
+			if (level->offset + level->size > end)
+				end = level->offset + level->size;
+		}
+	uint8_t *data = (uint8_t *)detexAllocate(end - start);
+	if (data == NULL) {
+		detexSetErrorMessage("detexLoadTextureSetFromIndex: Could not allocate %llu bytes",
+			(unsigned long long)(end - start));
+		return false;
+	}
+	if (!detexReadAtFileDescriptor((void *)&index->fd, start, data, end - start)) {
+		detexFree(data);
+		detexSetErrorMessage("detexLoadTextureSetFromIndex: Error reading file");
+		return false;
+	}
+	detexTextureSet *set = (detexTextureSet *)detexAllocate(sizeof(detexTextureSet));
+	detexTexture *slices = (detexTexture *)detexAllocate(sizeof(detexTexture) * nu_slices *
+		nu_levels);
+	if (set == NULL || slices == NULL) {
+		detexFree(slices);
+		detexFree(set);
+		detexFree(data);
+		detexSetErrorMessage("detexLoadTextureSetFromIndex: Out of memory");
+		return false;
+	}
+	set->nu_levels = nu_levels;
+	set->nu_layers = index->nu_layers;
+	set->nu_faces = index->nu_faces;
+	set->slices = slices;
+	set->data = data;
+	for (int i = 0; i < nu_slices; i++)
+		for (int j = 0; j < nu_levels; j++) {
+			const detexTextureLevelInfo *level = &index->levels[i * index->nu_levels + j];
+			detexTexture *slice = &set->slices[i * nu_levels + j];
+			slice->format = level->format;
+			slice->data = data + (level->offset - start);
+			slice->width = level->width;
+			slice->height = level->height;
+			slice->width_in_blocks = level->width_in_blocks;
+			slice->height_in_blocks = level->height_in_blocks;
+		}
+	*set_out = set;
+	return true;
+}
+
+// Load all array elements and faces of a texture file (type autodetected from extension),
+// with at most max_mipmaps mip-map levels.
+bool detexLoadTextureSetFile(const char *filename, int max_mipmaps, detexTextureSet **set_out) {
+	detexTextureFileIndex *index;
+	if (!detexIndexTextureFile(filename, &index))
+		return false;
+	bool r = detexLoadTextureSetFromIndex(index, max_mipmaps, set_out);
+	detexFreeTextureFileIndex(index);
+	return r;
+}
+
+// Free a texture set, including its pixel data.
+void detexFreeTextureSet(detexTextureSet *set) {
+	if (set == NULL)
+		return;
+	detexFree(set->data);
+	detexFree(set->slices);
+	detexFree(set);
+}
+
+// Multithreading.
+
+typedef struct {
+	detexTaskFunc task_func;
+	void *task_data;
+	int task_index;
+} detexThreadInfo;
+
+static void *ThreadStart(void *thread_data) {
+	detexThreadInfo *info = (detexThreadInfo *)thread_data;
+	info->task_func(info->task_data, info->task_index);
+	return NULL;
+}
+
+// Default task runner. Spawns a thread for every task but the first, which is run
+// in the calling thread. When a thread cannot be created, its task is run in the
+// calling thread instead, and when the thread bookkeeping cannot be allocated, all
+// tasks are.
+void detexRunTasksPthreads(detexTaskFunc task_func, void *task_data, int nu_tasks,
+void *user_data) {
+	pthread_t *threads = (pthread_t *)detexAllocate(sizeof(pthread_t) * nu_tasks);
+	detexThreadInfo *thread_info = (detexThreadInfo *)detexAllocate(sizeof(detexThreadInfo) * nu_tasks);
+	bool *thread_created = (bool *)detexAllocate(sizeof(bool) * nu_tasks);
+	if (threads == NULL || thread_info == NULL || thread_created == NULL) {
+		detexFree(thread_created);
+		detexFree(thread_info);
+		detexFree(threads);
+		for (int i = 0; i < nu_tasks; i++)
+			task_func(task_data, i);
+		return;
+	}
+	for (int i = 1; i < nu_tasks; i++) {
+		thread_info[i].task_func = task_func;
+		thread_info[i].task_data = task_data;
+		thread_info[i].task_index = i;
+		thread_created[i] = (pthread_create(&threads[i], NULL, ThreadStart,
+			&thread_info[i]) == 0);
+	}
+	task_func(task_data, 0);
+	for (int i = 1; i < nu_tasks; i++)
+		if (thread_created[i])
+			pthread_join(threads[i], NULL);
+		else
+			task_func(task_data, i);
+	detexFree(thread_created);
+	detexFree(thread_info);
+	detexFree(threads);
+}
+
+int detexGetDefaultNumberOfThreads() {
+	long nu_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return nu_cpus > 0 ? (int)nu_cpus : 1;
+}
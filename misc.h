@@ -19,3 +19,68 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 void detexSetErrorMessage(const char *format, ...);
 
+
+// Reader state for loading texture files from a memory buffer.
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+	size_t position;
+} detexMemoryReader;
+
+// Read callbacks for a FILE pointer passed as user_data.
+size_t detexReadFromFile(void *user_data, void *buffer, size_t size);
+bool detexSkipInFile(void *user_data, size_t size);
+
+// Read callbacks for a detexMemoryReader passed as user_data.
+size_t detexReadFromMemory(void *user_data, void *buffer, size_t size);
+bool detexSkipInMemory(void *user_data, size_t size);
+
+// Set the error message for a read error. filename may be NULL when the data does not
+// come from a file.
+void detexSetReadErrorMessage(const char *func_name, const char *filename);
+
+// Skip size bytes using the skip callback when available, otherwise by reading and
+// discarding the data. Returns true if successful.
+bool detexSkipData(const detexReadCallbacks *callbacks, size_t size);
+
+// Random access reader used to build texture file indices. read_at reads size bytes at
+// offset and returns true if successful. size is the total size of the data.
+typedef struct {
+	bool (*read_at)(void *user_data, uint64_t offset, void *buffer, size_t size);
+	void *user_data;
+	uint64_t size;
+} detexRandomAccessReader;
+
+// Read size bytes at offset, checking against the size of the data. Returns true if
+// successful.
+bool detexReadAt(const detexRandomAccessReader *reader, uint64_t offset, void *buffer, size_t size);
+
+// read_at functions for a pointer to a file descriptor and for a pointer to data in memory.
+bool detexReadAtFileDescriptor(void *user_data, uint64_t offset, void *buffer, size_t size);
+bool detexReadAtMemory(void *user_data, uint64_t offset, void *buffer, size_t size);
+
+// Return whether texture dimensions read from a file header are within the range that the
+// loaders support. Larger dimensions would overflow the block calculations.
+bool detexTextureDimensionsAreValid(uint32_t width, uint32_t height);
+
+// Free the first nu_textures textures of an array of allocated textures, including their
+// data, and the array itself.
+void detexFreeTextures(detexTexture **textures, int nu_textures);
+
+// Load mip-map levels described by an index from a random access reader into allocated
+// textures. Returns true if successful.
+bool detexLoadLevelsFromReader(const detexRandomAccessReader *reader,
+	const detexTextureLevelInfo *levels, int nu_levels, const char *func_name,
+	detexTexture ***textures_out);
+
+// Open a file for indexing. Returns an index without levels.
+bool detexOpenTextureFileIndex(const char *filename, const char *func_name,
+	detexTextureFileIndex **index_out);
+
+// Default task runner for the multithreaded functions, which creates a thread for each
+// task.
+void detexRunTasksPthreads(detexTaskFunc task_func, void *task_data, int nu_tasks,
+	void *user_data);
+
+// Number of threads used by the multithreaded functions when nu_threads <= 0.
+int detexGetDefaultNumberOfThreads();
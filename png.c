@@ -19,15 +19,42 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 // This file is not part of the detex library proper, but used by detex-convert.
 
 #include <stdlib.h>
+#include <string.h>
 #include <alloca.h>
 #include <png.h>
 
 #include "detex.h"
 #include "detex-png.h"
 
-// Load texture from PNG file (first mip-map only). Returns true if successful.
-// The texture is allocated, free with free().
-bool detexLoadPNGFile(const char *filename, detexTexture **texture_out) {
+// libpng read function that reads from the detexReadCallbacks set as I/O pointer.
+static void ReadPNGData(png_structp png_ptr, png_bytep data, png_size_t length) {
+	const detexReadCallbacks *callbacks = (const detexReadCallbacks *)png_get_io_ptr(png_ptr);
+	if (callbacks->read(callbacks->user_data, data, length) != length)
+		png_error(png_ptr, "Read error");
+}
+
+static size_t ReadFromFile(void *user_data, void *buffer, size_t size) {
+	return fread(buffer, 1, size, (FILE *)user_data);
+}
+
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+	size_t position;
+} MemoryReader;
+
+static size_t ReadFromMemory(void *user_data, void *buffer, size_t size) {
+	MemoryReader *reader = (MemoryReader *)user_data;
+	if (size > reader->size - reader->position)
+		size = reader->size - reader->position;
+	memcpy(buffer, reader->data + reader->position, size);
+	reader->position += size;
+	return size;
+}
+
+// Load texture from PNG data provided by read callbacks. filename is only used for error
+// messages and may be NULL.
+static bool LoadPNG(const detexReadCallbacks *callbacks, const char *filename, detexTexture **texture_out) {
 	int png_width, png_height;
 	png_byte color_type;
 	png_byte bit_depth;
@@ -38,19 +65,20 @@ bool detexLoadPNGFile(const char *filename, detexTexture **texture_out) {
 
 	png_byte header[8];    // 8 is the maximum size that can be checked
 
-        FILE *fp = fopen(filename, "rb");
-	if (!fp) {
-		printf("Error - file %s could not be opened for reading.\n", filename);
-		return false;
-	}
 	// Read header.
-	size_t r = fread(header, 1, 8, fp);
+	size_t r = callbacks->read(callbacks->user_data, header, 8);
 	if (r != 8) {
-		printf("Error reading file %s\n", filename);
+		if (filename != NULL)
+			printf("Error reading file %s\n", filename);
+		else
+			printf("Error reading PNG data\n");
 		return false;
 	}
 	if (png_sig_cmp(header, 0, 8)) {
-		printf("Error - file %s is not recognized as a PNG file.\n", filename);
+		if (filename != NULL)
+			printf("Error - file %s is not recognized as a PNG file.\n", filename);
+		else
+			printf("Error - data is not recognized as PNG data.\n");
 		return false;
 	}
 
@@ -64,15 +92,17 @@ bool detexLoadPNGFile(const char *filename, detexTexture **texture_out) {
 	info_ptr = png_create_info_struct(png_ptr);
 	if (!info_ptr) {
 		printf("png_create_info_struct failed\n");
+		png_destroy_read_struct(&png_ptr, NULL, NULL);
 		return false;
 	}
 
 	if (setjmp(png_jmpbuf(png_ptr))) {
 		printf("Error during PNG I/O initialization.");
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 		return false;
 	}
 
-	png_init_io(png_ptr, fp);
+	png_set_read_fn(png_ptr, (png_voidp)callbacks, ReadPNGData);
 	png_set_sig_bytes(png_ptr, 8);
 
 	png_read_info(png_ptr, info_ptr);
@@ -83,28 +113,18 @@ bool detexLoadPNGFile(const char *filename, detexTexture **texture_out) {
 	bit_depth = png_get_bit_depth(png_ptr, info_ptr);
 	if (bit_depth != 8 && bit_depth != 16) {
 		printf("Error - unexpected bit depth in PNG file\n");
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 		return false;
 	}
 
 	number_of_passes = png_set_interlace_handling(png_ptr);
 	if (number_of_passes > 1) {
 		printf("Error - interlaced PNG files not supported\n");
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 		return false;
 	}
 	png_read_update_info(png_ptr, info_ptr);
 
-        /* Read pixel data. */
-	if (setjmp(png_jmpbuf(png_ptr))) {
-		printf("Error during png_read_image.\n");
-		return false;
-        }
-	row_pointers = (png_bytep *)malloc(sizeof(png_bytep) * png_height);
-	int row_bytes = png_get_rowbytes(png_ptr, info_ptr);
-	for (int y = 0; y < png_height; y++)
-		row_pointers[y] = (png_byte *)malloc(row_bytes);
-	png_read_image(png_ptr, row_pointers);
-	fclose(fp);
-
 	uint32_t format;
 	if (color_type == PNG_COLOR_TYPE_GRAY)
 		if (bit_depth == 8)
@@ -123,26 +143,87 @@ bool detexLoadPNGFile(const char *filename, detexTexture **texture_out) {
 			format = DETEX_PIXEL_FORMAT_RGBA16;
 	else {
 		printf("Error - unexpected bit color type in PNG file\n");
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 		return false;
 	}
 
-	detexTexture *texture = (detexTexture *)malloc(sizeof(detexTexture));
+	// The rows are read directly into the texture data. Everything is allocated before
+	// setjmp so that the error path can release it.
+	size_t row_bytes = png_get_rowbytes(png_ptr, info_ptr);
+	detexTexture *texture = (detexTexture *)detexAllocate(sizeof(detexTexture));
+	uint8_t *data = (uint8_t *)detexAllocate(png_height * row_bytes);
+	row_pointers = (png_bytep *)malloc(sizeof(png_bytep) * png_height);
+	if (texture == NULL || data == NULL || row_pointers == NULL) {
+		printf("Error - out of memory loading PNG data\n");
+		free(row_pointers);
+		detexFree(data);
+		detexFree(texture);
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return false;
+	}
+	for (int y = 0; y < png_height; y++)
+		row_pointers[y] = data + y * row_bytes;
+
+        /* Read pixel data. */
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		printf("Error during png_read_image.\n");
+		free(row_pointers);
+		detexFree(data);
+		detexFree(texture);
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return false;
+        }
+	png_read_image(png_ptr, row_pointers);
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	free(row_pointers);
+
 	texture->format = format;
 	texture->width = png_width;
 	texture->height = png_height;
 	texture->width_in_blocks = png_width;
 	texture->height_in_blocks = png_height;
-	texture->data = (uint8_t *)malloc(png_height * row_bytes);
-	for (int y = 0; y < png_height; y++)
-		memcpy(texture->data + y * row_bytes, row_pointers[y], row_bytes);
-	// Clean up.
-	for (int y = 0; y < png_height; y++)
-		free(row_pointers[y]);
-	free(row_pointers);
+	texture->data = data;
 	*texture_out = texture;
 	return true;
 }
 
+// Load texture from PNG file (first mip-map only). Returns true if successful.
+// The texture and its data are allocated, free with detexFree().
+bool detexLoadPNGFile(const char *filename, detexTexture **texture_out) {
+	FILE *fp = fopen(filename, "rb");
+	if (!fp) {
+		printf("Error - file %s could not be opened for reading.\n", filename);
+		return false;
+	}
+	detexReadCallbacks callbacks;
+	callbacks.read = ReadFromFile;
+	callbacks.skip = NULL;
+	callbacks.user_data = fp;
+	bool r = LoadPNG(&callbacks, filename, texture_out);
+	fclose(fp);
+	return r;
+}
+
+// Load texture from PNG data in memory (first mip-map only). Returns true if successful.
+// The texture and its data are allocated, free with detexFree().
+bool detexLoadPNGMemory(const uint8_t *data, size_t size, detexTexture **texture_out) {
+	MemoryReader reader;
+	reader.data = data;
+	reader.size = size;
+	reader.position = 0;
+	detexReadCallbacks callbacks;
+	callbacks.read = ReadFromMemory;
+	callbacks.skip = NULL;
+	callbacks.user_data = &reader;
+	return LoadPNG(&callbacks, NULL, texture_out);
+}
+
+// Load texture from PNG data provided by read callbacks (first mip-map only). Returns true
+// if successful. The texture and its data are allocated, free with detexFree().
+bool detexLoadPNGCallbacks(const detexReadCallbacks *callbacks, detexTexture **texture_out) {
+	return LoadPNG(callbacks, NULL, texture_out);
+}
+
 // Save texture to PNG file (single mip-map level). Returns true if succesful.
 bool detexSavePNGFile(detexTexture *texture, const char *filename) {
 	int color_type;
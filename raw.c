@@ -24,29 +24,65 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "file-info.h"
 #include "misc.h"
 
+// Load raw texture data provided by read callbacks. filename is only used for error
+// messages and may be NULL.
+static bool LoadRaw(const detexReadCallbacks *callbacks, const char *func_name,
+const char *filename, detexTexture *texture) {
+	size_t size;
+	if (detexFormatIsCompressed(texture->format))
+		size = (size_t)detexGetCompressedBlockSize(texture->format) * texture->width_in_blocks *
+			texture->height_in_blocks;
+	else
+		size = (size_t)detexGetPixelSize(texture->format) * texture->width * texture->height;
+	texture->data = (uint8_t *)detexAllocate(size);
+	if (texture->data == NULL && size > 0) {
+		detexSetErrorMessage("%s: Out of memory", func_name);
+		return false;
+	}
+	if (callbacks->read(callbacks->user_data, texture->data, size) < size) {
+		detexFree(texture->data);
+		detexSetReadErrorMessage(func_name, filename);
+		return false;
+	}
+	return true;
+}
+
 // Load texture from raw file (first mip-map only) given the format and dimensions
 // in texture. Returns true if successful.
-// The texture->data is allocated, free with free().
+// The texture->data is allocated, free with detexFree().
 bool detexLoadRawFile(const char *filename, detexTexture *texture) {
 	FILE *f = fopen(filename, "rb");
 	if (f == NULL) {
 		detexSetErrorMessage("detexLoadRawFile: Could not open file %s", filename);
 		return false;
 	}
-	size_t size;
-	if (detexFormatIsCompressed(texture->format))
-		size = detexGetCompressedBlockSize(texture->format) * texture->width_in_blocks *
-			texture->height_in_blocks;
-	else
-		size = detexGetPixelSize(texture->format) * texture->width * texture->height;
-	texture->data = (uint8_t *)malloc(size);
-	if (fread(texture->data, 1, size, f) < size) {
-		free(texture->data);
-		detexSetErrorMessage("detexLoadRawFile: Error reading file %s", filename);
-		return false;
-	}
+	detexReadCallbacks callbacks;
+	callbacks.read = detexReadFromFile;
+	callbacks.skip = detexSkipInFile;
+	callbacks.user_data = f;
+	bool r = LoadRaw(&callbacks, "detexLoadRawFile", filename, texture);
 	fclose(f);
-	return true;
+	return r;
+}
+
+// Load texture from raw data in memory given the format and dimensions in texture.
+// Returns true if successful. The texture->data is allocated, free with detexFree().
+bool detexLoadRawMemory(const uint8_t *data, size_t size, detexTexture *texture) {
+	detexMemoryReader reader;
+	reader.data = data;
+	reader.size = size;
+	reader.position = 0;
+	detexReadCallbacks callbacks;
+	callbacks.read = detexReadFromMemory;
+	callbacks.skip = detexSkipInMemory;
+	callbacks.user_data = &reader;
+	return LoadRaw(&callbacks, "detexLoadRawMemory", NULL, texture);
+}
+
+// Load texture from raw data provided by read callbacks given the format and dimensions
+// in texture. Returns true if successful. The texture->data is allocated, free with detexFree().
+bool detexLoadRawCallbacks(const detexReadCallbacks *callbacks, detexTexture *texture) {
+	return LoadRaw(callbacks, "detexLoadRawCallbacks", NULL, texture);
 }
 
 // Save texture to raw file (first mip-map only) given the format and dimensions
@@ -64,7 +100,7 @@ bool detexSaveRawFile(detexTexture *texture, const char *filename) {
 	else
 		size = detexGetPixelSize(texture->format) * texture->width * texture->height;
 	if (fwrite(texture->data, 1, size, f) < size) {
-		free(texture->data);
+		detexFree(texture->data);
 		detexSetErrorMessage("detexSaveRawFile: Error writing to file %s", filename);
 		return false;
 	}
@@ -0,0 +1,57 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// SIMD support. Kernels are compiled for a specific instruction set using
+// function target attributes, so that the rest of the library does not depend
+// on compiler flags, and are selected at run-time based on the CPU features
+// reported by cpuid. The scalar code is always available as a fallback.
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+
+#define DETEX_SIMD_X86
+
+#include <immintrin.h>
+
+#define DETEX_TARGET_SSE2 __attribute__((target("sse2")))
+#define DETEX_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define DETEX_TARGET_AVX2 __attribute__((target("avx2")))
+#define DETEX_TARGET_F16C __attribute__((target("avx,f16c")))
+#define DETEX_TARGET_AVX2_F16C __attribute__((target("avx2,f16c")))
+#define DETEX_TARGET_AVX512 __attribute__((target("avx512f")))
+
+static DETEX_INLINE_ONLY bool detexCPUSupportsSSE2() {
+	return __builtin_cpu_supports("sse2");
+}
+
+static DETEX_INLINE_ONLY bool detexCPUSupportsSSSE3() {
+	return __builtin_cpu_supports("ssse3");
+}
+
+static DETEX_INLINE_ONLY bool detexCPUSupportsAVX2() {
+	return __builtin_cpu_supports("avx2");
+}
+
+static DETEX_INLINE_ONLY bool detexCPUSupportsF16C() {
+	return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+}
+
+static DETEX_INLINE_ONLY bool detexCPUSupportsAVX512() {
+	return __builtin_cpu_supports("avx512f");
+}
+
+#endif
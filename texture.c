@@ -19,6 +19,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <string.h>
 
 #include "detex.h"
+#include "half-float.h"
 #include "misc.h"
 
 typedef bool (*detexDecompressBlockFuncType)(const uint8_t *bitstring,
@@ -47,6 +48,37 @@ static detexDecompressBlockFuncType decompress_function[] = {
 	detexDecompressBlockEAC_SIGNED_RG11,
 };
 
+typedef void (*detexDecompressBlocksFuncType)(const uint8_t *bitstring, int nu_blocks,
+	uint8_t *pixel_buffer);
+
+// Maximum number of blocks decoded with one call to a multi-block function.
+#define DETEX_BLOCK_BATCH_SIZE 16
+
+// Multi-block decompression functions, for formats whose blocks always decode
+// successfully.
+static detexDecompressBlocksFuncType decompress_blocks_function[] = {
+	NULL,
+	detexDecompressBlocksBC1,
+	detexDecompressBlocksBC1A,
+	detexDecompressBlocksBC2,
+	detexDecompressBlocksBC3,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+};
+
 /*
  * General block decompression function. Block is decompressed using the given
  * compressed format, and stored in the given pixel format. Returns true if
@@ -69,34 +101,359 @@ uint32_t pixel_format) {
 		detexGetPixelFormat(texture_format), pixel_buffer, pixel_format); 
 }
 
-/*
- * Decode texture function (tiled). Decode an entire compressed texture into an
- * array of image buffer tiles (corresponding to compressed blocks), converting
- * into the given pixel format.
- */
-bool detexDecompressTextureTiled(const detexTexture *texture,
-uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t pixel_format) {
-	if (!detexFormatIsCompressed(texture->format)) {
-		detexSetErrorMessage("detexDecompressTextureTiled: Cannot handle uncompressed texture format");
+// Fused decompression. For common combinations of compressed format and target
+// pixel format, the pixels produced by the block decoder are converted while they
+// are stored into the output buffer, rather than calling detexConvertPixels for
+// every block. The decoder is selected once per texture. Only pairs for which
+// detexConvertPixels has a conversion are fused, so that the texture functions accept
+// the same pixel formats as detexDecompressBlock. Blocks are decoded in batches into a
+// small buffer in the native pixel format and then stored in the target format, rather
+// than having a separate block decoder for every target format.
+
+typedef struct detexFusedDecoder detexFusedDecoder;
+
+typedef void (*detexStorePixelsFuncType)(const detexFusedDecoder *decoder,
+	const uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
+	uint8_t * DETEX_RESTRICT target_pixel_buffer);
+
+struct detexFusedDecoder {
+	detexDecompressBlockFuncType decompress_func;
+	// Multi-block decompression function or NULL.
+	detexDecompressBlocksFuncType decompress_blocks_func;
+	// Function that stores decoded pixels in the target format. NULL when there
+	// is no fused path, in which case detexDecompressBlock is used.
+	detexStorePixelsFuncType store_func;
+	// Whether the block decoder output is already in the target format, so that
+	// tiles can be decoded directly into the target buffer.
+	bool store_is_copy;
+	int target_pixel_size;
+	// Per-component tables for 8-bit components to half-floats or floats.
+	uint16_t half_float_table[4][256];
+	float float_table[4][256];
+};
+
+static void StorePixelsCopy32(const detexFusedDecoder *decoder,
+const uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
+uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	memcpy(target_pixel_buffer, source_pixel_buffer, nu_pixels * 4);
+}
+
+static void StorePixelsCopy64(const detexFusedDecoder *decoder,
+const uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
+uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	memcpy(target_pixel_buffer, source_pixel_buffer, nu_pixels * 8);
+}
+
+// RGBA8/RGBX8 to BGRA8/BGRX8.
+static void StorePixelsSwapRB32(const detexFusedDecoder *decoder,
+const uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
+uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	const uint32_t *source_pixel32_buffer = (const uint32_t *)source_pixel_buffer;
+	uint32_t *target_pixel32_buffer = (uint32_t *)target_pixel_buffer;
+	for (int i = 0; i < nu_pixels; i++) {
+		uint32_t pixel = source_pixel32_buffer[i];
+		target_pixel32_buffer[i] = (pixel & 0xFF00FF00) | ((pixel & 0xFF) << 16) |
+			((pixel >> 16) & 0xFF);
+	}
+}
+
+// RGBA8/RGBX8 to FLOAT_RGBX16 using a table for each component.
+static void StorePixelsRGBA8ToFloatRGBX16(const detexFusedDecoder *decoder,
+const uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
+uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	uint16_t *target_pixel16_buffer = (uint16_t *)target_pixel_buffer;
+	for (int i = 0; i < nu_pixels; i++) {
+		target_pixel16_buffer[0] = decoder->half_float_table[0][source_pixel_buffer[0]];
+		target_pixel16_buffer[1] = decoder->half_float_table[1][source_pixel_buffer[1]];
+		target_pixel16_buffer[2] = decoder->half_float_table[2][source_pixel_buffer[2]];
+		target_pixel16_buffer[3] = decoder->half_float_table[3][source_pixel_buffer[3]];
+		source_pixel_buffer += 4;
+		target_pixel16_buffer += 4;
+	}
+}
+
+// RGBA8/RGBX8 to FLOAT_RGBX32 using a table for each component.
+static void StorePixelsRGBA8ToFloatRGBX32(const detexFusedDecoder *decoder,
+const uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
+uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	float *target_pixelf_buffer = (float *)target_pixel_buffer;
+	for (int i = 0; i < nu_pixels; i++) {
+		target_pixelf_buffer[0] = decoder->float_table[0][source_pixel_buffer[0]];
+		target_pixelf_buffer[1] = decoder->float_table[1][source_pixel_buffer[1]];
+		target_pixelf_buffer[2] = decoder->float_table[2][source_pixel_buffer[2]];
+		target_pixelf_buffer[3] = decoder->float_table[3][source_pixel_buffer[3]];
+		source_pixel_buffer += 4;
+		target_pixelf_buffer += 4;
+	}
+}
+
+// FLOAT_RGBX16 to FLOAT_RGBX32.
+static void StorePixelsFloatRGBX16ToFloatRGBX32(const detexFusedDecoder *decoder,
+const uint8_t * DETEX_RESTRICT source_pixel_buffer, int nu_pixels,
+uint8_t * DETEX_RESTRICT target_pixel_buffer) {
+	detexConvertHalfFloatToFloat((uint16_t *)source_pixel_buffer, nu_pixels * 4,
+		(float *)target_pixel_buffer);
+}
+
+// Fill the component tables of the decoder by converting every 8-bit value with
+// detexConvertPixels, so that the fused path gives exactly the same result. Returns
+// false when there is no conversion from the native pixel format.
+static bool SetComponentTables(uint32_t native_pixel_format, uint32_t pixel_format,
+detexFusedDecoder *decoder) {
+	uint8_t source_buffer[256 * 4];
+	uint8_t target_buffer[256 * 16];
+	for (int i = 0; i < 256 * 4; i++)
+		source_buffer[i] = i >> 2;
+	if (!detexConvertPixels(source_buffer, 256, native_pixel_format, target_buffer,
+	pixel_format))
 		return false;
+	for (int i = 0; i < 256; i++)
+		for (int j = 0; j < 4; j++)
+			if (pixel_format == DETEX_PIXEL_FORMAT_FLOAT_RGBX16)
+				decoder->half_float_table[j][i] = ((uint16_t *)target_buffer)[i * 4 + j];
+			else
+				decoder->float_table[j][i] = ((float *)target_buffer)[i * 4 + j];
+	return true;
+}
+
+// Select the fused decoder for a texture format and target pixel format. When
+// there is no fused path, decoder->store_func is set to NULL.
+static void SelectFusedDecoder(uint32_t texture_format, uint32_t pixel_format,
+detexFusedDecoder *decoder) {
+	decoder->decompress_func = decompress_function[detexGetCompressedFormat(texture_format)];
+	decoder->decompress_blocks_func =
+		decompress_blocks_function[detexGetCompressedFormat(texture_format)];
+	decoder->store_func = NULL;
+	decoder->store_is_copy = false;
+	decoder->target_pixel_size = detexGetPixelSize(pixel_format);
+	uint32_t native_pixel_format = detexGetPixelFormat(texture_format);
+	if (native_pixel_format == DETEX_PIXEL_FORMAT_RGBA8 ||
+	native_pixel_format == DETEX_PIXEL_FORMAT_RGBX8) {
+		switch (pixel_format) {
+		case DETEX_PIXEL_FORMAT_RGBA8 :
+		case DETEX_PIXEL_FORMAT_RGBX8 :
+			decoder->store_func = StorePixelsCopy32;
+			decoder->store_is_copy = true;
+			break;
+		case DETEX_PIXEL_FORMAT_BGRA8 :
+		case DETEX_PIXEL_FORMAT_BGRX8 :
+			decoder->store_func = StorePixelsSwapRB32;
+			break;
+		case DETEX_PIXEL_FORMAT_FLOAT_RGBX16 :
+			if (SetComponentTables(native_pixel_format, pixel_format, decoder))
+				decoder->store_func = StorePixelsRGBA8ToFloatRGBX16;
+			break;
+		case DETEX_PIXEL_FORMAT_FLOAT_RGBX32 :
+			if (SetComponentTables(native_pixel_format, pixel_format, decoder))
+				decoder->store_func = StorePixelsRGBA8ToFloatRGBX32;
+			break;
+		}
+	}
+	else if (native_pixel_format == DETEX_PIXEL_FORMAT_FLOAT_RGBX16) {
+		switch (pixel_format) {
+		case DETEX_PIXEL_FORMAT_FLOAT_RGBX16 :
+			decoder->store_func = StorePixelsCopy64;
+			decoder->store_is_copy = true;
+			break;
+		case DETEX_PIXEL_FORMAT_FLOAT_RGBX32 :
+			decoder->store_func = StorePixelsFloatRGBX16ToFloatRGBX32;
+			break;
+		}
+	}
+}
+
+// Decompress a block to a tile in the target pixel format using the fused decoder.
+static DETEX_INLINE_ONLY bool DecompressBlockFused(const detexFusedDecoder *decoder,
+const uint8_t * DETEX_RESTRICT bitstring, uint32_t texture_format,
+uint8_t * DETEX_RESTRICT pixel_buffer) {
+	uint8_t block_buffer[DETEX_MAX_BLOCK_SIZE];
+	uint8_t *decoder_buffer = decoder->store_is_copy ? pixel_buffer : block_buffer;
+	if (!decoder->decompress_func(bitstring, DETEX_MODE_MASK_ALL, 0, decoder_buffer)) {
+		detexSetErrorMessage("detexDecompressBlock: Decompress function for format "
+			"0x%08X returned error", texture_format);
+		return false;
+	}
+	if (!decoder->store_is_copy)
+		decoder->store_func(decoder, block_buffer, 16, pixel_buffer);
+	return true;
+}
+
+// Decompress the block rows y_start to y_end - 1 of a compressed texture into
+// an array of tiles. pixel_buffer points to the start of the whole tiled image.
+static bool DecompressBlockRowsTiled(const detexTexture *texture,
+const detexFusedDecoder *decoder, int y_start, int y_end,
+uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t pixel_format) {
+	uint32_t compressed_block_size = detexGetCompressedBlockSize(texture->format);
+	uint32_t block_size = detexGetPixelSize(pixel_format) * 16;
+	const uint8_t *data = texture->data + (size_t)y_start * texture->width_in_blocks *
+		compressed_block_size;
+	pixel_buffer += (size_t)y_start * texture->width_in_blocks * block_size;
+	if (decoder->store_func != NULL && decoder->decompress_blocks_func != NULL) {
+		// Decode whole rows of blocks at a time.
+		uint8_t batch_buffer[DETEX_BLOCK_BATCH_SIZE * 64];
+		for (int y = y_start; y < y_end; y++)
+			for (int x = 0; x < texture->width_in_blocks; x += DETEX_BLOCK_BATCH_SIZE) {
+				int nu_blocks = texture->width_in_blocks - x;
+				if (nu_blocks > DETEX_BLOCK_BATCH_SIZE)
+					nu_blocks = DETEX_BLOCK_BATCH_SIZE;
+				if (decoder->store_is_copy)
+					decoder->decompress_blocks_func(data, nu_blocks, pixel_buffer);
+				else {
+					decoder->decompress_blocks_func(data, nu_blocks, batch_buffer);
+					decoder->store_func(decoder, batch_buffer, nu_blocks * 16,
+						pixel_buffer);
+				}
+				data += nu_blocks * compressed_block_size;
+				pixel_buffer += nu_blocks * block_size;
+			}
+		return true;
 	}
-	const uint8_t *data = texture->data;
 	bool result = true;
-	for (int y = 0; y < texture->height_in_blocks; y++)
+	for (int y = y_start; y < y_end; y++)
 		for (int x = 0; x < texture->width_in_blocks; x++) {
-			bool r = detexDecompressBlock(data, texture->format,
-				DETEX_MODE_MASK_ALL, 0, pixel_buffer, pixel_format);
-			uint32_t block_size = detexGetPixelSize(pixel_format) * 16;
+			bool r;
+			if (decoder->store_func != NULL)
+				r = DecompressBlockFused(decoder, data, texture->format, pixel_buffer);
+			else
+				r = detexDecompressBlock(data, texture->format,
+					DETEX_MODE_MASK_ALL, 0, pixel_buffer, pixel_format);
 			if (!r) {
 				result = false;
 				memset(pixel_buffer, 0, block_size);
 			}
-			data += detexGetCompressedBlockSize(texture->format);
+			data += compressed_block_size;
 			pixel_buffer += block_size;
 		}
 	return result;
 }
 
+// Decompress the block rows y_start to y_end - 1 of a compressed texture, storing
+// only the pixels inside the rectangle (x, y, width, height) of the texture. Partial
+// blocks at the edges of the rectangle are clipped. pixel_buffer points to the
+// pixel at (x, y) and rows of the output are stride bytes apart.
+static bool DecompressBlockRowsRegion(const detexTexture *texture,
+const detexFusedDecoder *decoder, int x, int y, int width, int height,
+int y_start, int y_end, uint8_t * DETEX_RESTRICT pixel_buffer, size_t stride,
+uint32_t pixel_format) {
+	uint8_t block_buffer[DETEX_MAX_BLOCK_SIZE];
+	uint32_t compressed_block_size = detexGetCompressedBlockSize(texture->format);
+	int pixel_size = detexGetPixelSize(pixel_format);
+	int source_pixel_size = detexGetPixelSize(texture->format);
+	int bx_start = x / 4;
+	int bx_end = (x + width + 3) / 4;
+	bool result = true;
+	for (int by = y_start; by < y_end; by++) {
+		// Determine the rows of the block that lie inside the rectangle.
+		int first_row = 0;
+		if (by * 4 < y)
+			first_row = y - by * 4;
+		int nu_rows = 4;
+		if (by * 4 + 4 > y + height)
+			nu_rows = y + height - by * 4;
+		nu_rows -= first_row;
+		uint8_t *row_pixelp = pixel_buffer + (by * 4 + first_row - y) * stride;
+		const uint8_t *data = texture->data + ((size_t)by * texture->width_in_blocks + bx_start) *
+			compressed_block_size;
+		int bx = bx_start;
+		while (bx < bx_end) {
+			// Decode a batch of blocks when a multi-block function is available,
+			// otherwise a single block.
+			int nu_blocks = 1;
+			uint8_t batch_buffer[DETEX_BLOCK_BATCH_SIZE * 64];
+			const uint8_t *decoded_pixels;
+			int decoded_pixel_size;
+			bool r = true;
+			if (decoder->store_func != NULL && decoder->decompress_blocks_func != NULL) {
+				nu_blocks = bx_end - bx;
+				if (nu_blocks > DETEX_BLOCK_BATCH_SIZE)
+					nu_blocks = DETEX_BLOCK_BATCH_SIZE;
+				decoder->decompress_blocks_func(data, nu_blocks, batch_buffer);
+				decoded_pixels = batch_buffer;
+				decoded_pixel_size = source_pixel_size;
+			}
+			else if (decoder->store_func != NULL) {
+				r = decoder->decompress_func(data, DETEX_MODE_MASK_ALL, 0, block_buffer);
+				if (!r)
+					detexSetErrorMessage("detexDecompressBlock: Decompress function for format "
+						"0x%08X returned error", texture->format);
+				decoded_pixels = block_buffer;
+				decoded_pixel_size = source_pixel_size;
+			}
+			else {
+				r = detexDecompressBlock(data, texture->format, DETEX_MODE_MASK_ALL, 0,
+					block_buffer, pixel_format);
+				decoded_pixels = block_buffer;
+				decoded_pixel_size = pixel_size;
+			}
+			for (int i = 0; i < nu_blocks; i++) {
+				// Determine the columns of the block that lie inside the rectangle.
+				int first_column = 0;
+				if ((bx + i) * 4 < x)
+					first_column = x - (bx + i) * 4;
+				int nu_columns = 4;
+				if ((bx + i) * 4 + 4 > x + width)
+					nu_columns = x + width - (bx + i) * 4;
+				nu_columns -= first_column;
+				uint8_t *pixelp = row_pixelp + ((bx + i) * 4 + first_column - x) * pixel_size;
+				const uint8_t *sourcep = decoded_pixels + i * 16 * decoded_pixel_size +
+					(first_row * 4 + first_column) * decoded_pixel_size;
+				for (int row = 0; row < nu_rows; row++) {
+					if (!r)
+						memset(pixelp, 0, nu_columns * pixel_size);
+					else if (decoder->store_func != NULL)
+						decoder->store_func(decoder, sourcep, nu_columns, pixelp);
+					else
+						memcpy(pixelp, sourcep, nu_columns * pixel_size);
+					sourcep += 4 * decoded_pixel_size;
+					pixelp += stride;
+				}
+			}
+			if (!r)
+				result = false;
+			data += nu_blocks * compressed_block_size;
+			bx += nu_blocks;
+		}
+	}
+	return result;
+}
+
+// Decompress the block rows y_start to y_end - 1 of a compressed texture into
+// a linear image. pixel_buffer points to the start of the whole image.
+static bool DecompressBlockRowsLinear(const detexTexture *texture,
+const detexFusedDecoder *decoder, int y_start, int y_end,
+uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t pixel_format) {
+	return DecompressBlockRowsRegion(texture, decoder, 0, 0, texture->width, texture->height,
+		y_start, y_end, pixel_buffer, (size_t)texture->width * detexGetPixelSize(pixel_format),
+		pixel_format);
+}
+
+// Convert the pixel rows y_start to y_end - 1 of an uncompressed texture.
+static bool ConvertRowsLinear(const detexTexture *texture,
+const detexFusedDecoder *decoder, int y_start, int y_end,
+uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t pixel_format) {
+	size_t offset = (size_t)y_start * texture->width;
+	return detexConvertPixels(texture->data + offset * detexGetPixelSize(texture->format),
+		(y_end - y_start) * texture->width, detexGetPixelFormat(texture->format),
+		pixel_buffer + offset * detexGetPixelSize(pixel_format), pixel_format);
+}
+
+/*
+ * Decode texture function (tiled). Decode an entire compressed texture into an
+ * array of image buffer tiles (corresponding to compressed blocks), converting
+ * into the given pixel format.
+ */
+bool detexDecompressTextureTiled(const detexTexture *texture,
+uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t pixel_format) {
+	if (!detexFormatIsCompressed(texture->format)) {
+		detexSetErrorMessage("detexDecompressTextureTiled: Cannot handle uncompressed texture format");
+		return false;
+	}
+	detexFusedDecoder decoder;
+	SelectFusedDecoder(texture->format, pixel_format, &decoder);
+	return DecompressBlockRowsTiled(texture, &decoder, 0, texture->height_in_blocks,
+		pixel_buffer, pixel_format);
+}
+
 /*
  * Decode texture function (linear). Decode an entire texture into a single
  * image buffer, with pixels stored row-by-row, converting into the given pixel
@@ -104,43 +461,163 @@ uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t pixel_format) {
  */
 bool detexDecompressTextureLinear(const detexTexture *texture,
 uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t pixel_format) {
-	uint8_t block_buffer[DETEX_MAX_BLOCK_SIZE];
 	if (!detexFormatIsCompressed(texture->format)) {
 		return detexConvertPixels(texture->data, texture->width * texture->height,
 			detexGetPixelFormat(texture->format), pixel_buffer, pixel_format);
 	}
-	const uint8_t *data = texture->data;
-	int pixel_size = detexGetPixelSize(pixel_format);
-	bool result = true;
-	for (int y = 0; y < texture->height_in_blocks; y++) {
-		int nu_rows;
-		if (y * 4 + 3 >= texture->height)
-			nu_rows = texture->height - y * 4;
-		else
-			nu_rows = 4;
-		for (int x = 0; x < texture->width_in_blocks; x++) {
-			bool r = detexDecompressBlock(data, texture->format,
-				DETEX_MODE_MASK_ALL, 0, block_buffer, pixel_format);
-			uint32_t block_size = detexGetPixelSize(pixel_format) * 16;
-			if (!r) {
-				result = false;
-				memset(block_buffer, 0, block_size);
-			}
-			uint8_t *pixelp = pixel_buffer +
-				y * 4 * texture->width * pixel_size +
-				+ x * 4 * pixel_size;
-			int nu_columns;
-			if (x * 4 + 3  >= texture->width)
-				nu_columns = texture->width - x * 4;
-			else
-				nu_columns = 4;
-			for (int row = 0; row < nu_rows; row++)
-				memcpy(pixelp + row * texture->width * pixel_size,
-					block_buffer + row * 4 * pixel_size,
-					nu_columns * pixel_size);
-			data += detexGetCompressedBlockSize(texture->format);
-		}
+	detexFusedDecoder decoder;
+	SelectFusedDecoder(texture->format, pixel_format, &decoder);
+	return DecompressBlockRowsLinear(texture, &decoder, 0, texture->height_in_blocks,
+		pixel_buffer, pixel_format);
+}
+
+/*
+ * Decode a rectangular region of a texture. Only the blocks overlapping the
+ * rectangle with its top-left corner at (x, y) and the given width and height
+ * are decompressed; partial blocks at the edges of the rectangle are clipped.
+ * The pixels are stored row-by-row in the given pixel format, with rows that
+ * are stride bytes apart (when stride is 0, rows are stored contiguously). The
+ * rectangle must lie within the texture.
+ */
+bool detexDecompressTextureRegion(const detexTexture *texture, int x, int y, int width,
+int height, uint8_t * DETEX_RESTRICT pixel_buffer, size_t stride, uint32_t pixel_format) {
+	if (x < 0 || y < 0 || width <= 0 || height <= 0 || width > texture->width - x ||
+	height > texture->height - y) {
+		detexSetErrorMessage("detexDecompressTextureRegion: Region (%d, %d, %d x %d) is "
+			"not inside the texture", x, y, width, height);
+		return false;
+	}
+	size_t row_size = (size_t)width * detexGetPixelSize(pixel_format);
+	if (stride == 0)
+		stride = row_size;
+	if (stride < row_size) {
+		detexSetErrorMessage("detexDecompressTextureRegion: Stride is smaller than a row");
+		return false;
+	}
+	if (!detexFormatIsCompressed(texture->format)) {
+		int source_pixel_size = detexGetPixelSize(texture->format);
+		for (int row = 0; row < height; row++)
+			if (!detexConvertPixels(texture->data + ((size_t)(y + row) * texture->width + x) *
+			source_pixel_size, width, detexGetPixelFormat(texture->format),
+			pixel_buffer + row * stride, pixel_format))
+				return false;
+		return true;
+	}
+	detexFusedDecoder decoder;
+	SelectFusedDecoder(texture->format, pixel_format, &decoder);
+	return DecompressBlockRowsRegion(texture, &decoder, x, y, width, height, y / 4,
+		(y + height + 3) / 4, pixel_buffer, stride, pixel_format);
+}
+
+// Multithreaded decompression. The rows of the texture (block rows for compressed
+// textures, pixel rows for uncompressed textures) are divided into nu_tasks contiguous
+// ranges, each of which is handled by one task.
+
+typedef bool (*detexDecompressRowsFuncType)(const detexTexture *texture,
+	const detexFusedDecoder *decoder, int y_start, int y_end, uint8_t *pixel_buffer,
+	uint32_t pixel_format);
+
+typedef struct {
+	const detexTexture *texture;
+	const detexFusedDecoder *decoder;
+	uint8_t *pixel_buffer;
+	uint32_t pixel_format;
+	detexDecompressRowsFuncType decompress_rows_func;
+	int nu_rows;
+	int nu_tasks;
+	bool *task_result;
+} detexDecompressTaskInfo;
+
+static void DecompressTask(void *task_data, int task_index) {
+	detexDecompressTaskInfo *info = (detexDecompressTaskInfo *)task_data;
+	int y_start = (int)((int64_t)info->nu_rows * task_index / info->nu_tasks);
+	int y_end = (int)((int64_t)info->nu_rows * (task_index + 1) / info->nu_tasks);
+	info->task_result[task_index] = info->decompress_rows_func(info->texture, info->decoder,
+		y_start, y_end, info->pixel_buffer, info->pixel_format);
+}
+
+static bool DecompressTextureMultithreaded(const detexTexture *texture,
+uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t pixel_format,
+detexDecompressRowsFuncType decompress_rows_func, int nu_rows, int nu_threads,
+detexRunTasksFunc run_tasks, void *run_tasks_user_data, const char *func_name) {
+	if (nu_threads <= 0)
+		nu_threads = detexGetDefaultNumberOfThreads();
+	detexFusedDecoder decoder;
+	if (detexFormatIsCompressed(texture->format))
+		SelectFusedDecoder(texture->format, pixel_format, &decoder);
+	int nu_tasks = nu_threads;
+	if (nu_tasks > nu_rows)
+		nu_tasks = nu_rows;
+	bool *task_result = NULL;
+	if (nu_tasks > 1)
+		task_result = (bool *)detexAllocate(sizeof(bool) * nu_tasks);
+	// When there is a single task or the task results cannot be allocated, decompress in
+	// the calling thread.
+	if (task_result == NULL) {
+		bool r = decompress_rows_func(texture, &decoder, 0, nu_rows, pixel_buffer,
+			pixel_format);
+		if (!r)
+			detexSetErrorMessage("%s: Decompression failed", func_name);
+		return r;
 	}
+	detexDecompressTaskInfo info;
+	info.texture = texture;
+	info.decoder = &decoder;
+	info.pixel_buffer = pixel_buffer;
+	info.pixel_format = pixel_format;
+	info.decompress_rows_func = decompress_rows_func;
+	info.nu_rows = nu_rows;
+	info.nu_tasks = nu_tasks;
+	info.task_result = task_result;
+	if (run_tasks == NULL)
+		run_tasks = detexRunTasksPthreads;
+	run_tasks(DecompressTask, &info, nu_tasks, run_tasks_user_data);
+	bool result = true;
+	for (int i = 0; i < nu_tasks; i++)
+		result &= info.task_result[i];
+	detexFree(info.task_result);
+	// Error messages are thread-local, so set one for the calling thread.
+	if (!result)
+		detexSetErrorMessage("%s: Decompression failed", func_name);
 	return result;
 }
 
+/*
+ * Multithreaded version of detexDecompressTextureTiled. The block rows of the
+ * texture are divided over nu_threads tasks (when nu_threads <= 0, the number
+ * of online processors is used). The tasks are run using run_tasks when it is
+ * not NULL, otherwise a thread is created for each task. The output is identical
+ * to that of detexDecompressTextureTiled.
+ */
+bool detexDecompressTextureTiledMultithreaded(const detexTexture *texture,
+uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t pixel_format, int nu_threads,
+detexRunTasksFunc run_tasks, void *run_tasks_user_data) {
+	if (!detexFormatIsCompressed(texture->format)) {
+		detexSetErrorMessage("detexDecompressTextureTiledMultithreaded: Cannot handle uncompressed "
+			"texture format");
+		return false;
+	}
+	return DecompressTextureMultithreaded(texture, pixel_buffer, pixel_format,
+		DecompressBlockRowsTiled, texture->height_in_blocks, nu_threads, run_tasks,
+		run_tasks_user_data, "detexDecompressTextureTiledMultithreaded");
+}
+
+/*
+ * Multithreaded version of detexDecompressTextureLinear. The rows of the texture
+ * are divided over nu_threads tasks (when nu_threads <= 0, the number of online
+ * processors is used). The tasks are run using run_tasks when it is not NULL,
+ * otherwise a thread is created for each task. The output is identical to that
+ * of detexDecompressTextureLinear.
+ */
+bool detexDecompressTextureLinearMultithreaded(const detexTexture *texture,
+uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t pixel_format, int nu_threads,
+detexRunTasksFunc run_tasks, void *run_tasks_user_data) {
+	if (!detexFormatIsCompressed(texture->format))
+		return DecompressTextureMultithreaded(texture, pixel_buffer, pixel_format,
+			ConvertRowsLinear, texture->height, nu_threads, run_tasks,
+			run_tasks_user_data, "detexDecompressTextureLinearMultithreaded");
+	return DecompressTextureMultithreaded(texture, pixel_buffer, pixel_format,
+		DecompressBlockRowsLinear, texture->height_in_blocks, nu_threads, run_tasks,
+		run_tasks_user_data, "detexDecompressTextureLinearMultithreaded");
+}
+